@@ -0,0 +1,54 @@
+#version 450
+
+layout(local_size_x = 64) in;
+
+// CullCandidate in Renderer/DrawCulling.hpp
+struct CullCandidate {
+    vec4 sphere;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+    uint outputOffset;
+    uint counterIndex;
+    uint padding0;
+    uint padding1;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Candidates {
+    CullCandidate candidates[];
+};
+layout(std430, set = 0, binding = 1) writeonly buffer Draws {
+    DrawCommand draws[];
+};
+// Visible draws per model, cleared before the dispatch
+layout(std430, set = 0, binding = 2) buffer Counters {
+    uint counters[];
+};
+
+layout(push_constant) uniform Push {
+    // Normalized frustum planes, in the order of SGF::Frustum
+    vec4 planes[6];
+    uint candidateCount;
+} pc;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= pc.candidateCount) return;
+    CullCandidate candidate = candidates[index];
+    for (int i = 0; i < 6; ++i) {
+        if (dot(pc.planes[i].xyz, candidate.sphere.xyz) + pc.planes[i].w < -candidate.sphere.w) return;
+    }
+    // The range of the model is zero filled, draws behind the visible ones draw nothing
+    uint slot = atomicAdd(counters[candidate.counterIndex], 1);
+    draws[candidate.outputOffset + slot] = DrawCommand(candidate.indexCount, 1, candidate.firstIndex, candidate.vertexOffset, candidate.firstInstance);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+layout(set = 1, binding = 0) uniform sampler texSampler;
+layout(set = 1, binding = 1) uniform texture2D textures[128];
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 1) in vec4 color;
+layout(location = 2) flat in uint texIndex;
+layout(location = 3) in float intensity;
+layout(location = 4) flat in vec4 colorModifier;
+layout(location = 5) flat in uint pickID;
+layout(location = 6) flat in float transparency;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out uint modelPick;
+
+void main() {
+    outColor = mix(texture(sampler2D(textures[texIndex], texSampler), fragUV) * color * intensity, colorModifier, colorModifier.a);
+    modelPick = pickID;
+    outColor[3] = transparency;
+}
@@ -0,0 +1,52 @@
+#version 450
+
+layout (set = 0, binding = 0) uniform UniformBuffer {
+    mat4 transform;
+} ubo;
+
+struct NodeDrawData {
+    vec4 colorModifier;
+    uint pickID;
+    float transparency;
+};
+
+// One entry per node of every model drawn this frame
+layout (std430, set = 2, binding = 0) readonly buffer NodeData {
+    NodeDrawData nodes[];
+} nodeData;
+
+layout(push_constant) uniform Push {
+    uint firstNode;
+} pc;
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 uvCoord;
+layout(location = 3) in vec4 vertexColor;
+layout(location = 4) in uint textureIndex;
+
+layout(location = 5) in mat4 modelTransform;
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) out vec4 color;
+layout(location = 2) out uint texIndex;
+layout(location = 3) out float intensity;
+layout(location = 4) flat out vec4 colorModifier;
+layout(location = 5) flat out uint pickID;
+layout(location = 6) flat out float transparency;
+
+const vec3 sunVektor = normalize(vec3(0.5, 0.5, 0.5));
+
+void main() {
+    gl_Position = ubo.transform * modelTransform * vec4(vertexPosition, 1.0);
+    fragUV = uvCoord.xy;
+    color = vertexColor;
+    intensity = min(max(dot(normalize(vertexNormal.xyz), sunVektor), 0.3) + 0.2, 1.0);
+    texIndex = textureIndex;
+
+    // The first instance of every draw is its node index
+    NodeDrawData node = nodeData.nodes[pc.firstNode + gl_InstanceIndex];
+    colorModifier = node.colorModifier;
+    pickID = node.pickID;
+    transparency = node.transparency;
+}
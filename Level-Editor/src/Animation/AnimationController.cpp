@@ -1,5 +1,6 @@
 #include "AnimationController.hpp"
 #include "SGF.hpp"
+#include "Threading/ThreadPool.hpp"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <algorithm>
@@ -9,142 +10,278 @@ namespace SGF {
 		assert(pModel);
     }
 
-    void AnimationController::PlayAnimation(const std::string& animationName, bool loop) {
-        assert(pModel);
-		auto& model = *pModel;
-        for (size_t i = 0; i < model.animations.size(); ++i) {
-            if (model.animations[i].name == animationName) {
-                currentAnimationIndex = static_cast<uint32_t>(i);
-                currentTime = 0.0f;
-                isLooping = loop;
-                isPlaying = true;
-                return;
-            }
+    uint32_t AnimationController::FindAnimation(const std::string& animationName) const {
+        for (size_t i = 0; i < pModel->animations.size(); ++i) {
+            if (pModel->animations[i].name == animationName) return static_cast<uint32_t>(i);
         }
         Log::Warn("Animation '{}' not found!", animationName);
-		currentAnimationIndex = UINT32_MAX;
+        return UINT32_MAX;
     }
 
-    void AnimationController::Update(float deltaTime) {
-        if (currentAnimationIndex == UINT32_MAX || !isPlaying) return;
+    void AnimationController::StartPlayback(ClipPlayback& playback, uint32_t animationIndex, bool loop) {
+        playback.animationIndex = animationIndex;
+        playback.time = 0.0f;
+        playback.isLooping = loop;
+        if (animationIndex == UINT32_MAX) return;
+        playback.cursors.assign(pModel->animations[animationIndex].GetChannelCount(), ChannelCursor());
+        EnsureBaked(animationIndex);
+    }
 
-        const auto& animation = pModel->animations[currentAnimationIndex];
-        currentTime += deltaTime * animation.ticksPerSecond;
+    void AnimationController::PlayAnimation(const std::string& animationName, bool loop) {
+        assert(pModel);
+        StartPlayback(basePlayback, FindAnimation(animationName), loop);
+        fadingPlayback.animationIndex = UINT32_MAX;
+        isPlaying = basePlayback.animationIndex != UINT32_MAX;
+    }
 
-        if (currentTime > animation.duration) {
-            if (isLooping) {
-                currentTime = std::fmod(currentTime, animation.duration);
-            }
-            else {
-                currentAnimationIndex = UINT32_MAX;
-                return;
-            }
+    void AnimationController::CrossFade(const std::string& animationName, float duration, bool loop) {
+        uint32_t animationIndex = FindAnimation(animationName);
+        if (animationIndex == UINT32_MAX) return;
+        if (basePlayback.animationIndex == UINT32_MAX || duration <= 0.0f) {
+            PlayAnimation(animationName, loop);
+            return;
         }
+        // The cursors move along with the playback, so swapping keeps both allocations
+        std::swap(fadingPlayback, basePlayback);
+        StartPlayback(basePlayback, animationIndex, loop);
+        fadeDuration = duration;
+        fadeTime = 0.0f;
+        isPlaying = true;
+    }
 
-        UpdateBoneTransforms(animation, currentTime);
+    bool AnimationController::AdvancePlayback(ClipPlayback& playback, float deltaTime) const {
+        const auto& animation = pModel->animations[playback.animationIndex];
+        const bool isBaked = playback.animationIndex < bakedAnimations.size() && bakedAnimations[playback.animationIndex].IsBaked();
+        const float ticksPerSecond = isBaked ? bakedAnimations[playback.animationIndex].ticksPerSecond : GetTicksPerSecond(animation);
+        playback.time += deltaTime * ticksPerSecond;
+        if (playback.time > animation.duration) {
+            if (!playback.isLooping) return false;
+            playback.time = std::fmod(playback.time, animation.duration);
+        }
+        return true;
     }
 
-    void AnimationController::UpdateBoneTransforms(const GenericModel::Animation& animation, float animationTime) {
-		assert(currentAnimationIndex != UINT32_MAX);
-		auto& model = *pModel;
-        for (auto& bone : model.bones) {
-            bone.currentTransform = bone.nodeTransform;
+    void AnimationController::Update(float deltaTime) {
+        if (basePlayback.animationIndex == UINT32_MAX || !isPlaying) return;
+        if (!AdvancePlayback(basePlayback, deltaTime)) {
+            basePlayback.animationIndex = UINT32_MAX;
+            fadingPlayback.animationIndex = UINT32_MAX;
+            return;
+        }
+        if (fadingPlayback.animationIndex != UINT32_MAX) {
+            fadeTime += deltaTime;
+            if (fadeTime >= fadeDuration || !AdvancePlayback(fadingPlayback, deltaTime)) {
+                fadingPlayback.animationIndex = UINT32_MAX;
+            }
         }
-        for (const auto& channel : animation.channels) {
-            if (channel.boneIndex >= model.bones.size()) continue;
+        for (auto& layer : layers) {
+            if (layer.playback.animationIndex != UINT32_MAX && !AdvancePlayback(layer.playback, deltaTime)) {
+                layer.playback.animationIndex = UINT32_MAX;
+            }
+        }
+        UpdateBoneTransforms();
+    }
 
-            auto& bone = model.bones[channel.boneIndex];
+    PoseView AnimationController::AllocatePose(size_t boneCount) {
+        PoseView pose;
+        pose.translations = frameAllocator.Allocate<glm::vec3>(boneCount);
+        pose.rotations = frameAllocator.Allocate<glm::quat>(boneCount);
+        pose.scales = frameAllocator.Allocate<glm::vec3>(boneCount);
+        pose.boneCount = boneCount;
+        return pose;
+    }
 
-            glm::vec3 position;
-            glm::quat rotation;
-            glm::vec3 scale;
-            DecomposeTransformationMatrix(bone.nodeTransform, &position, &rotation, &scale);
+    void AnimationController::SampleClip(uint32_t animationIndex, float time, ChannelCursor* pCursors, const PoseView& pose, uint8_t* pIsBoneAnimated) {
+        CopyPose(bindPose.GetView(), pose);
+        const bool isBaked = animationIndex < bakedAnimations.size() && bakedAnimations[animationIndex].IsBaked();
+        if (!isBaked) {
+            SampleAnimation(pModel->animations[animationIndex], bindPose, time, pCursors, pose, pIsBoneAnimated);
+            return;
+        }
+        // Blend the two samples of all channels at once, then scatter them to their bones
+        const BakedAnimation& baked = bakedAnimations[animationIndex];
+        uint32_t sampleIndex;
+        float sampleFactor;
+        baked.GetSamplePosition(time, sampleIndex, sampleFactor);
+        const uint32_t nextSampleIndex = std::min(sampleIndex + 1, baked.sampleCount - 1);
+        const size_t channelCount = baked.GetChannelCount();
+        const size_t first = sampleIndex * channelCount, next = nextSampleIndex * channelCount;
+        PoseView channelPose = AllocatePose(channelCount);
+        LerpVectors(&baked.translations[first], &baked.translations[next], sampleFactor, channelPose.translations, channelCount);
+        NlerpRotations(&baked.rotations[first], &baked.rotations[next], sampleFactor, channelPose.rotations, channelCount);
+        LerpVectors(&baked.scales[first], &baked.scales[next], sampleFactor, channelPose.scales, channelCount);
+        for (size_t c = 0; c < channelCount; ++c) {
+            uint32_t bone = baked.channelBones[c];
+            pose.translations[bone] = channelPose.translations[c];
+            pose.rotations[bone] = channelPose.rotations[c];
+            pose.scales[bone] = channelPose.scales[c];
+            pIsBoneAnimated[bone] = 1;
+        }
+    }
 
-            if (!channel.positionKeys.empty()) {
-                position = InterpolatePosition(channel.positionKeys, animationTime);
-            }
-            if (!channel.rotationKeys.empty()) {
-                rotation = InterpolateRotation(channel.rotationKeys, animationTime);
-            }
-            if (!channel.scaleKeys.empty()) {
-                scale = InterpolateScale(channel.scaleKeys, animationTime);
+    void AnimationController::UpdateBoneTransforms() {
+		assert(basePlayback.animationIndex != UINT32_MAX);
+		auto& model = *pModel;
+        EnsureBindPose();
+        frameAllocator.Reset();
+        const size_t boneCount = model.bones.size();
+        uint8_t* pIsBoneAnimated = frameAllocator.Allocate<uint8_t>(boneCount);
+        std::fill_n(pIsBoneAnimated, boneCount, 0);
+        PoseView pose = AllocatePose(boneCount);
+        SampleClip(basePlayback.animationIndex, basePlayback.time, basePlayback.cursors.data(), pose, pIsBoneAnimated);
+        if (fadingPlayback.animationIndex != UINT32_MAX) {
+            PoseView fadingPose = AllocatePose(boneCount);
+            SampleClip(fadingPlayback.animationIndex, fadingPlayback.time, fadingPlayback.cursors.data(), fadingPose, pIsBoneAnimated);
+            BlendPoses(fadingPose, pose, fadeTime / fadeDuration, nullptr, pose);
+        }
+        if (!layers.empty()) {
+            PoseView layerPose = AllocatePose(boneCount);
+            uint8_t* pIsLayerBoneAnimated = frameAllocator.Allocate<uint8_t>(boneCount);
+            float* pBoneWeights = frameAllocator.Allocate<float>(boneCount);
+            for (auto& layer : layers) {
+                if (layer.playback.animationIndex == UINT32_MAX || layer.weight <= 0.0f) continue;
+                std::fill_n(pIsLayerBoneAnimated, boneCount, 0);
+                SampleClip(layer.playback.animationIndex, layer.playback.time, layer.playback.cursors.data(), layerPose, pIsLayerBoneAnimated);
+                // Bones the clip does not animate keep the pose below
+                for (size_t i = 0; i < boneCount; ++i) {
+                    pBoneWeights[i] = pIsLayerBoneAnimated[i] ? layer.weight * (layer.boneMask.empty() ? 1.0f : layer.boneMask[i]) : 0.0f;
+                    pIsBoneAnimated[i] |= pBoneWeights[i] > 0.0f;
+                }
+                if (layer.mode == AnimationBlendMode::OVERRIDE) {
+                    BlendPoses(pose, layerPose, 1.0f, pBoneWeights, pose);
+                } else {
+                    AddPose(pose, layerPose, layer.referencePose.GetView(), pBoneWeights);
+                }
             }
-            // Build transform: Translation * Rotation * Scale 
-            bone.currentTransform = glm::translate(glm::mat4(1.0f), position)
-                * glm::mat4_cast(rotation)
-                * glm::scale(glm::mat4(1.0f), scale);
         }
-        // Update parent-child hierarchy
-        for (size_t i = 1; i < model.bones.size(); ++i) {
+        // Compose the matrices only in the hierarchy pass, parents are stored before their children
+        for (size_t i = 0; i < boneCount; ++i) {
             auto& bone = model.bones[i];
+            glm::mat4 local = pIsBoneAnimated[i] ? ComposeTransform(pose.translations[i], pose.rotations[i], pose.scales[i]) : bone.nodeTransform;
             if (bone.parent != UINT32_MAX) {
-				assert(bone.parent < model.bones.size());
 				assert(bone.parent < i);
-                bone.currentTransform = model.bones[bone.parent].currentTransform * bone.currentTransform;
+                bone.currentTransform = model.bones[bone.parent].currentTransform * local;
+            } else {
+                bone.currentTransform = local;
             }
         }
     }
 
-    glm::vec3 AnimationController::InterpolatePosition(const std::vector<GenericModel::KeyFrame>& keys, float time) const {
-        if (keys.empty())
-            return glm::vec3(0.0f);
-        if (keys.size() == 1)
-            return keys[0].value;
-        if (time <= keys.front().time)
-            return keys.front().value;
-        if (time >= keys.back().time)
-            return keys.back().value;
-
-        for (size_t i = 0; i < keys.size() - 1; ++i) {
-            if (time >= keys[i].time && time <= keys[i + 1].time) {
-                float delta = keys[i + 1].time - keys[i].time;
-                if (delta <= 0.00001f)
-                    return keys[i].value;
-                float t = (time - keys[i].time) / delta;
-                return glm::mix(keys[i].value, keys[i + 1].value, t);
+    void AnimationController::EnsureBindPose() {
+        if (bindPose.GetSize() == pModel->bones.size()) return;
+        ComputeBindPose(*pModel, bindPose);
+    }
+
+    void AnimationController::EnsureBaked(uint32_t animationIndex) {
+        if (bakeSampleRate <= 0.0f || animationIndex == UINT32_MAX) return;
+        bakedAnimations.resize(pModel->animations.size());
+        if (!bakedAnimations[animationIndex].IsBaked()) {
+            EnsureBindPose();
+            bakedAnimations[animationIndex] = BakeAnimation(pModel->animations[animationIndex], bindPose, bakeSampleRate);
+        }
+    }
+
+    uint32_t AnimationController::AddLayer(AnimationBlendMode mode) {
+        layers.emplace_back();
+        layers.back().mode = mode;
+        return (uint32_t)(layers.size() - 1);
+    }
+
+    void AnimationController::RemoveLayer(uint32_t layer) {
+        assert(layer < layers.size());
+        layers.erase(layers.begin() + layer);
+    }
+
+    void AnimationController::PlayLayerAnimation(uint32_t layer, const std::string& animationName, bool loop) {
+        assert(layer < layers.size());
+        auto& playback = layers[layer].playback;
+        StartPlayback(playback, FindAnimation(animationName), loop);
+        if (playback.animationIndex == UINT32_MAX) return;
+        // Starts at the phase of the base animation, the clips may differ in duration and ticks per second
+        if (basePlayback.animationIndex != UINT32_MAX) {
+            const float baseDuration = pModel->animations[basePlayback.animationIndex].duration;
+            if (baseDuration > 0.0f) {
+                const float phase = std::min(basePlayback.time / baseDuration, 1.0f);
+                playback.time = phase * pModel->animations[playback.animationIndex].duration;
             }
         }
-        return keys.back().value;
-    }
-
-    glm::quat AnimationController::InterpolateRotation(const std::vector<GenericModel::RotationKeyFrame>& keys, float time) const {
-        if (keys.empty())
-            return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-        if (keys.size() == 1)
-            return keys[0].value;
-        if (time <= keys.front().time)
-            return keys.front().value;
-        if (time >= keys.back().time)
-            return keys.back().value;
-        for (size_t i = 0; i < keys.size() - 1; ++i) {
-            if (time >= keys[i].time && time <= keys[i + 1].time) {
-                float delta = keys[i + 1].time - keys[i].time;
-                if (delta <= 0.00001f)
-                    return keys[i].value;
-                float t = (time - keys[i].time) / delta;
-                glm::quat q1 = keys[i].value;
-                glm::quat q2 = keys[i + 1].value;
-                // Ensure shortest path
-                if (glm::dot(q1, q2) < 0.0f)
-                    q2 = -q2;
-                return glm::normalize(glm::slerp(q1, q2, t));
+        // Sampled once, it does not change while the layer plays
+        EnsureBindPose();
+        auto& referencePose = layers[layer].referencePose;
+        referencePose.Resize(bindPose.GetSize());
+        std::vector<ChannelCursor> cursors(playback.cursors.size());
+        std::vector<uint8_t> isBoneAnimated(bindPose.GetSize());
+        SampleClip(playback.animationIndex, 0.0f, cursors.data(), referencePose.GetView(), isBoneAnimated.data());
+    }
+
+    void AnimationController::SetLayerBoneMask(uint32_t layer, uint32_t rootBone) {
+        assert(layer < layers.size());
+        auto& mask = layers[layer].boneMask;
+        layers[layer].maskRootBone = rootBone;
+        if (rootBone >= pModel->bones.size()) {
+            mask.clear();
+            return;
+        }
+        // Parents come before their children, so one pass marks the whole subtree
+        const auto& bones = pModel->bones;
+        mask.assign(bones.size(), 0.0f);
+        for (size_t i = rootBone; i < bones.size(); ++i) {
+            if (i == rootBone || (bones[i].parent != UINT32_MAX && mask[bones[i].parent] > 0.0f)) {
+                mask[i] = 1.0f;
             }
         }
-        return keys.back().value;
+    }
+
+    void AnimationController::SetLayerBoneMask(uint32_t layer, const std::vector<float>& boneWeights) {
+        assert(layer < layers.size() && boneWeights.size() == pModel->bones.size());
+        layers[layer].boneMask = boneWeights;
+        layers[layer].maskRootBone = UINT32_MAX;
     }
 
     void AnimationController::GetBonePalette(std::vector<glm::mat4>& outPalette) const {
-		auto& model = *pModel;
-        outPalette.clear();
-        outPalette.reserve(model.bones.size());
-        glm::mat4 globalInverse = glm::inverse(pModel->GetRoot().globalTransform);
-        for (const auto& bone : model.bones) {
-            outPalette.push_back(bone.currentTransform * bone.offsetMatrix);
+        outPalette.resize(pModel->bones.size());
+        WriteBonePalette(outPalette.data());
+    }
+    void AnimationController::WriteBonePalette(glm::mat4* pOutPalette) const {
+		const auto& bones = pModel->bones;
+        for (size_t i = 0; i < bones.size(); ++i) {
+            pOutPalette[i] = bones[i].currentTransform * bones[i].offsetMatrix;
         }
     }
     void AnimationController::SetCurrentTime(float time) {
-		currentTime = time;
-        if (currentAnimationIndex == UINT32_MAX);
-		UpdateBoneTransforms(pModel->animations[currentAnimationIndex], currentTime);
+		basePlayback.time = time;
+        if (basePlayback.animationIndex == UINT32_MAX) return;
+		UpdateBoneTransforms();
+    }
+
+    void AnimationController::SetBakeSampleRate(float samplesPerSecond) {
+        if (samplesPerSecond == bakeSampleRate) return;
+        bakeSampleRate = std::max(samplesPerSecond, 0.0f);
+        bakedAnimations.clear();
+        EnsureBaked(basePlayback.animationIndex);
+        EnsureBaked(fadingPlayback.animationIndex);
+        for (const auto& layer : layers) {
+            EnsureBaked(layer.playback.animationIndex);
+        }
+    }
+
+    const BakedAnimation* AnimationController::GetBakedAnimation() const {
+        const uint32_t animationIndex = basePlayback.animationIndex;
+        if (animationIndex >= bakedAnimations.size() || !bakedAnimations[animationIndex].IsBaked()) return nullptr;
+        return &bakedAnimations[animationIndex];
+    }
+
+    void UpdateAnimationControllers(std::vector<AnimationController>& controllers, float deltaTime) {
+        ThreadPool::Get().ParallelFor(controllers.size(), [&](size_t i) {
+            controllers[i].Update(deltaTime);
+        });
+    }
+
+    void WriteBonePalettes(const std::vector<AnimationController>& controllers, glm::mat4* const* ppPalettes) {
+        ThreadPool::Get().ParallelFor(controllers.size(), [&](size_t i) {
+            if (ppPalettes[i] != nullptr) {
+                controllers[i].WriteBonePalette(ppPalettes[i]);
+            }
+        });
     }
-}
\ No newline at end of file
+}
@@ -2,36 +2,112 @@
 
 #include <glm/glm.hpp>
 #include "Model/Model.hpp"
+#include "AnimationSampling.hpp"
+#include "FrameAllocator.hpp"
 
 namespace SGF {
+    enum class AnimationBlendMode {
+        // Blends the pose below towards the layer by its weight
+        OVERRIDE,
+        // Adds the difference of the clip to its first frame on top of the pose below
+        ADDITIVE
+    };
+
+    // Plays a base animation, optionally fading out the previous one, and blends layers on top of it in order.
+    // All temporary poses of an update come from a frame allocator of the controller.
     class AnimationController {
     public:
         AnimationController(GenericModel* model);
 
         void PlayAnimation(const std::string& animationName, bool loop = true);
+        // Blends from the playing animation to the new one over fadeDuration seconds
+        void CrossFade(const std::string& animationName, float fadeDuration, bool loop = true);
         void Update(float deltaTime);
         void GetBonePalette(std::vector<glm::mat4>& outPalette) const;
+        // Writes one matrix per bone of the model to pOutPalette
+        void WriteBonePalette(glm::mat4* pOutPalette) const;
 
         inline bool IsPlaying() const { return isPlaying; }
-		inline void Stop() { currentAnimationIndex = UINT32_MAX; isPlaying = false; }
+		inline void Stop() { basePlayback.animationIndex = UINT32_MAX; fadingPlayback.animationIndex = UINT32_MAX; isPlaying = false; }
 		inline void Pause() { isPlaying = false; }
-		inline void Continue() { if (currentAnimationIndex != UINT32_MAX) isPlaying = true; }
-		inline void SetLooping(bool loop) { isLooping = loop; }
-        inline float GetCurrentTime() const { return currentTime; }
+		inline void Continue() { if (basePlayback.animationIndex != UINT32_MAX) isPlaying = true; }
+		inline void SetLooping(bool loop) { basePlayback.isLooping = loop; }
+        inline float GetCurrentTime() const { return basePlayback.time; }
+        inline bool IsCrossFading() const { return fadingPlayback.animationIndex != UINT32_MAX; }
 		inline GenericModel* GetModel() const { return pModel; }
+        inline size_t GetBoneCount() const { return pModel->bones.size(); }
         void SetCurrentTime(float time);
+        // Resamples the animations at a fixed rate on first use, so key lookup is a direct index. 0 samples the keys directly.
+        void SetBakeSampleRate(float samplesPerSecond);
+        inline float GetBakeSampleRate() const { return bakeSampleRate; }
+        // Baked data of the current animation or nullptr
+        const BakedAnimation* GetBakedAnimation() const;
+
+        // Layers play their own animation in sync with the base animation and are applied in the order they were added
+        uint32_t AddLayer(AnimationBlendMode mode);
+        void RemoveLayer(uint32_t layer);
+        void PlayLayerAnimation(uint32_t layer, const std::string& animationName, bool loop = true);
+        inline void SetLayerWeight(uint32_t layer, float weight) { layers[layer].weight = weight; }
+        // Limits the layer to the bone and its descendants, UINT32_MAX applies it to all bones
+        void SetLayerBoneMask(uint32_t layer, uint32_t rootBone);
+        // One weight per bone multiplied with the layer weight
+        void SetLayerBoneMask(uint32_t layer, const std::vector<float>& boneWeights);
+        inline size_t GetLayerCount() const { return layers.size(); }
+        inline float GetLayerWeight(uint32_t layer) const { return layers[layer].weight; }
+        inline AnimationBlendMode GetLayerMode(uint32_t layer) const { return layers[layer].mode; }
+        inline uint32_t GetLayerAnimationIndex(uint32_t layer) const { return layers[layer].playback.animationIndex; }
+        inline uint32_t GetLayerMaskRoot(uint32_t layer) const { return layers[layer].maskRootBone; }
+        inline const FrameAllocator& GetFrameAllocator() const { return frameAllocator; }
 
     private:
+        struct ClipPlayback {
+            uint32_t animationIndex = UINT32_MAX;
+            float time = 0.0f;
+            bool isLooping = true;
+            // Per channel of the animation
+            std::vector<ChannelCursor> cursors;
+        };
+        struct Layer {
+            ClipPlayback playback;
+            AnimationBlendMode mode;
+            float weight = 1.0f;
+            // Per bone factor of the weight, empty for all bones
+            std::vector<float> boneMask;
+            uint32_t maskRootBone = UINT32_MAX;
+            // First frame of the animation, the difference to it is added by additive layers
+            LocalPose referencePose;
+        };
+
         GenericModel* pModel;
-        uint32_t currentAnimationIndex = UINT32_MAX;
-        float currentTime = 0.0f;
-        bool isLooping = true;
+        ClipPlayback basePlayback;
+        // Previous base animation while crossfading
+        ClipPlayback fadingPlayback;
+        float fadeDuration = 0.0f;
+        float fadeTime = 0.0f;
 		bool isPlaying = false;
+        std::vector<Layer> layers;
 
-        glm::vec3 InterpolatePosition(const std::vector<GenericModel::KeyFrame>& keys, float time) const;
-		inline glm::vec3 InterpolateScale(const std::vector<GenericModel::KeyFrame>& keys, float time) const { return InterpolatePosition(keys, time); }
-        glm::quat InterpolateRotation(const std::vector<GenericModel::RotationKeyFrame>& keys, float time) const;
+        float bakeSampleRate = 0.0f;
+        // Per animation of the model, baked when it is played
+        std::vector<BakedAnimation> bakedAnimations;
+        // Decomposed once from the node transforms of the bones
+        LocalPose bindPose;
+        FrameAllocator frameAllocator;
 
-        void UpdateBoneTransforms(const GenericModel::Animation& animation, float animationTime);
+        uint32_t FindAnimation(const std::string& animationName) const;
+        void StartPlayback(ClipPlayback& playback, uint32_t animationIndex, bool loop);
+        // Returns false once an animation that does not loop has ended
+        bool AdvancePlayback(ClipPlayback& playback, float deltaTime) const;
+        void EnsureBindPose();
+        void EnsureBaked(uint32_t animationIndex);
+        PoseView AllocatePose(size_t boneCount);
+        // Writes the bind pose with the animated bones of the clip on top
+        void SampleClip(uint32_t animationIndex, float time, ChannelCursor* pCursors, const PoseView& pose, uint8_t* pIsBoneAnimated);
+        void UpdateBoneTransforms();
     };
-}
\ No newline at end of file
+
+    // Every controller is a job of the thread pool, so no two controllers may animate the same model.
+    void UpdateAnimationControllers(std::vector<AnimationController>& controllers, float deltaTime);
+    // Writes the palette of controller i to ppPalettes[i] in parallel, controllers with a nullptr destination are skipped.
+    void WriteBonePalettes(const std::vector<AnimationController>& controllers, glm::mat4* const* ppPalettes);
+}
@@ -0,0 +1,145 @@
+#include "AnimationSampling.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+#include <algorithm>
+
+namespace SGF {
+    namespace {
+        // Assimp leaves ticksPerSecond at 0 when the file does not specify it
+        constexpr float DEFAULT_TICKS_PER_SECOND = 25.0f;
+    }
+
+    float GetTicksPerSecond(const GenericModel::Animation& animation) {
+        return animation.ticksPerSecond > 0.0f ? animation.ticksPerSecond : DEFAULT_TICKS_PER_SECOND;
+    }
+
+    glm::vec3 SampleKeys(const std::vector<GenericModel::KeyFrame>& keys, float time, uint32_t& cursor) {
+        if (keys.empty())
+            return glm::vec3(0.0f);
+        if (keys.size() == 1 || time <= keys.front().time)
+            return keys.front().value;
+        if (time >= keys.back().time)
+            return keys.back().value;
+        uint32_t i = FindKeyIndex(keys, time, cursor);
+        float delta = keys[i + 1].time - keys[i].time;
+        if (delta <= 0.00001f)
+            return keys[i].value;
+        float t = (time - keys[i].time) / delta;
+        return glm::mix(keys[i].value, keys[i + 1].value, t);
+    }
+
+    glm::quat SampleKeys(const std::vector<GenericModel::RotationKeyFrame>& keys, float time, uint32_t& cursor) {
+        if (keys.empty())
+            return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        if (keys.size() == 1 || time <= keys.front().time)
+            return keys.front().value;
+        if (time >= keys.back().time)
+            return keys.back().value;
+        uint32_t i = FindKeyIndex(keys, time, cursor);
+        float delta = keys[i + 1].time - keys[i].time;
+        if (delta <= 0.00001f)
+            return keys[i].value;
+        float t = (time - keys[i].time) / delta;
+        glm::quat q1 = keys[i].value;
+        glm::quat q2 = keys[i + 1].value;
+        // Ensure shortest path
+        if (glm::dot(q1, q2) < 0.0f)
+            q2 = -q2;
+        return glm::normalize(glm::slerp(q1, q2, t));
+    }
+
+    glm::vec3 SampleTrack(const GenericModel::CompressedAnimation& animation, const GenericModel::CompressedTrack& track, const glm::vec3& min, const glm::vec3& extent, float time, uint32_t& cursor) {
+        assert(track.keyCount != 0);
+        const float* pTimes = &animation.times[track.timeOffset];
+        const uint16_t* pValues = &animation.values[track.valueOffset * 3];
+        if (track.keyCount == 1 || time <= pTimes[0])
+            return DecodeCompressedVector(pValues, min, extent);
+        if (time >= pTimes[track.keyCount - 1])
+            return DecodeCompressedVector(pValues + (track.keyCount - 1) * 3, min, extent);
+        uint32_t i = FindKeyIndex(pTimes, track.keyCount, time, cursor);
+        glm::vec3 v1 = DecodeCompressedVector(pValues + i * 3, min, extent);
+        float delta = pTimes[i + 1] - pTimes[i];
+        if (delta <= 0.00001f)
+            return v1;
+        return glm::mix(v1, DecodeCompressedVector(pValues + (i + 1) * 3, min, extent), (time - pTimes[i]) / delta);
+    }
+
+    glm::quat SampleRotationTrack(const GenericModel::CompressedAnimation& animation, const GenericModel::CompressedTrack& track, float time, uint32_t& cursor) {
+        assert(track.keyCount != 0);
+        const float* pTimes = &animation.times[track.timeOffset];
+        const uint16_t* pValues = &animation.values[track.valueOffset * 3];
+        if (track.keyCount == 1 || time <= pTimes[0])
+            return DecodeSmallestThree(pValues);
+        if (time >= pTimes[track.keyCount - 1])
+            return DecodeSmallestThree(pValues + (track.keyCount - 1) * 3);
+        uint32_t i = FindKeyIndex(pTimes, track.keyCount, time, cursor);
+        glm::quat q1 = DecodeSmallestThree(pValues + i * 3);
+        float delta = pTimes[i + 1] - pTimes[i];
+        if (delta <= 0.00001f)
+            return q1;
+        glm::quat q2 = DecodeSmallestThree(pValues + (i + 1) * 3);
+        if (glm::dot(q1, q2) < 0.0f)
+            q2 = -q2;
+        return glm::normalize(glm::slerp(q1, q2, (time - pTimes[i]) / delta));
+    }
+
+    void SampleAnimation(const GenericModel::Animation& animation, const LocalPose& bindPose, float time, ChannelCursor* pCursors, const PoseView& pose, uint8_t* pIsBoneAnimated) {
+        const size_t boneCount = bindPose.GetSize();
+        if (animation.IsCompressed()) {
+            const auto& compressed = animation.compressed;
+            for (size_t c = 0; c < compressed.channels.size(); ++c) {
+                const auto& channel = compressed.channels[c];
+                const uint32_t bone = channel.boneIndex;
+                if (bone >= boneCount) continue;
+                auto& cursor = pCursors[c];
+                pose.translations[bone] = channel.positions.keyCount == 0 ? bindPose.translations[bone] : SampleTrack(compressed, channel.positions, channel.positionMin, channel.positionExtent, time, cursor.position);
+                pose.rotations[bone] = channel.rotations.keyCount == 0 ? bindPose.rotations[bone] : SampleRotationTrack(compressed, channel.rotations, time, cursor.rotation);
+                pose.scales[bone] = channel.scales.keyCount == 0 ? bindPose.scales[bone] : SampleTrack(compressed, channel.scales, channel.scaleMin, channel.scaleExtent, time, cursor.scale);
+                if (pIsBoneAnimated != nullptr) pIsBoneAnimated[bone] = 1;
+            }
+            return;
+        }
+        for (size_t c = 0; c < animation.channels.size(); ++c) {
+            const auto& channel = animation.channels[c];
+            const uint32_t bone = channel.boneIndex;
+            if (bone >= boneCount) continue;
+            auto& cursor = pCursors[c];
+            pose.translations[bone] = channel.positionKeys.empty() ? bindPose.translations[bone] : SampleKeys(channel.positionKeys, time, cursor.position);
+            pose.rotations[bone] = channel.rotationKeys.empty() ? bindPose.rotations[bone] : SampleKeys(channel.rotationKeys, time, cursor.rotation);
+            pose.scales[bone] = channel.scaleKeys.empty() ? bindPose.scales[bone] : SampleKeys(channel.scaleKeys, time, cursor.scale);
+            if (pIsBoneAnimated != nullptr) pIsBoneAnimated[bone] = 1;
+        }
+    }
+
+    BakedAnimation BakeAnimation(const GenericModel::Animation& animation, const LocalPose& bindPose, float samplesPerSecond) {
+        BakedAnimation baked;
+        baked.duration = animation.duration;
+        baked.ticksPerSecond = GetTicksPerSecond(animation);
+        float samplesPerTick = samplesPerSecond / baked.ticksPerSecond;
+        baked.sampleCount = animation.duration > 0.0f ? std::max(2u, (uint32_t)std::ceil(animation.duration * samplesPerTick) + 1) : 1;
+        // The last sample lands exactly on the end of the animation
+        float sampleStep = baked.sampleCount > 1 ? animation.duration / (float)(baked.sampleCount - 1) : 0.0f;
+        for (size_t c = 0; c < animation.GetChannelCount(); ++c) {
+            uint32_t bone = animation.GetChannelBone(c);
+            if (bone < bindPose.GetSize()) baked.channelBones.push_back(bone);
+        }
+        const size_t channelCount = baked.channelBones.size();
+        baked.translations.resize(baked.sampleCount * channelCount);
+        baked.rotations.resize(baked.sampleCount * channelCount);
+        baked.scales.resize(baked.sampleCount * channelCount);
+        // The samples move forward in time, so the cursors only step to the next key
+        std::vector<ChannelCursor> cursors(animation.GetChannelCount());
+        LocalPose pose = bindPose;
+        for (uint32_t i = 0; i < baked.sampleCount; ++i) {
+            SampleAnimation(animation, bindPose, (float)i * sampleStep, cursors.data(), pose.GetView(), nullptr);
+            for (size_t c = 0; c < channelCount; ++c) {
+                const uint32_t bone = baked.channelBones[c];
+                size_t index = i * channelCount + c;
+                baked.translations[index] = pose.translations[bone];
+                baked.rotations[index] = pose.rotations[bone];
+                baked.scales[index] = pose.scales[bone];
+            }
+        }
+        return baked;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "Model/Model.hpp"
+#include "Model/AnimationCompression.hpp"
+#include "Pose.hpp"
+
+namespace SGF {
+    // Last key index of every key list of a channel, playback moves forward, so the next lookup starts there
+    struct ChannelCursor {
+        uint32_t position = 0;
+        uint32_t rotation = 0;
+        uint32_t scale = 0;
+    };
+
+    // Index i of the key pair with keys[i].time <= time <= keys[i + 1].time, keys needs at least two keys and time has to be inside them.
+    // Checks the cursor and its successor first and only searches after seeking or looping.
+    template<typename KEY>
+    inline uint32_t FindKeyIndex(const std::vector<KEY>& keys, float time, uint32_t& cursor) {
+        const uint32_t lastPair = (uint32_t)keys.size() - 2;
+        if (cursor <= lastPair && keys[cursor].time <= time) {
+            if (time <= keys[cursor + 1].time) return cursor;
+            if (cursor + 1 <= lastPair && time <= keys[cursor + 2].time) return ++cursor;
+        }
+        auto it = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const KEY& key) { return t < key.time; });
+        cursor = std::min((uint32_t)(it - keys.begin()) - 1, lastPair);
+        return cursor;
+    }
+
+    // Same as above for the key times of a compressed track
+    inline uint32_t FindKeyIndex(const float* pTimes, uint32_t count, float time, uint32_t& cursor) {
+        const uint32_t lastPair = count - 2;
+        if (cursor <= lastPair && pTimes[cursor] <= time) {
+            if (time <= pTimes[cursor + 1]) return cursor;
+            if (cursor + 1 <= lastPair && time <= pTimes[cursor + 2]) return ++cursor;
+        }
+        const float* pUpper = std::upper_bound(pTimes, pTimes + count, time);
+        cursor = std::min((uint32_t)(pUpper - pTimes) - 1, lastPair);
+        return cursor;
+    }
+
+    glm::vec3 SampleKeys(const std::vector<GenericModel::KeyFrame>& keys, float time, uint32_t& cursor);
+    glm::quat SampleKeys(const std::vector<GenericModel::RotationKeyFrame>& keys, float time, uint32_t& cursor);
+    // Tracks of compressed animations, the track needs at least one key
+    glm::vec3 SampleTrack(const GenericModel::CompressedAnimation& animation, const GenericModel::CompressedTrack& track, const glm::vec3& min, const glm::vec3& extent, float time, uint32_t& cursor);
+    glm::quat SampleRotationTrack(const GenericModel::CompressedAnimation& animation, const GenericModel::CompressedTrack& track, float time, uint32_t& cursor);
+    // Samples every channel of the animation, compressed or not, into the pose of its bone. Keyless tracks get the bind pose.
+    // pCursors has one cursor per channel, pIsBoneAnimated is set for every sampled bone if it is not nullptr.
+    void SampleAnimation(const GenericModel::Animation& animation, const LocalPose& bindPose, float time, ChannelCursor* pCursors, const PoseView& pose, uint8_t* pIsBoneAnimated);
+
+    // Ticks per second of the animation, with a default for files that do not specify it
+    float GetTicksPerSecond(const GenericModel::Animation& animation);
+
+    // Animation resampled at a fixed rate, so the samples around a time are found with a direct index.
+    // The values are stored sample major: all channels of one sample are next to each other, so a pose is
+    // evaluated by blending two contiguous ranges. Channels without keys of a kind hold the bind pose.
+    struct BakedAnimation {
+        float duration = 0.0f;
+        // Resolved like GetTicksPerSecond, playback advances with the same rate the samples were taken at
+        float ticksPerSecond = 0.0f;
+        uint32_t sampleCount = 0;
+        // Bone of every channel
+        std::vector<uint32_t> channelBones;
+        std::vector<glm::vec3> translations;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+
+        inline bool IsBaked() const { return sampleCount != 0; }
+        inline uint32_t GetChannelCount() const { return (uint32_t)channelBones.size(); }
+        // First sample index and blend factor towards the next sample
+        inline void GetSamplePosition(float time, uint32_t& index, float& factor) const {
+            if (sampleCount < 2 || time <= 0.0f) {
+                index = 0;
+                factor = 0.0f;
+                return;
+            }
+            float position = std::min(time / duration, 1.0f) * (float)(sampleCount - 1);
+            index = std::min((uint32_t)position, sampleCount - 2);
+            factor = position - (float)index;
+        }
+        inline size_t GetMemorySize() const {
+            return translations.size() * sizeof(glm::vec3) + rotations.size() * sizeof(glm::quat) + scales.size() * sizeof(glm::vec3) + channelBones.size() * sizeof(uint32_t);
+        }
+    };
+    // samplesPerSecond is in real time, the animation time in ticks is converted with the ticks per second of the animation.
+    // Channels of bones outside the bind pose are dropped.
+    BakedAnimation BakeAnimation(const GenericModel::Animation& animation, const LocalPose& bindPose, float samplesPerSecond);
+}
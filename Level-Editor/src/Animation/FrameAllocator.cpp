@@ -0,0 +1,36 @@
+#include "FrameAllocator.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace SGF {
+    FrameAllocator::FrameAllocator(size_t initialSize) : block(new std::byte[initialSize]), capacity(initialSize), pCurrent(block.get()), currentCapacity(initialSize) {}
+
+    void* FrameAllocator::Allocate(size_t size, size_t alignment) {
+        assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= alignof(std::max_align_t));
+        size_t alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+        if (alignedOffset + size > currentCapacity) {
+            size_t blockSize = std::max(size, capacity);
+            overflowBlocks.emplace_back(new std::byte[blockSize]);
+            pCurrent = overflowBlocks.back().get();
+            currentCapacity = blockSize;
+            alignedOffset = 0;
+            offset = 0;
+        }
+        usedSize += alignedOffset - offset + size;
+        offset = alignedOffset + size;
+        return pCurrent + alignedOffset;
+    }
+
+    void FrameAllocator::Reset() {
+        peakSize = std::max(peakSize, usedSize);
+        if (!overflowBlocks.empty()) {
+            overflowBlocks.clear();
+            capacity = peakSize + peakSize / 2;
+            block.reset(new std::byte[capacity]);
+        }
+        pCurrent = block.get();
+        currentCapacity = capacity;
+        offset = 0;
+        usedSize = 0;
+    }
+}
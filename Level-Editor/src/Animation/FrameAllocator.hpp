@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace SGF {
+    // Linear allocator for data that only lives during one update, everything is released together by Reset.
+    // A frame that does not fit spills into extra blocks, the next Reset replaces them by one block large enough,
+    // so after the first frames no allocation touches the heap anymore.
+    class FrameAllocator {
+    public:
+        FrameAllocator(size_t initialSize = 16 * 1024);
+
+        // The alignment has to be a power of two of at most alignof(std::max_align_t)
+        void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+        template<typename T>
+        inline T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+        void Reset();
+
+        inline size_t GetCapacity() const { return capacity; }
+        // Largest amount of memory a frame used so far
+        inline size_t GetPeakSize() const { return peakSize; }
+    private:
+        std::unique_ptr<std::byte[]> block;
+        size_t capacity;
+        std::vector<std::unique_ptr<std::byte[]>> overflowBlocks;
+        std::byte* pCurrent;
+        size_t currentCapacity;
+        size_t offset = 0;
+        size_t usedSize = 0;
+        size_t peakSize = 0;
+    };
+}
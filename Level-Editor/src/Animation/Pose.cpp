@@ -0,0 +1,100 @@
+#include "Pose.hpp"
+#include "Geometry/Math.hpp"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POSE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace SGF {
+    void ComputeBindPose(const GenericModel& model, LocalPose& outPose) {
+        outPose.Resize(model.bones.size());
+        for (size_t i = 0; i < model.bones.size(); ++i) {
+            DecomposeTransformationMatrix(model.bones[i].nodeTransform, &outPose.translations[i], &outPose.rotations[i], &outPose.scales[i]);
+        }
+    }
+
+    void LerpVectors(const glm::vec3* pA, const glm::vec3* pB, float factor, glm::vec3* pOut, size_t count) {
+        // glm::vec3 is three tightly packed floats, so the arrays are lerped as flat float arrays the compiler can vectorize
+        const float* a = &pA[0].x;
+        const float* b = &pB[0].x;
+        float* out = &pOut[0].x;
+        for (size_t i = 0; i < count * 3; ++i) {
+            out[i] = a[i] + (b[i] - a[i]) * factor;
+        }
+    }
+
+    void NlerpRotations(const glm::quat* pA, const glm::quat* pB, float factor, glm::quat* pOut, size_t count) {
+        static_assert(sizeof(glm::quat) == 4 * sizeof(float));
+#ifdef POSE_SSE
+        const __m128 f = _mm_set1_ps(factor);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        for (size_t i = 0; i < count; ++i) {
+            __m128 a = _mm_loadu_ps(&pA[i][0]);
+            __m128 b = _mm_loadu_ps(&pB[i][0]);
+            // Horizontal dot product, broadcast to all lanes
+            __m128 d = _mm_mul_ps(a, b);
+            d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+            d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+            // Flip b onto the same hemisphere as a
+            b = _mm_xor_ps(b, _mm_and_ps(d, signMask));
+            __m128 q = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f));
+            __m128 lengthSquared = _mm_mul_ps(q, q);
+            lengthSquared = _mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(2, 3, 0, 1)));
+            lengthSquared = _mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_ps(&pOut[i][0], _mm_div_ps(q, _mm_sqrt_ps(lengthSquared)));
+        }
+#else
+        for (size_t i = 0; i < count; ++i) {
+            glm::quat b = glm::dot(pA[i], pB[i]) < 0.0f ? -pB[i] : pB[i];
+            pOut[i] = glm::normalize(pA[i] * (1.0f - factor) + b * factor);
+        }
+#endif
+    }
+
+    void CopyPose(const PoseView& source, const PoseView& destination) {
+        assert(source.boneCount == destination.boneCount);
+        std::copy(source.translations, source.translations + source.boneCount, destination.translations);
+        std::copy(source.rotations, source.rotations + source.boneCount, destination.rotations);
+        std::copy(source.scales, source.scales + source.boneCount, destination.scales);
+    }
+
+    void BlendPoses(const PoseView& a, const PoseView& b, float weight, const float* pBoneWeights, const PoseView& out) {
+        assert(a.boneCount == b.boneCount && a.boneCount == out.boneCount);
+        if (pBoneWeights == nullptr) {
+            LerpVectors(a.translations, b.translations, weight, out.translations, a.boneCount);
+            NlerpRotations(a.rotations, b.rotations, weight, out.rotations, a.boneCount);
+            LerpVectors(a.scales, b.scales, weight, out.scales, a.boneCount);
+            return;
+        }
+        for (size_t i = 0; i < a.boneCount; ++i) {
+            const float w = weight * pBoneWeights[i];
+            if (w <= 0.0f) {
+                out.translations[i] = a.translations[i];
+                out.rotations[i] = a.rotations[i];
+                out.scales[i] = a.scales[i];
+                continue;
+            }
+            out.translations[i] = glm::mix(a.translations[i], b.translations[i], w);
+            NlerpRotations(&a.rotations[i], &b.rotations[i], w, &out.rotations[i], 1);
+            out.scales[i] = glm::mix(a.scales[i], b.scales[i], w);
+        }
+    }
+
+    void AddPose(const PoseView& pose, const PoseView& additive, const PoseView& reference, const float* pBoneWeights) {
+        assert(pose.boneCount == additive.boneCount && pose.boneCount == reference.boneCount);
+        const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < pose.boneCount; ++i) {
+            const float w = pBoneWeights[i];
+            if (w <= 0.0f) continue;
+            pose.translations[i] += (additive.translations[i] - reference.translations[i]) * w;
+            // The difference is applied in the local space of the bone
+            glm::quat delta = glm::conjugate(reference.rotations[i]) * additive.rotations[i];
+            NlerpRotations(&identity, &delta, w, &delta, 1);
+            pose.rotations[i] = glm::normalize(pose.rotations[i] * delta);
+            glm::vec3 scaleDelta = additive.scales[i] / glm::max(reference.scales[i], glm::vec3(1e-6f));
+            pose.scales[i] *= glm::mix(glm::vec3(1.0f), scaleDelta, w);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Model/Model.hpp"
+
+namespace SGF {
+    // Pose in memory owned by someone else, like the frame allocator of a controller
+    struct PoseView {
+        glm::vec3* translations = nullptr;
+        glm::quat* rotations = nullptr;
+        glm::vec3* scales = nullptr;
+        size_t boneCount = 0;
+    };
+
+    // Local bone transforms as separate translation, rotation and scale arrays, so whole poses can be
+    // blended with tight loops instead of composing a matrix per bone.
+    struct LocalPose {
+        std::vector<glm::vec3> translations;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+
+        inline size_t GetSize() const { return translations.size(); }
+        inline void Resize(size_t boneCount) {
+            translations.resize(boneCount);
+            rotations.resize(boneCount);
+            scales.resize(boneCount);
+        }
+        inline PoseView GetView() { return { translations.data(), rotations.data(), scales.data(), translations.size() }; }
+        // The view does not write to the pose, it is only non const to share the type
+        inline PoseView GetView() const { return const_cast<LocalPose*>(this)->GetView(); }
+    };
+
+    // Decomposes the node transforms of all bones, done once and not every frame
+    void ComputeBindPose(const GenericModel& model, LocalPose& outPose);
+
+    // Element wise out = a + (b - a) * factor over count values
+    void LerpVectors(const glm::vec3* pA, const glm::vec3* pB, float factor, glm::vec3* pOut, size_t count);
+    // Normalized lerp along the shortest path, close to a slerp for the small angles between neighbouring samples
+    void NlerpRotations(const glm::quat* pA, const glm::quat* pB, float factor, glm::quat* pOut, size_t count);
+
+    void CopyPose(const PoseView& source, const PoseView& destination);
+    // out = a blended towards b by weight, or by weight * pBoneWeights[i] per bone if pBoneWeights is not nullptr.
+    // out may be a or b.
+    void BlendPoses(const PoseView& a, const PoseView& b, float weight, const float* pBoneWeights, const PoseView& out);
+    // Applies the difference of additive to reference on top of pose, scaled by pBoneWeights[i] per bone
+    void AddPose(const PoseView& pose, const PoseView& additive, const PoseView& reference, const float* pBoneWeights);
+
+    // Translation * Rotation * Scale without building and multiplying three matrices
+    inline glm::mat4 ComposeTransform(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+        glm::mat3 r = glm::mat3_cast(rotation);
+        return glm::mat4(
+            glm::vec4(r[0] * scale.x, 0.0f),
+            glm::vec4(r[1] * scale.y, 0.0f),
+            glm::vec4(r[2] * scale.z, 0.0f),
+            glm::vec4(translation, 1.0f));
+    }
+}
@@ -13,8 +13,10 @@ namespace SGF {
 	const float MESH_TRANSPARENCY = .6f;
 	const float NO_TRANSPARENCY = 1.f;
 
-	ViewportLayer::ViewportLayer(VkFormat colorFormat) : Layer("Viewport"), editorRenderer(colorFormat), debugPanel("Debug Panel"),
-			debugRenderer(editorRenderer.GetRenderPass(), editorRenderer.GetSubpass()) {}
+	constexpr uint32_t MAX_QUEUED_IMPORTS = 256;
+
+	ViewportLayer::ViewportLayer(VkFormat colorFormat) : Layer("Viewport"), importQueue(ThreadPool::Get().GetThreadCount(), MAX_QUEUED_IMPORTS),
+			editorRenderer(colorFormat), debugPanel("Debug Panel"), debugRenderer(editorRenderer.GetRenderPass(), editorRenderer.GetSubpass()) {}
 	ViewportLayer::~ViewportLayer() {}
 	void ViewportLayer::OnAttach() {}
 	void ViewportLayer::OnDetach() {}
@@ -29,14 +31,37 @@ namespace SGF {
 		editorRenderer.BeginFrame(event, viewProj);
 
 		bool skeletalAnimationsPresent = false;
-		// Draw all static Models
-		editorRenderer.BindStaticRenderPipeline();
+		// Static models are drawn with one indirect call each, models that do not fit the indirect buffers anymore are drawn directly
+		staticDirectModels.clear();
+		if (editorRenderer.IsIndirectDrawSupported()) {
+			editorRenderer.BindIndirectRenderPipeline();
+		}
 		for (size_t i = 0; i < models.size(); ++i) {
 			auto& model = *models[i];
 			if (model.HasSkeletalAnimation()) {
 				skeletalAnimationsPresent = true;
 				continue;
 			}
+			if (!editorRenderer.IsIndirectDrawSupported()) {
+				staticDirectModels.push_back((uint32_t)i);
+				continue;
+			}
+			bool isHovered = !ImGuizmo::IsUsing() && (editorRenderer.IsCursorHoveringItem() && editorRenderer.GetHoveredModelIndex() == i && selectionMode != SelectionMode::NO_SELECTION);
+			bool isDrawn;
+			if (isHovered && selectionMode == SelectionMode::NODE) {
+				isDrawn = editorRenderer.DrawModelIndirect(model, i, NO_COLOR_MODIFIER, 1.f, &model.GetNode(editorRenderer.GetHoveredNodeIndex()), HOVER_COLOR);
+			} else {
+				isDrawn = editorRenderer.DrawModelIndirect(model, i, isHovered ? HOVER_COLOR : NO_COLOR_MODIFIER, 1.f);
+			}
+			if (!isDrawn) {
+				staticDirectModels.push_back((uint32_t)i);
+			}
+		}
+		if (!staticDirectModels.empty()) {
+			editorRenderer.BindStaticRenderPipeline();
+		}
+		for (uint32_t i : staticDirectModels) {
+			auto& model = *models[i];
 			if (!ImGuizmo::IsUsing() && (editorRenderer.IsCursorHoveringItem() && editorRenderer.GetHoveredModelIndex() == i && selectionMode != SelectionMode::NO_SELECTION)) {
 				if (selectionMode == SelectionMode::NODE) {
 					editorRenderer.SetModifiers(NO_COLOR_MODIFIER, 1.f);
@@ -55,13 +80,12 @@ namespace SGF {
 			}
 		}
 		if (skeletalAnimationsPresent) {
-			std::vector<glm::mat4> boneTransforms;
-			boneTransforms.reserve(128);
+			// Palettes go straight into the mapped bone buffer of this frame
+			bonePalettePointers.resize(animationControllers.size());
 			for (size_t i = 0; i < animationControllers.size(); ++i) {
-				animationControllers[i].GetBonePalette(boneTransforms);
-				auto& model = *animationControllers[i].GetModel();
-				editorRenderer.UpdateBoneTransforms(model, boneTransforms);
+				bonePalettePointers[i] = editorRenderer.GetBoneTransformsPointer(*animationControllers[i].GetModel());
 			}
+			WriteBonePalettes(animationControllers, bonePalettePointers.data());
 			editorRenderer.BindSkeletalRenderPipeline();
 			for (size_t i = 0; i < models.size(); ++i) {
 				auto& model = *models[i];
@@ -217,9 +241,17 @@ namespace SGF {
 
 
 	void ViewportLayer::UpdateAnimations(const UpdateEvent& event) {
-		for (size_t i = 0; i < animationControllers.size(); ++i) {
-			auto& controller = animationControllers[i];
-			controller.Update(event.GetDeltaTime()/1000.f);
+		auto s = profiler.ProfileScope("Update Animations");
+		UpdateAnimationControllers(animationControllers, event.GetDeltaTime()/1000.f);
+	}
+
+	void ViewportLayer::RefitSkinnedModelBVH(const GenericModel& model, ModelBVH& bvh) {
+		for (const auto& controller : animationControllers) {
+			if (controller.GetModel() != &model) continue;
+			controller.GetBonePalette(pickingBonePalette);
+			SkinVertexPositions(model, pickingBonePalette, skinnedPositions);
+			bvh.Refit(model, skinnedPositions);
+			return;
 		}
 	}
 
@@ -262,7 +294,18 @@ namespace SGF {
 					Ray ray = SGF::CreateRayFromPixel(relativeCursor.x, relativeCursor.y, editorRenderer.GetWidth(), editorRenderer.GetHeight(), cameraController.GetViewMatrix(), cameraController.GetProjMatrix(editorRenderer.GetAspectRatio()));
 					for (size_t i = 0; i < models.size(); ++i) {
 						auto& model = *models[i];
-						SGF::GetModelIntersection(ray, model, hitInfo);
+						// Built on the first query, the mesh BVHs only depend on the geometry.
+						// UpdateInstances returns right away unless a node was transformed since the last query.
+						auto& bvh = modelBVHs[i];
+						if (!bvh.IsBuilt()) {
+							bvh.Build(model);
+						} else {
+							bvh.UpdateInstances(model);
+						}
+						if (!model.vertexWeights.empty()) {
+							RefitSkinnedModelBVH(model, bvh);
+						}
+						bvh.Intersect(ray, hitInfo);
 					}
 					if (editorRenderer.IsCursorHoveringItem()) {
 						if (hitInfo.nodeIndex == nodeHover) {
@@ -368,31 +411,79 @@ namespace SGF {
 	}
 
 	void ViewportLayer::ImportModel(const char* filename) {
-		if (loadingModel.valid()) {
-			// still loading a model - waiting for finished loading
-			auto loadedModel = loadingModel.get();
+		uint32_t importFlags = 0;
+		if (optimizeImportedMeshes) importFlags |= MODEL_IMPORT_OPTIMIZE_MESHES;
+		if (generateMeshLods) importFlags |= MODEL_IMPORT_GENERATE_LODS;
+		if (buildMeshlets) importFlags |= MODEL_IMPORT_BUILD_MESHLETS;
+		if (compressAnimations) importFlags |= MODEL_IMPORT_COMPRESS_ANIMATIONS;
+		importQueue.Enqueue(filename, 0, useProgressiveImport, importFlags);
+	}
+	void ViewportLayer::CheckModelImportStatus() {
+		std::vector<std::unique_ptr<GenericModel>> loadedModels;
+		std::vector<GenericModel*> streamedModels;
+		importQueue.Update(loadedModels, streamedModels);
+		for (auto& loadedModel : loadedModels) {
 			models.push_back(std::move(loadedModel));
-			editorRenderer.AddModel(*models.back());
-			if (models.back()->HasAnimations()) {
-				animationControllers.emplace_back(models.back().get());
+			modelBVHs.emplace_back();
+			GenericModel* pModel = models.back().get();
+			editorRenderer.AddModel(*pModel);
+			if (pModel->HasAnimations()) {
+				animationControllers.emplace_back(pModel);
 			}
+			SGF::Log::Debug("Finished loading model: {}", pModel->name);
+		}
+		for (GenericModel* pModel : streamedModels) {
+			editorRenderer.UpdateModelTextures(*pModel);
+			// Controllers are updated in parallel, a model must not get a second one
+			bool hasController = std::any_of(animationControllers.begin(), animationControllers.end(), [&](const AnimationController& controller) { return controller.GetModel() == pModel; });
+			if (pModel->HasAnimations() && !hasController) {
+				animationControllers.emplace_back(pModel);
+			}
+			SGF::Log::Debug("Finished streaming textures and animations of model: {}", pModel->name);
 		}
-		// Async import:
-		std::string file(filename);
-		loadingModel = std::async(std::launch::async, [f = std::move(file)]() {
-			auto ptr = std::make_unique<GenericModel>(f.c_str());
-			return std::move(ptr);
-			});
 	}
-	void ViewportLayer::CheckModelImportStatus() {
-		if (loadingModel.valid() && loadingModel.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-			// still loading a model - waiting for finished loading
-			models.push_back(std::move(loadingModel.get()));
-			editorRenderer.AddModel(*models.back().get());
-			if (models.back()->HasAnimations()) {
-				animationControllers.emplace_back(models.back().get());
+	void ViewportLayer::RemoveModel(uint32_t modelIndex) {
+		assert(modelIndex < models.size());
+		GenericModel* pModel = models[modelIndex].get();
+		SGF::Log::Debug("Removing model: {}", pModel->name);
+		ClearSelection();
+		editorRenderer.RemoveModel(*pModel);
+		animationControllers.erase(std::remove_if(animationControllers.begin(), animationControllers.end(),
+			[&](const AnimationController& controller) { return controller.GetModel() == pModel; }), animationControllers.end());
+		models.erase(models.begin() + modelIndex);
+		modelBVHs.erase(modelBVHs.begin() + modelIndex);
+	}
+	void ViewportLayer::ShowImportQueue() {
+		importQueue.GetJobInfos(importJobInfos);
+		if (importJobInfos.empty()) return;
+		ImGui::Separator();
+		ImGui::Text("Import Queue - Running: %u/%u, Jobs: %zu", importQueue.GetRunningJobCount(), importQueue.GetMaxRunningJobs(), importJobInfos.size());
+		ImGui::SameLine();
+		if (ImGui::SmallButton("Cancel All")) {
+			importQueue.CancelAll();
+		}
+		for (const auto& info : importJobInfos) {
+			ImGui::PushID((int)info.id);
+			const char* stateName = info.state == ModelImportQueue::JobState::QUEUED ? "Queued" : 
+				(info.state == ModelImportQueue::JobState::LOADING ? "Loading" : "Streaming");
+			ImGui::ProgressBar(info.progress, ImVec2(100.f, 0.f), stateName);
+			ImGui::SameLine();
+			if (info.state == ModelImportQueue::JobState::QUEUED) {
+				int priority = info.priority;
+				ImGui::SetNextItemWidth(80.f);
+				if (ImGui::InputInt("##Priority", &priority)) {
+					importQueue.SetPriority(info.id, priority);
+				}
+				ImGui::SameLine();
 			}
-			SGF::Log::Debug("Finished loading model: {}", models.back().get()->name);
+			ImGui::BeginDisabled(info.state == ModelImportQueue::JobState::STREAMING);
+			if (ImGui::SmallButton("Cancel")) {
+				importQueue.Cancel(info.id);
+			}
+			ImGui::EndDisabled();
+			ImGui::SameLine();
+			ImGui::TextUnformatted(info.pFilename->c_str());
+			ImGui::PopID();
 		}
 	}
 
@@ -401,12 +492,23 @@ namespace SGF {
 		if (ImGui::Button("Import Model")) {
 			Log::Debug("Import Model Button Clicked");
 			WindowHandle handle(ImGui::GetWindowViewport());
-			auto filename = handle.OpenFileDialog("Model files", "gltf,glb,fbx,obj,usdz");
-			if (!filename.empty()) {
+			auto filenames = handle.OpenMultipleFilesDialog("Model files", "gltf,glb,fbx,obj,usdz");
+			for (const auto& filename : filenames) {
 				ImportModel(filename.c_str());
 			}
 			ClearSelection();
 		}
+		ImGui::SameLine();
+		ImGui::Checkbox("Progressive Import", &useProgressiveImport);
+		ImGui::SameLine();
+		ImGui::Checkbox("Optimize Meshes", &optimizeImportedMeshes);
+		ImGui::SameLine();
+		ImGui::Checkbox("Generate LODs", &generateMeshLods);
+		ImGui::SameLine();
+		ImGui::Checkbox("Build Meshlets", &buildMeshlets);
+		ImGui::SameLine();
+		ImGui::Checkbox("Compress Animations", &compressAnimations);
+		ShowImportQueue();
 		if (selectionMode == SelectionMode::MODEL) {
 			if (ImGui::Button("Selection Mode: Model")) {
 				selectionMode = SelectionMode::NODE; 
@@ -424,6 +526,12 @@ namespace SGF {
 			if (ImGui::Button("Clear Selection")) {
 				ClearSelection();
 			}
+			ImGui::SameLine();
+			ImGui::BeginDisabled(!importJobInfos.empty());
+			if (ImGui::Button("Remove Model")) {
+				RemoveModel(selectedModelIndex);
+			}
+			ImGui::EndDisabled();
 		}
 		ImGui::Separator();
 		ShowModelHierarchy();
@@ -515,6 +623,13 @@ namespace SGF {
 				if (ImGui::Button("Stop##AnimationStop", ImVec2(50, 0))) {
 					pController->Pause();
 				}
+				// Previews the transition from the playing animation to the selected one
+				ImGui::SameLine();
+				ImGui::BeginDisabled(selectedAnimationIndex < 0);
+				if (ImGui::Button("Blend To##AnimationCrossFade") && selectedAnimationIndex < (int)selectedModel.animations.size()) {
+					pController->CrossFade(selectedModel.animations[selectedAnimationIndex].name, animationCrossFadeDuration);
+				}
+				ImGui::EndDisabled();
 			}
 			else {
 				ImGui::BeginDisabled(selectedAnimationIndex < 0);
@@ -537,7 +652,19 @@ namespace SGF {
 				ImGui::Text("Animation: %s", selectedAnimation.name.c_str());
 				ImGui::Text("Duration: %.2f seconds", selectedAnimation.duration);
 				ImGui::Text("Ticks Per Second: %.2f", selectedAnimation.ticksPerSecond);
-				ImGui::Text("Channels: %ld", selectedAnimation.channels.size());
+				ImGui::Text("Channels: %ld", selectedAnimation.GetChannelCount());
+				ImGui::Text("Key Memory: %ld bytes%s", GetAnimationMemorySize(selectedAnimation), selectedAnimation.IsCompressed() ? " (compressed)" : "");
+				if (pController != nullptr) {
+					float bakeSampleRate = pController->GetBakeSampleRate();
+					if (ImGui::DragFloat("Bake Sample Rate (0 = off)", &bakeSampleRate, 1.0f, 0.0f, 240.0f, "%.0f /s")) {
+						pController->SetBakeSampleRate(bakeSampleRate);
+					}
+					if (const BakedAnimation* pBaked = pController->GetBakedAnimation()) {
+						ImGui::Text("Baked: %u samples, %ld bytes", pBaked->sampleCount, pBaked->GetMemorySize());
+					}
+					ImGui::DragFloat("Crossfade Duration", &animationCrossFadeDuration, 0.01f, 0.0f, 5.0f, "%.2f s");
+					ImGui::Text("Frame Allocator: %ld / %ld bytes", pController->GetFrameAllocator().GetPeakSize(), pController->GetFrameAllocator().GetCapacity());
+				}
 
 				// Timeline slider
 				float currentTime = (pController != nullptr) ? pController->GetCurrentTime() : 0.0f;
@@ -547,6 +674,40 @@ namespace SGF {
 					pController->SetCurrentTime(currentTime);
 				}
 
+				// Layers blended on top of the playing animation
+				if (pController != nullptr && ImGui::TreeNode("Layers")) {
+					if (ImGui::Button("Add Override Layer")) {
+						uint32_t layer = pController->AddLayer(AnimationBlendMode::OVERRIDE);
+						pController->PlayLayerAnimation(layer, selectedAnimation.name);
+					}
+					ImGui::SameLine();
+					if (ImGui::Button("Add Additive Layer")) {
+						uint32_t layer = pController->AddLayer(AnimationBlendMode::ADDITIVE);
+						pController->PlayLayerAnimation(layer, selectedAnimation.name);
+					}
+					for (uint32_t layer = 0; layer < pController->GetLayerCount(); ++layer) {
+						ImGui::PushID((int)layer);
+						uint32_t animationIndex = pController->GetLayerAnimationIndex(layer);
+						ImGui::Text("Layer %u: %s (%s)", layer, animationIndex < selectedModel.animations.size() ? selectedModel.animations[animationIndex].name.c_str() : "stopped",
+							pController->GetLayerMode(layer) == AnimationBlendMode::ADDITIVE ? "additive" : "override");
+						float weight = pController->GetLayerWeight(layer);
+						if (ImGui::SliderFloat("Weight", &weight, 0.0f, 1.0f)) {
+							pController->SetLayerWeight(layer, weight);
+						}
+						int maskRoot = pController->GetLayerMaskRoot(layer) == UINT32_MAX ? -1 : (int)pController->GetLayerMaskRoot(layer);
+						if (ImGui::InputInt("Mask Root Bone (-1 = all)", &maskRoot)) {
+							pController->SetLayerBoneMask(layer, maskRoot < 0 ? UINT32_MAX : (uint32_t)maskRoot);
+						}
+						bool isRemoved = ImGui::Button("Remove");
+						ImGui::PopID();
+						if (isRemoved) {
+							pController->RemoveLayer(layer);
+							break;
+						}
+					}
+					ImGui::TreePop();
+				}
+
 				// Display channel information
 				if (ImGui::TreeNode("Channels")) {
 					for (size_t i = 0; i < selectedAnimation.channels.size(); ++i) {
@@ -558,6 +719,15 @@ namespace SGF {
 						ImGui::Text("Scale Keys: %ld", channel.scaleKeys.size());
 						ImGui::Unindent();
 					}
+					for (size_t i = 0; i < selectedAnimation.compressed.channels.size(); ++i) {
+						const auto& channel = selectedAnimation.compressed.channels[i];
+						ImGui::Text("Channel %ld - Bone Index: %u", i, channel.boneIndex);
+						ImGui::Indent();
+						ImGui::Text("Position Keys: %u", channel.positions.keyCount);
+						ImGui::Text("Rotation Keys: %u", channel.rotations.keyCount);
+						ImGui::Text("Scale Keys: %u", channel.scales.keyCount);
+						ImGui::Unindent();
+					}
 					ImGui::TreePop();
 				}
 			}
@@ -569,7 +739,7 @@ namespace SGF {
 					ImGui::Text("Animation %ld: %s", i, anim.name.c_str());
 					ImGui::Indent();
 					ImGui::Text("Duration: %.2f s | Ticks/Sec: %.2f | Channels: %ld",
-						anim.duration, anim.ticksPerSecond, anim.channels.size());
+						anim.duration, anim.ticksPerSecond, anim.GetChannelCount());
 					ImGui::Unindent();
 				}
 				ImGui::TreePop();
@@ -609,12 +779,54 @@ namespace SGF {
 			editorRenderer.GetTextureCount(), editorRenderer.GetTotalDeviceMemoryUsed(), editorRenderer.GetTotalDeviceMemoryAllocated());
 
 		ImGui::Text("Selected ModelIndex: %d", selectedModelIndex);
+		const auto& geometryArena = editorRenderer.GetGeometryArena();
+		for (uint32_t i = 0; i < geometryArena.GetBlockCount(); ++i) {
+			auto stats = geometryArena.GetBlockStats(i);
+			if (stats.size == 0) continue;
+			ImGui::Text("Geometry Block %u: %llu/%llu bytes, %u ranges, %zu free ranges, largest free: %llu", i, (unsigned long long)stats.usedSize,
+				(unsigned long long)stats.size, stats.allocationCount, stats.freeRangeCount, (unsigned long long)stats.largestFreeRange);
+		}
+		if (ImGui::Button("Compact Geometry")) {
+			editorRenderer.CompactGeometry();
+		}
 		ImGui::Separator();
 		if (doCPUModelIntersection) {
 			doCPUModelIntersection = !ImGui::Button("Disable CPU Model intersection");
 		} else {
 			doCPUModelIntersection = ImGui::Button("Enable CPU Model intersection");
 		}
+		ImGui::Text("Triangle Kernel: %s", GetTriangleKernelName(GetTriangleKernel()));
+		float lodPixelError = editorRenderer.GetLodPixelError();
+		if (ImGui::DragFloat("LOD Pixel Error (0 = off): ", &lodPixelError, 0.1f, 0.f, 32.f, "%.1f")) {
+			editorRenderer.SetLodPixelError(lodPixelError);
+		}
+		bool cullMeshlets = editorRenderer.IsMeshletCullingEnabled();
+		if (ImGui::Checkbox("Meshlet Culling", &cullMeshlets)) {
+			editorRenderer.SetMeshletCulling(cullMeshlets);
+		}
+		bool cullOnGpu = editorRenderer.IsGpuCullingEnabled();
+		if (ImGui::Checkbox("GPU Frustum Culling", &cullOnGpu)) {
+			editorRenderer.SetGpuCulling(cullOnGpu);
+		}
+		if (cullOnGpu) {
+			bool validateCulling = editorRenderer.IsCullValidationEnabled();
+			if (ImGui::Checkbox("Validate Culling", &validateCulling)) {
+				editorRenderer.SetCullValidation(validateCulling);
+			}
+			const auto& cullStats = editorRenderer.GetCullStats();
+			if (cullStats.cpuVisibleCount != UINT32_MAX) {
+				ImGui::Text("Culled Draws: %u/%u visible, CPU reference: %u", cullStats.gpuVisibleCount, cullStats.candidateCount, cullStats.cpuVisibleCount);
+			} else {
+				ImGui::Text("Culled Draws: %u/%u visible", cullStats.gpuVisibleCount, cullStats.candidateCount);
+			}
+		}
+		if (ImGui::Button("Run Culling Self-Test")) {
+			cullSelfTestResult = editorRenderer.RunCullSelfTest() ? "Passed" : "Failed, see the log";
+		}
+		if (cullSelfTestResult != nullptr) {
+			ImGui::SameLine();
+			ImGui::Text("%s", cullSelfTestResult);
+		}
 		ImGui::Separator();
 		cursorMove.x = 0; cursorMove.y = 0;
 		if (isOrthographic) {
@@ -2,6 +2,7 @@
 
 #include <SGF.hpp>
 #include "Model/Model.hpp"
+#include "Model/ModelImportQueue.hpp"
 #include "Renderer/GridRenderer.hpp"
 #include "Renderer/ModelRenderer.hpp"
 #include "Renderer/EditorRenderer.hpp"
@@ -10,6 +11,8 @@
 #include "Renderer/DebugRenderer.hpp"
 #include "UI/DebugWindow.hpp"
 #include "Model/ModelSelectionCPU.hpp"
+#include "Model/ModelBVH.hpp"
+#include "Model/CPUSkinning.hpp"
 #include "Animation/AnimationController.hpp"
 #include <future>
 
@@ -51,7 +54,16 @@ namespace SGF {
             NO_SELECTION
         };
         std::vector<AnimationController> animationControllers;
+        // Destination of the palette of every controller in the bone buffer of the current frame
+        std::vector<glm::mat4*> bonePalettePointers;
         std::vector<std::unique_ptr<GenericModel>> models;
+        // CPU picking structure of every model, same order as models
+        std::vector<ModelBVH> modelBVHs;
+        // Static models of the frame that are not drawn indirectly
+        std::vector<uint32_t> staticDirectModels;
+        // Scratch buffers for picking skinned models in their current pose
+        std::vector<glm::mat4> pickingBonePalette;
+        std::vector<glm::vec3> skinnedPositions;
         //std::set<uint32_t> selectionIndices;
         uint32_t selectedModelIndex = UINT32_MAX; 
         uint32_t selectedNodeIndex = UINT32_MAX;
@@ -59,12 +71,21 @@ namespace SGF {
         glm::dvec2 cursorMove;
         ImVec2 relativeCursor;
         CameraController cameraController;
-        std::future<std::unique_ptr<GenericModel>> loadingModel;
+        ModelImportQueue importQueue;
+        std::vector<ModelImportQueue::JobInfo> importJobInfos;
         
         float viewSize = 0.0f;
         float cameraZoom = 0.0f;
         bool isOrthographic = false;
         bool doCPUModelIntersection = false;
+        bool useProgressiveImport = true;
+        bool optimizeImportedMeshes = true;
+        bool generateMeshLods = true;
+        bool buildMeshlets = true;
+        bool compressAnimations = true;
+        // nullptr until the culling self test ran
+        const char* cullSelfTestResult = nullptr;
+        float animationCrossFadeDuration = 0.3f;
         uint32_t inputMode = 0;
         SelectionMode selectionMode = SelectionMode::MODEL;
 		Profiler profiler;
@@ -76,12 +97,17 @@ namespace SGF {
     private:
 		void ImportModel(const char* filename);
         void CheckModelImportStatus();
+        // Only while no import is running, streaming jobs keep pointers to their models
+        void RemoveModel(uint32_t modelIndex);
+        void ShowImportQueue();
 	    void DrawTreeNode(uint32_t model, const GenericModel::Node& node);
 	    void DrawModelNodeExcludeSelectedHierarchy(const GenericModel& model, const GenericModel::Node& node) const;
 	    void DrawModelNodeRecursive(const GenericModel& model, const GenericModel::Node& node) const;
         void ShowSelectionInformation();
         void ShowModelHierarchy();
         void UpdateAnimations(const UpdateEvent& event);
+        // Moves the picking BVH of a skinned model to the pose of its animation controller
+        void RefitSkinnedModelBVH(const GenericModel& model, ModelBVH& bvh);
         void BindPipeline(VkPipeline pipeline, VkPipelineLayout layout);
         void ClearSelection();
         void UseGuizmo();
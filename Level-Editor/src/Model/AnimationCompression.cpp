@@ -0,0 +1,181 @@
+#include "AnimationCompression.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace SGF {
+	namespace {
+		// Tracks with the same key times get the same range of the time array
+		using TimeTable = std::map<std::vector<float>, uint32_t>;
+
+		template<typename KEY, typename INTERPOLATE, typename DISTANCE>
+		void ReduceTrack(std::vector<KEY>& keys, float tolerance, INTERPOLATE interpolate, DISTANCE distance) {
+			if (keys.size() < 2) return;
+			if (std::all_of(keys.begin() + 1, keys.end(), [&](const KEY& key) { return distance(key.value, keys[0].value) <= tolerance; })) {
+				keys.resize(1);
+				return;
+			}
+			std::vector<KEY> keptKeys;
+			keptKeys.push_back(keys[0]);
+			// Key i is dropped if the segment from the last kept key to key i + 1 reproduces every key in between
+			size_t anchor = 0;
+			for (size_t i = 1; i + 1 < keys.size(); ++i) {
+				const KEY& first = keys[anchor];
+				const KEY& last = keys[i + 1];
+				float span = last.time - first.time;
+				bool canDrop = span > 0.0f;
+				for (size_t j = anchor + 1; j <= i && canDrop; ++j) {
+					float t = (keys[j].time - first.time) / span;
+					canDrop = distance(interpolate(first.value, last.value, t), keys[j].value) <= tolerance;
+				}
+				if (!canDrop) {
+					keptKeys.push_back(keys[i]);
+					anchor = i;
+				}
+			}
+			keptKeys.push_back(keys.back());
+			keys = std::move(keptKeys);
+		}
+
+		template<typename KEY>
+		GenericModel::CompressedTrack AddTrack(GenericModel::CompressedAnimation& compressed, TimeTable& timeTable, const std::vector<KEY>& keys) {
+			GenericModel::CompressedTrack track;
+			track.keyCount = (uint32_t)keys.size();
+			track.valueOffset = (uint32_t)(compressed.values.size() / 3);
+			compressed.values.resize(compressed.values.size() + keys.size() * 3);
+			std::vector<float> times(keys.size());
+			for (size_t i = 0; i < keys.size(); ++i) {
+				times[i] = keys[i].time;
+			}
+			auto [it, isNew] = timeTable.try_emplace(std::move(times), (uint32_t)compressed.times.size());
+			if (isNew) {
+				compressed.times.insert(compressed.times.end(), it->first.begin(), it->first.end());
+			}
+			track.timeOffset = it->second;
+			return track;
+		}
+
+		void CompressVectorTrack(GenericModel::CompressedAnimation& compressed, TimeTable& timeTable, const std::vector<GenericModel::KeyFrame>& keys,
+			GenericModel::CompressedTrack& track, glm::vec3& min, glm::vec3& extent) {
+			min = keys.empty() ? glm::vec3(0.0f) : keys[0].value;
+			glm::vec3 max = min;
+			for (const auto& key : keys) {
+				min = glm::min(min, key.value);
+				max = glm::max(max, key.value);
+			}
+			extent = max - min;
+			track = AddTrack(compressed, timeTable, keys);
+			for (size_t i = 0; i < keys.size(); ++i) {
+				EncodeCompressedVector(keys[i].value, min, extent, &compressed.values[(track.valueOffset + i) * 3]);
+			}
+		}
+
+		std::vector<GenericModel::KeyFrame> DecompressVectorTrack(const GenericModel::CompressedAnimation& compressed, const GenericModel::CompressedTrack& track,
+			const glm::vec3& min, const glm::vec3& extent) {
+			std::vector<GenericModel::KeyFrame> keys(track.keyCount);
+			for (uint32_t i = 0; i < track.keyCount; ++i) {
+				keys[i].time = compressed.times[track.timeOffset + i];
+				keys[i].value = DecodeCompressedVector(&compressed.values[(track.valueOffset + i) * 3], min, extent);
+			}
+			return keys;
+		}
+	}
+
+	void EncodeCompressedVector(const glm::vec3& value, const glm::vec3& min, const glm::vec3& extent, uint16_t* pValue) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			float normalized = extent[i] > 0.0f ? (value[i] - min[i]) / extent[i] : 0.0f;
+			pValue[i] = (uint16_t)std::lround(std::clamp(normalized, 0.0f, 1.0f) * (float)COMPRESSED_VECTOR_MAX);
+		}
+	}
+
+	void EncodeSmallestThree(const glm::quat& rotation, uint16_t* pValue) {
+		glm::quat q = glm::normalize(rotation);
+		uint32_t largest = 0;
+		for (uint32_t i = 1; i < 4; ++i) {
+			if (std::abs(q[i]) > std::abs(q[largest])) largest = i;
+		}
+		// q and -q are the same rotation, the dropped component is always positive
+		const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+		for (uint32_t i = 0, k = 0; i < 4; ++i) {
+			if (i == largest) continue;
+			float normalized = std::clamp(q[i] * sign / COMPRESSED_QUAT_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+			pValue[k++] = (uint16_t)std::lround(normalized * (float)COMPRESSED_QUAT_MAX);
+		}
+		pValue[0] |= (uint16_t)((largest & 1) << 15);
+		pValue[1] |= (uint16_t)((largest >> 1) << 15);
+	}
+
+	size_t GetAnimationMemorySize(const GenericModel::Animation& animation) {
+		size_t size = animation.compressed.GetMemorySize() + animation.channels.size() * sizeof(GenericModel::AnimationChannel);
+		for (const auto& channel : animation.channels) {
+			size += (channel.positionKeys.size() + channel.scaleKeys.size()) * sizeof(GenericModel::KeyFrame) + channel.rotationKeys.size() * sizeof(GenericModel::RotationKeyFrame);
+		}
+		return size;
+	}
+
+	void ReduceKeys(std::vector<GenericModel::KeyFrame>& keys, float tolerance) {
+		ReduceTrack(keys, tolerance,
+			[](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); },
+			[](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); });
+	}
+
+	void ReduceKeys(std::vector<GenericModel::RotationKeyFrame>& keys, float tolerance) {
+		// Same interpolation as the sampling of the animation
+		ReduceTrack(keys, tolerance,
+			[](const glm::quat& a, const glm::quat& b, float t) { return glm::normalize(glm::slerp(a, glm::dot(a, b) < 0.0f ? -b : b, t)); },
+			// Twice the chord length is the rotation angle for small angles, acos loses too much precision near 1
+			[](const glm::quat& a, const glm::quat& b) { glm::quat d = glm::dot(a, b) < 0.0f ? a + b : a - b; return 2.0f * std::sqrt(glm::dot(d, d)); });
+	}
+
+	AnimationCompressionReport CompressAnimation(GenericModel::Animation& animation, const AnimationCompressionSettings& settings) {
+		if (animation.IsCompressed()) {
+			DecompressAnimation(animation);
+		}
+		AnimationCompressionReport report;
+		report.size = GetAnimationMemorySize(animation);
+		auto& compressed = animation.compressed;
+		compressed.channels.reserve(animation.channels.size());
+		TimeTable timeTable;
+		for (auto& channel : animation.channels) {
+			report.keyCount += (uint32_t)(channel.positionKeys.size() + channel.rotationKeys.size() + channel.scaleKeys.size());
+			ReduceKeys(channel.positionKeys, settings.positionTolerance);
+			ReduceKeys(channel.rotationKeys, settings.rotationTolerance);
+			ReduceKeys(channel.scaleKeys, settings.scaleTolerance);
+			report.compressedKeyCount += (uint32_t)(channel.positionKeys.size() + channel.rotationKeys.size() + channel.scaleKeys.size());
+
+			GenericModel::CompressedChannel compressedChannel;
+			compressedChannel.boneIndex = channel.boneIndex;
+			CompressVectorTrack(compressed, timeTable, channel.positionKeys, compressedChannel.positions, compressedChannel.positionMin, compressedChannel.positionExtent);
+			CompressVectorTrack(compressed, timeTable, channel.scaleKeys, compressedChannel.scales, compressedChannel.scaleMin, compressedChannel.scaleExtent);
+			compressedChannel.rotations = AddTrack(compressed, timeTable, channel.rotationKeys);
+			for (size_t i = 0; i < channel.rotationKeys.size(); ++i) {
+				EncodeSmallestThree(channel.rotationKeys[i].value, &compressed.values[(compressedChannel.rotations.valueOffset + i) * 3]);
+			}
+			compressed.channels.push_back(compressedChannel);
+		}
+		animation.channels.clear();
+		animation.channels.shrink_to_fit();
+		compressed.times.shrink_to_fit();
+		compressed.values.shrink_to_fit();
+		report.compressedSize = GetAnimationMemorySize(animation);
+		return report;
+	}
+
+	void DecompressAnimation(GenericModel::Animation& animation) {
+		const auto& compressed = animation.compressed;
+		animation.channels.resize(compressed.channels.size());
+		for (size_t c = 0; c < compressed.channels.size(); ++c) {
+			const auto& compressedChannel = compressed.channels[c];
+			auto& channel = animation.channels[c];
+			channel.boneIndex = compressedChannel.boneIndex;
+			channel.positionKeys = DecompressVectorTrack(compressed, compressedChannel.positions, compressedChannel.positionMin, compressedChannel.positionExtent);
+			channel.scaleKeys = DecompressVectorTrack(compressed, compressedChannel.scales, compressedChannel.scaleMin, compressedChannel.scaleExtent);
+			channel.rotationKeys.resize(compressedChannel.rotations.keyCount);
+			for (uint32_t i = 0; i < compressedChannel.rotations.keyCount; ++i) {
+				channel.rotationKeys[i].time = compressed.times[compressedChannel.rotations.timeOffset + i];
+				channel.rotationKeys[i].value = DecodeSmallestThree(&compressed.values[(compressedChannel.rotations.valueOffset + i) * 3]);
+			}
+		}
+		animation.compressed = GenericModel::CompressedAnimation();
+	}
+}
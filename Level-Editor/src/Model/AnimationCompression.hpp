@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	// Largest error a dropped key may introduce, in model units for positions and scales and in radians for rotations
+	struct AnimationCompressionSettings {
+		float positionTolerance = 0.0005f;
+		float rotationTolerance = 0.0005f;
+		float scaleTolerance = 0.0005f;
+	};
+
+	struct AnimationCompressionReport {
+		uint32_t keyCount = 0;
+		uint32_t compressedKeyCount = 0;
+		size_t size = 0;
+		size_t compressedSize = 0;
+		inline float GetRatio() const { return compressedSize == 0 ? 0.0f : (float)size / (float)compressedSize; }
+		inline void Add(const AnimationCompressionReport& other) { keyCount += other.keyCount; compressedKeyCount += other.compressedKeyCount; size += other.size; compressedSize += other.compressedSize; }
+	};
+
+	constexpr uint32_t COMPRESSED_VECTOR_MAX = 65535;
+	// The three smallest components of a unit quaternion are inside +-sqrt(0.5), they get 15 bits each
+	constexpr uint32_t COMPRESSED_QUAT_MAX = 32767;
+	constexpr float COMPRESSED_QUAT_RANGE = 0.70710678f;
+
+	inline glm::vec3 DecodeCompressedVector(const uint16_t* pValue, const glm::vec3& min, const glm::vec3& extent) {
+		return min + glm::vec3(pValue[0], pValue[1], pValue[2]) * (extent * (1.0f / (float)COMPRESSED_VECTOR_MAX));
+	}
+	void EncodeCompressedVector(const glm::vec3& value, const glm::vec3& min, const glm::vec3& extent, uint16_t* pValue);
+	// The index of the dropped component is stored in the top bits of the first two values
+	inline glm::quat DecodeSmallestThree(const uint16_t* pValue) {
+		const uint32_t largest = (pValue[0] >> 15) | ((pValue[1] >> 15) << 1);
+		glm::quat rotation;
+		float lengthSq = 0.0f;
+		for (uint32_t i = 0, k = 0; i < 4; ++i) {
+			if (i == largest) continue;
+			float component = ((float)(pValue[k++] & 0x7FFF) * (2.0f / (float)COMPRESSED_QUAT_MAX) - 1.0f) * COMPRESSED_QUAT_RANGE;
+			rotation[i] = component;
+			lengthSq += component * component;
+		}
+		rotation[largest] = std::sqrt(std::max(1.0f - lengthSq, 0.0f));
+		return rotation;
+	}
+	void EncodeSmallestThree(const glm::quat& rotation, uint16_t* pValue);
+
+	// Memory used by the keys of the animation in its current form
+	size_t GetAnimationMemorySize(const GenericModel::Animation& animation);
+	// Removes the keys that interpolating their neighbours reproduces within the tolerance, the first and last key stay.
+	// A track whose keys all stay within the tolerance of the first key is reduced to that key.
+	void ReduceKeys(std::vector<GenericModel::KeyFrame>& keys, float tolerance);
+	void ReduceKeys(std::vector<GenericModel::RotationKeyFrame>& keys, float tolerance);
+	// Reduces the keys and replaces the channels with their compressed form
+	AnimationCompressionReport CompressAnimation(GenericModel::Animation& animation, const AnimationCompressionSettings& settings = {});
+	// Rebuilds full precision channels from the compressed form, the quantization error stays
+	void DecompressAnimation(GenericModel::Animation& animation);
+}
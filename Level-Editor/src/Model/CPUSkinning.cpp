@@ -0,0 +1,54 @@
+#include "CPUSkinning.hpp"
+#include "Threading/ThreadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SKINNING_SSE
+#include <emmintrin.h>
+#endif
+
+namespace SGF {
+	namespace {
+		// Sum of the weighted bone transforms applied to the position, the same as applying the blended matrix
+		inline glm::vec3 SkinPosition(const glm::vec3& position, const GenericModel::VertexWeight& weight, const glm::mat4* pPalette, size_t boneCount) {
+#ifdef CPU_SKINNING_SSE
+			const __m128 x = _mm_set1_ps(position.x), y = _mm_set1_ps(position.y), z = _mm_set1_ps(position.z);
+			__m128 result = _mm_setzero_ps();
+			for (uint32_t i = 0; i < 4; ++i) {
+				if (weight.boneWeights[i] == 0.f || weight.boneIndices[i] >= boneCount) continue;
+				const float* pBone = &pPalette[weight.boneIndices[i]][0][0];
+				__m128 transformed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pBone), x), _mm_mul_ps(_mm_loadu_ps(pBone + 4), y)),
+					_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pBone + 8), z), _mm_loadu_ps(pBone + 12)));
+				result = _mm_add_ps(result, _mm_mul_ps(transformed, _mm_set1_ps(weight.boneWeights[i])));
+			}
+			alignas(16) float values[4];
+			_mm_store_ps(values, result);
+			return glm::vec3(values[0], values[1], values[2]);
+#else
+			glm::vec3 result(0.f);
+			for (uint32_t i = 0; i < 4; ++i) {
+				if (weight.boneWeights[i] == 0.f || weight.boneIndices[i] >= boneCount) continue;
+				result += weight.boneWeights[i] * glm::vec3(pPalette[weight.boneIndices[i]] * glm::vec4(position, 1.f));
+			}
+			return result;
+#endif
+		}
+	}
+
+	void SkinVertexPositions(const GenericModel& model, const std::vector<glm::mat4>& palette, std::vector<glm::vec3>& outPositions) {
+		const size_t vertexCount = model.vertices.size();
+		outPositions.resize(vertexCount);
+		if (model.vertexWeights.size() != vertexCount || palette.empty()) {
+			for (size_t i = 0; i < vertexCount; ++i) {
+				outPositions[i] = model.vertices[i].position;
+			}
+			return;
+		}
+		const size_t batchCount = (vertexCount + SKINNING_BATCH_SIZE - 1) / SKINNING_BATCH_SIZE;
+		ThreadPool::Get().ParallelFor(batchCount, [&](size_t batch) {
+			const size_t end = std::min(vertexCount, (batch + 1) * SKINNING_BATCH_SIZE);
+			for (size_t i = batch * SKINNING_BATCH_SIZE; i < end; ++i) {
+				outPositions[i] = SkinPosition(model.vertices[i].position, model.vertexWeights[i], palette.data(), palette.size());
+			}
+		});
+	}
+}
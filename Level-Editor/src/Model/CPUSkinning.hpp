@@ -0,0 +1,13 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	constexpr size_t SKINNING_BATCH_SIZE = 4096;
+
+	// Skins the positions of all vertices of the model with a bone palette like model_skeletal.vert does, the result is
+	// in the space of the nodes. outPositions is resized to the vertex count and can be reused between calls to avoid allocations.
+	// Models without vertex weights get their bind pose positions.
+	void SkinVertexPositions(const GenericModel& model, const std::vector<glm::mat4>& palette, std::vector<glm::vec3>& outPositions);
+}
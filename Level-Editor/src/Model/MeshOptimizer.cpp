@@ -0,0 +1,232 @@
+#include "MeshOptimizer.hpp"
+#include "Threading/ThreadPool.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace SGF {
+	VertexCacheStatistics AnalyzeVertexCache(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+		assert(indexCount % 3 == 0);
+		VertexCacheStatistics statistics;
+		statistics.triangleCount = (uint32_t)(indexCount / 3);
+		// A vertex is in the cache while less than cacheSize misses happened since it was loaded
+		std::vector<uint32_t> loadTime(vertexCount, 0);
+		std::vector<bool> isReferenced(vertexCount, false);
+		uint32_t time = cacheSize + 1;
+		for (size_t i = 0; i < indexCount; ++i) {
+			uint32_t index = pIndices[i];
+			assert(index < vertexCount);
+			if (time - loadTime[index] > cacheSize) {
+				loadTime[index] = time++;
+				statistics.missCount++;
+			}
+			if (!isReferenced[index]) {
+				isReferenced[index] = true;
+				statistics.vertexCount++;
+			}
+		}
+		return statistics;
+	}
+
+	void OptimizeVertexCache(uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, std::vector<uint32_t>& clusterOffsets, uint32_t cacheSize) {
+		assert(indexCount % 3 == 0);
+		clusterOffsets.clear();
+		const uint32_t triangleCount = (uint32_t)(indexCount / 3);
+		if (triangleCount == 0) return;
+
+		// Triangle adjacency of every vertex
+		std::vector<uint32_t> liveCount(vertexCount, 0);
+		for (size_t i = 0; i < indexCount; ++i) {
+			liveCount[pIndices[i]]++;
+		}
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+		}
+		std::vector<uint32_t> adjacency(indexCount);
+		{
+			std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t t = 0; t < triangleCount; ++t) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					adjacency[fillOffsets[pIndices[t * 3 + k]]++] = t;
+				}
+			}
+		}
+
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> isEmitted(triangleCount, false);
+		std::vector<uint32_t> deadEnds;
+		deadEnds.reserve(indexCount);
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(indexCount);
+		uint32_t time = cacheSize + 1;
+		uint32_t cursor = 0;
+
+		auto skipDeadEnd = [&]() -> uint32_t {
+			while (!deadEnds.empty()) {
+				uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveCount[v] > 0) return v;
+			}
+			while (cursor < vertexCount) {
+				if (liveCount[cursor] > 0) return cursor;
+				++cursor;
+			}
+			return UINT32_MAX;
+		};
+
+		uint32_t fanningVertex = skipDeadEnd();
+		clusterOffsets.push_back(0);
+		while (fanningVertex != UINT32_MAX) {
+			// Emit all remaining triangles around the fanning vertex
+			candidates.clear();
+			for (uint32_t a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; ++a) {
+				uint32_t t = adjacency[a];
+				if (isEmitted[t]) continue;
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t v = pIndices[t * 3 + k];
+					output.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					liveCount[v]--;
+					if (time - cacheTime[v] > cacheSize) {
+						cacheTime[v] = time++;
+					}
+				}
+				isEmitted[t] = true;
+			}
+			// Next fanning vertex is the candidate that stays in the cache the longest while its triangles get emitted
+			uint32_t nextVertex = UINT32_MAX;
+			int64_t bestPriority = -1;
+			for (uint32_t v : candidates) {
+				if (liveCount[v] == 0) continue;
+				int64_t priority = 0;
+				if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize) {
+					priority = time - cacheTime[v];
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					nextVertex = v;
+				}
+			}
+			if (nextVertex == UINT32_MAX) {
+				nextVertex = skipDeadEnd();
+				uint32_t emittedTriangles = (uint32_t)(output.size() / 3);
+				if (nextVertex != UINT32_MAX && clusterOffsets.back() != emittedTriangles) {
+					clusterOffsets.push_back(emittedTriangles);
+				}
+			}
+			fanningVertex = nextVertex;
+		}
+		assert(output.size() == indexCount);
+		std::copy(output.begin(), output.end(), pIndices);
+	}
+
+	void OptimizeOverdraw(uint32_t* pIndices, size_t indexCount, const GenericModel::Vertex* pVertices, const std::vector<uint32_t>& clusterOffsets) {
+		const uint32_t triangleCount = (uint32_t)(indexCount / 3);
+		const size_t clusterCount = clusterOffsets.size();
+		if (clusterCount < 2) return;
+
+		struct Cluster {
+			glm::vec3 centroid;
+			glm::vec3 normal;
+			float area;
+		};
+		std::vector<Cluster> clusters(clusterCount);
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t c = 0; c < clusterCount; ++c) {
+			uint32_t end = c + 1 < clusterCount ? clusterOffsets[c + 1] : triangleCount;
+			Cluster& cluster = clusters[c];
+			cluster.centroid = glm::vec3(0.0f);
+			cluster.normal = glm::vec3(0.0f);
+			cluster.area = 0.0f;
+			for (uint32_t t = clusterOffsets[c]; t < end; ++t) {
+				const glm::vec3& p0 = pVertices[pIndices[t * 3 + 0]].position;
+				const glm::vec3& p1 = pVertices[pIndices[t * 3 + 1]].position;
+				const glm::vec3& p2 = pVertices[pIndices[t * 3 + 2]].position;
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(normal);
+				cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+				cluster.normal += normal;
+				cluster.area += area;
+			}
+			meshCentroid += cluster.centroid;
+			meshArea += cluster.area;
+			if (cluster.area > 0.0f) {
+				cluster.centroid /= cluster.area;
+			}
+		}
+		if (meshArea <= 0.0f) return;
+		meshCentroid /= meshArea;
+
+		std::vector<float> sortKeys(clusterCount);
+		for (size_t c = 0; c < clusterCount; ++c) {
+			float normalLength = glm::length(clusters[c].normal);
+			sortKeys[c] = normalLength > 0.0f ? glm::dot(clusters[c].centroid - meshCentroid, clusters[c].normal / normalLength) : 0.0f;
+		}
+		std::vector<uint32_t> order(clusterCount);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+		std::vector<uint32_t> sortedIndices;
+		sortedIndices.reserve(indexCount);
+		for (uint32_t c : order) {
+			uint32_t end = c + 1 < clusterCount ? clusterOffsets[c + 1] : triangleCount;
+			sortedIndices.insert(sortedIndices.end(), pIndices + clusterOffsets[c] * 3, pIndices + end * 3);
+		}
+		std::copy(sortedIndices.begin(), sortedIndices.end(), pIndices);
+	}
+
+	template<typename T>
+	void ApplyVertexRemap(std::vector<T>& values, uint32_t offset, const std::vector<uint32_t>& remap) {
+		std::vector<T> reordered(remap.size());
+		for (uint32_t v = 0; v < remap.size(); ++v) {
+			reordered[remap[v]] = values[offset + v];
+		}
+		std::copy(reordered.begin(), reordered.end(), values.begin() + offset);
+	}
+
+	void OptimizeVertexFetch(GenericModel& model, const GenericModel::Mesh& mesh) {
+		std::vector<uint32_t> remap(mesh.vertexCount, UINT32_MAX);
+		uint32_t nextVertex = 0;
+		for (uint32_t i = mesh.indexOffset; i < mesh.indexOffset + mesh.indexCount; ++i) {
+			uint32_t& index = model.indices[i];
+			if (remap[index] == UINT32_MAX) {
+				remap[index] = nextVertex++;
+			}
+			index = remap[index];
+		}
+		// Unreferenced vertices are kept at the end
+		for (auto& newIndex : remap) {
+			if (newIndex == UINT32_MAX) newIndex = nextVertex++;
+		}
+		ApplyVertexRemap(model.vertices, mesh.vertexOffset, remap);
+		if (!model.vertexWeights.empty()) {
+			ApplyVertexRemap(model.vertexWeights, mesh.vertexOffset, remap);
+		}
+	}
+
+	MeshOptimizationReport OptimizeMeshes(GenericModel& model) {
+		std::vector<MeshOptimizationReport> meshReports(model.meshes.size());
+		// Every mesh only touches its own index and vertex range
+		ThreadPool::Get().ParallelFor(model.meshes.size(), [&](size_t meshIndex) {
+			const auto& mesh = model.meshes[meshIndex];
+			uint32_t* pIndices = model.indices.data() + mesh.indexOffset;
+			auto& report = meshReports[meshIndex];
+			report.before = AnalyzeVertexCache(pIndices, mesh.indexCount, mesh.vertexCount);
+			std::vector<uint32_t> clusterOffsets;
+			OptimizeVertexCache(pIndices, mesh.indexCount, mesh.vertexCount, clusterOffsets);
+			OptimizeOverdraw(pIndices, mesh.indexCount, model.vertices.data() + mesh.vertexOffset, clusterOffsets);
+			report.after = AnalyzeVertexCache(pIndices, mesh.indexCount, mesh.vertexCount);
+			OptimizeVertexFetch(model, mesh);
+		});
+		MeshOptimizationReport report;
+		for (const auto& meshReport : meshReports) {
+			report.before.Add(meshReport.before);
+			report.after.Add(meshReport.after);
+		}
+		return report;
+	}
+}
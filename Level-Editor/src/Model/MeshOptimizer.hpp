@@ -0,0 +1,37 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+	// Post transform vertex cache statistics of an index buffer, simulated with a FIFO cache.
+	// ACMR is the number of cache misses per triangle, ATVR the number of misses per referenced vertex (1.0 is optimal).
+	struct VertexCacheStatistics {
+		uint32_t triangleCount = 0;
+		uint32_t vertexCount = 0;
+		uint32_t missCount = 0;
+		inline float GetACMR() const { return triangleCount == 0 ? 0.0f : (float)missCount / (float)triangleCount; }
+		inline float GetATVR() const { return vertexCount == 0 ? 0.0f : (float)missCount / (float)vertexCount; }
+		inline void Add(const VertexCacheStatistics& other) { triangleCount += other.triangleCount; vertexCount += other.vertexCount; missCount += other.missCount; }
+	};
+
+	struct MeshOptimizationReport {
+		VertexCacheStatistics before;
+		VertexCacheStatistics after;
+	};
+
+	// The indices are local to a vertex range of vertexCount vertices
+	VertexCacheStatistics AnalyzeVertexCache(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+	// Reorders the triangles for vertex cache locality (Tipsify, Sander et al. 2007).
+	// The first triangle of every cluster gets written to clusterOffsets, a cluster ends where the fan had to restart at a dead end.
+	void OptimizeVertexCache(uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, std::vector<uint32_t>& clusterOffsets, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+	// Sorts the clusters so the ones facing away from the mesh center are drawn first and occlude the inner ones
+	void OptimizeOverdraw(uint32_t* pIndices, size_t indexCount, const GenericModel::Vertex* pVertices, const std::vector<uint32_t>& clusterOffsets);
+	// Renumbers the vertices of the mesh in order of first use, the vertices and vertex weights are reordered to match
+	void OptimizeVertexFetch(GenericModel& model, const GenericModel::Mesh& mesh);
+
+	// Runs all optimizations for every mesh of the model in parallel
+	MeshOptimizationReport OptimizeMeshes(GenericModel& model);
+}
@@ -0,0 +1,286 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+#include "Threading/ThreadPool.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace SGF {
+	namespace {
+		// Largest error of a LOD relative to the diagonal of the mesh bounding box
+		constexpr float MAX_RELATIVE_LOD_ERROR = 0.1f;
+		// A LOD is dropped if it doesn't remove at least this fraction of the triangles of the previous one
+		constexpr float MIN_LOD_REDUCTION = 0.1f;
+
+		// Area weighted sum of squared plane distances
+		struct Quadric {
+			double a2, b2, c2, d2;
+			double ab, ac, ad, bc, bd, cd;
+			double weight;
+
+			inline void Add(const Quadric& other) {
+				a2 += other.a2; b2 += other.b2; c2 += other.c2; d2 += other.d2;
+				ab += other.ab; ac += other.ac; ad += other.ad; bc += other.bc; bd += other.bd; cd += other.cd;
+				weight += other.weight;
+			}
+			inline void AddPlane(const glm::dvec3& n, double d, double w) {
+				a2 += w * n.x * n.x; b2 += w * n.y * n.y; c2 += w * n.z * n.z; d2 += w * d * d;
+				ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+				bc += w * n.y * n.z; bd += w * n.y * d; cd += w * n.z * d;
+				weight += w;
+			}
+			// Mean squared distance of the point to the planes
+			inline double Evaluate(const glm::vec3& p) const {
+				double x = p.x, y = p.y, z = p.z;
+				double r = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z) + d2;
+				return weight > 0.0 ? std::max(r, 0.0) / weight : 0.0;
+			}
+		};
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			float error;
+		};
+
+		inline glm::vec3 GetTriangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+			return glm::cross(p1 - p0, p2 - p0);
+		}
+	}
+
+	float SimplifyMesh(const uint32_t* pIndices, size_t indexCount, const GenericModel::Vertex* pVertices, uint32_t vertexCount,
+		size_t targetIndexCount, float maxError, std::vector<uint32_t>& result) {
+		assert(indexCount % 3 == 0);
+		result.assign(pIndices, pIndices + indexCount);
+		if (indexCount <= targetIndexCount || vertexCount == 0) return 0.0f;
+
+		// Vertices at the same position are welded, the topology is built on the welded vertices
+		std::vector<uint32_t> welded(vertexCount);
+		std::vector<uint32_t> wedgeCount(vertexCount, 0);
+		{
+			std::vector<uint32_t> order(vertexCount);
+			std::iota(order.begin(), order.end(), 0);
+			auto lessPosition = [&](uint32_t a, uint32_t b) {
+				const glm::vec3& pa = pVertices[a].position;
+				const glm::vec3& pb = pVertices[b].position;
+				if (pa.x != pb.x) return pa.x < pb.x;
+				if (pa.y != pb.y) return pa.y < pb.y;
+				return pa.z < pb.z;
+			};
+			std::sort(order.begin(), order.end(), lessPosition);
+			for (size_t i = 0; i < order.size();) {
+				size_t end = i + 1;
+				while (end < order.size() && !lessPosition(order[i], order[end])) ++end;
+				for (size_t j = i; j < end; ++j) {
+					welded[order[j]] = order[i];
+				}
+				wedgeCount[order[i]] = (uint32_t)(end - i);
+				i = end;
+			}
+		}
+
+		// Vertices on open or non manifold edges and seams can't be collapsed
+		std::vector<bool> isLocked(vertexCount, false);
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			if (welded[v] == v && wedgeCount[v] > 1) isLocked[v] = true;
+		}
+		{
+			std::vector<uint64_t> edges;
+			edges.reserve(indexCount);
+			for (size_t t = 0; t < indexCount; t += 3) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t a = welded[result[t + k]];
+					uint32_t b = welded[result[t + (k + 1) % 3]];
+					if (a == b) continue;
+					edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			for (size_t i = 0; i < edges.size();) {
+				size_t end = i + 1;
+				while (end < edges.size() && edges[end] == edges[i]) ++end;
+				if (end - i != 2) {
+					isLocked[(uint32_t)(edges[i] >> 32)] = true;
+					isLocked[(uint32_t)(edges[i] & UINT32_MAX)] = true;
+				}
+				i = end;
+			}
+		}
+
+		std::vector<Quadric> quadrics(vertexCount, Quadric{});
+		for (size_t t = 0; t < indexCount; t += 3) {
+			const glm::vec3& p0 = pVertices[result[t]].position;
+			const glm::vec3& p1 = pVertices[result[t + 1]].position;
+			const glm::vec3& p2 = pVertices[result[t + 2]].position;
+			glm::dvec3 normal = glm::dvec3(GetTriangleNormal(p0, p1, p2));
+			double area = glm::length(normal);
+			if (area <= 0.0) continue;
+			normal /= area;
+			double d = -glm::dot(normal, glm::dvec3(p0));
+			for (uint32_t k = 0; k < 3; ++k) {
+				quadrics[welded[result[t + k]]].AddPlane(normal, d, area);
+			}
+		}
+
+		// Every vertex points to the vertex it was collapsed into
+		std::vector<uint32_t> collapsedInto(vertexCount);
+		std::iota(collapsedInto.begin(), collapsedInto.end(), 0);
+		auto resolve = [&](uint32_t v) {
+			while (collapsedInto[v] != v) v = collapsedInto[v];
+			return v;
+		};
+
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<bool> isTouched(vertexCount);
+		float resultError = 0.0f;
+		const float maxSquaredError = maxError * maxError;
+		while (result.size() > targetIndexCount) {
+			// Triangles around every welded vertex
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (uint32_t index : result) {
+				adjacencyOffsets[welded[index] + 1]++;
+			}
+			for (uint32_t v = 0; v < vertexCount; ++v) {
+				adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+			}
+			adjacency.resize(result.size());
+			{
+				std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < result.size(); ++i) {
+					adjacency[fillOffsets[welded[result[i]]]++] = (uint32_t)(i / 3);
+				}
+			}
+
+			collapses.clear();
+			for (size_t t = 0; t < result.size(); t += 3) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					for (uint32_t direction = 1; direction <= 2; ++direction) {
+						uint32_t from = result[t + k];
+						uint32_t to = result[t + (k + direction) % 3];
+						uint32_t u = welded[from];
+						uint32_t v = welded[to];
+						if (isLocked[u]) continue;
+						Quadric q = quadrics[u];
+						q.Add(quadrics[v]);
+						float error = (float)q.Evaluate(pVertices[to].position);
+						if (error <= maxSquaredError) {
+							collapses.push_back({ from, to, error });
+						}
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+			// Every collapse removes about two triangles, collapses in one pass don't share any triangle
+			std::fill(isTouched.begin(), isTouched.end(), false);
+			const size_t maxCollapseCount = (result.size() - targetIndexCount) / 6 + 1;
+			size_t collapseCount = 0;
+			for (const auto& collapse : collapses) {
+				if (collapseCount >= maxCollapseCount) break;
+				uint32_t u = welded[collapse.from];
+				uint32_t v = welded[collapse.to];
+				if (isTouched[u] || isTouched[v]) continue;
+
+				// Reject collapses that flip a remaining triangle
+				bool isFlipping = false;
+				const glm::vec3& target = pVertices[collapse.to].position;
+				for (uint32_t a = adjacencyOffsets[u]; a < adjacencyOffsets[u + 1] && !isFlipping; ++a) {
+					const uint32_t* pTriangle = &result[adjacency[a] * 3];
+					if (welded[pTriangle[0]] == v || welded[pTriangle[1]] == v || welded[pTriangle[2]] == v) continue;
+					glm::vec3 p[3];
+					for (uint32_t k = 0; k < 3; ++k) {
+						p[k] = welded[pTriangle[k]] == u ? target : pVertices[pTriangle[k]].position;
+					}
+					glm::vec3 before = GetTriangleNormal(pVertices[pTriangle[0]].position, pVertices[pTriangle[1]].position, pVertices[pTriangle[2]].position);
+					glm::vec3 after = GetTriangleNormal(p[0], p[1], p[2]);
+					isFlipping = glm::dot(before, after) <= 0.0f;
+				}
+				if (isFlipping) continue;
+
+				for (uint32_t a = adjacencyOffsets[u]; a < adjacencyOffsets[u + 1]; ++a) {
+					const uint32_t* pTriangle = &result[adjacency[a] * 3];
+					for (uint32_t k = 0; k < 3; ++k) {
+						isTouched[welded[pTriangle[k]]] = true;
+					}
+				}
+				// Unlocked vertices have a single wedge, so only collapse.from references u
+				collapsedInto[collapse.from] = collapse.to;
+				quadrics[v].Add(quadrics[u]);
+				resultError = std::max(resultError, collapse.error);
+				collapseCount++;
+			}
+			if (collapseCount == 0) break;
+
+			// Rebuild the triangles without the collapsed ones
+			size_t writeIndex = 0;
+			for (size_t t = 0; t < result.size(); t += 3) {
+				uint32_t a = resolve(result[t]);
+				uint32_t b = resolve(result[t + 1]);
+				uint32_t c = resolve(result[t + 2]);
+				if (welded[a] == welded[b] || welded[b] == welded[c] || welded[a] == welded[c]) continue;
+				result[writeIndex++] = a;
+				result[writeIndex++] = b;
+				result[writeIndex++] = c;
+			}
+			result.resize(writeIndex);
+			// The welded indices of collapsed vertices now point to the vertex they were collapsed into
+			for (uint32_t w = 0; w < vertexCount; ++w) {
+				if (collapsedInto[w] != w) welded[w] = welded[resolve(w)];
+			}
+		}
+		return std::sqrt(resultError);
+	}
+
+	void GenerateMeshLods(GenericModel& model) {
+		model.meshLods.clear();
+		std::vector<std::vector<GenericModel::MeshLod>> lods(model.meshes.size());
+		std::vector<std::vector<uint32_t>> lodIndices(model.meshes.size());
+		ThreadPool::Get().ParallelFor(model.meshes.size(), [&](size_t meshIndex) {
+			const auto& mesh = model.meshes[meshIndex];
+			if (mesh.indexCount / 3 < MIN_LOD_TRIANGLE_COUNT) return;
+			const uint32_t* pIndices = model.indices.data() + mesh.indexOffset;
+			const GenericModel::Vertex* pVertices = model.vertices.data() + mesh.vertexOffset;
+			const float maxError = glm::length(mesh.boundingBox.max - mesh.boundingBox.min) * MAX_RELATIVE_LOD_ERROR;
+
+			std::vector<uint32_t> simplified;
+			size_t previousIndexCount = mesh.indexCount;
+			for (uint32_t lod = 0; lod < MAX_MESH_LOD_COUNT; ++lod) {
+				size_t targetIndexCount = (previousIndexCount / 6) * 3;
+				if (targetIndexCount / 3 < MIN_LOD_TRIANGLE_COUNT / 4) break;
+				// Every LOD is simplified from the full mesh, so the error is relative to the original surface
+				float error = SimplifyMesh(pIndices, mesh.indexCount, pVertices, mesh.vertexCount, targetIndexCount, maxError, simplified);
+				if ((float)simplified.size() > (1.0f - MIN_LOD_REDUCTION) * (float)previousIndexCount || simplified.empty()) break;
+				std::vector<uint32_t> clusterOffsets;
+				OptimizeVertexCache(simplified.data(), simplified.size(), mesh.vertexCount, clusterOffsets);
+
+				GenericModel::MeshLod meshLod;
+				// The offset is made absolute once all meshes are done
+				meshLod.indexOffset = (uint32_t)lodIndices[meshIndex].size();
+				meshLod.indexCount = (uint32_t)simplified.size();
+				meshLod.error = error;
+				lods[meshIndex].push_back(meshLod);
+				lodIndices[meshIndex].insert(lodIndices[meshIndex].end(), simplified.begin(), simplified.end());
+				previousIndexCount = simplified.size();
+			}
+		});
+
+		size_t totalLodIndexCount = 0;
+		for (const auto& indices : lodIndices) {
+			totalLodIndexCount += indices.size();
+		}
+		model.indices.reserve(model.indices.size() + totalLodIndexCount);
+		for (size_t meshIndex = 0; meshIndex < model.meshes.size(); ++meshIndex) {
+			auto& mesh = model.meshes[meshIndex];
+			mesh.firstLod = (uint32_t)model.meshLods.size();
+			mesh.lodCount = (uint32_t)lods[meshIndex].size();
+			uint32_t indexOffset = (uint32_t)model.indices.size();
+			for (auto& meshLod : lods[meshIndex]) {
+				meshLod.indexOffset += indexOffset;
+				model.meshLods.push_back(meshLod);
+			}
+			model.indices.insert(model.indices.end(), lodIndices[meshIndex].begin(), lodIndices[meshIndex].end());
+		}
+	}
+}
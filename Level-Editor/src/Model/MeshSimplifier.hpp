@@ -0,0 +1,21 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	constexpr uint32_t MAX_MESH_LOD_COUNT = 4;
+	// Meshes with fewer triangles don't get LODs
+	constexpr uint32_t MIN_LOD_TRIANGLE_COUNT = 256;
+
+	// Simplifies a mesh by collapsing the edges with the lowest quadric error (Garland and Heckbert 1997).
+	// Vertices are never moved or created, so the result can be drawn with the vertices of the mesh.
+	// Vertices on open borders and attribute seams are kept in place.
+	// Returns the largest geometric error of the result in model space.
+	float SimplifyMesh(const uint32_t* pIndices, size_t indexCount, const GenericModel::Vertex* pVertices, uint32_t vertexCount,
+		size_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+
+	// Builds up to MAX_MESH_LOD_COUNT LODs for every mesh, each with about half the triangles of the previous one.
+	// The LOD indices are appended to model.indices and referenced by model.meshLods.
+	void GenerateMeshLods(GenericModel& model);
+}
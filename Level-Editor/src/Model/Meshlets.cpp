@@ -0,0 +1,145 @@
+#include "Meshlets.hpp"
+#include "Threading/ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace SGF {
+	namespace {
+		struct MeshletInfo {
+			glm::vec4 boundingSphere;
+			glm::vec4 normalCone;
+			uint32_t indexOffset;
+			uint8_t triangleCount;
+			uint8_t vertexCount;
+		};
+
+		// Ritter's bounding sphere: starts with the two most distant extreme points along the axes and grows it to contain all points
+		glm::vec4 ComputeBoundingSphere(const uint32_t* pIndices, size_t indexCount, const GenericModel::Vertex* pVertices) {
+			glm::vec3 minPoints[3], maxPoints[3];
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				minPoints[axis] = maxPoints[axis] = pVertices[pIndices[0]].position;
+			}
+			for (size_t i = 1; i < indexCount; ++i) {
+				const glm::vec3& p = pVertices[pIndices[i]].position;
+				for (uint32_t axis = 0; axis < 3; ++axis) {
+					if (p[axis] < minPoints[axis][axis]) minPoints[axis] = p;
+					if (p[axis] > maxPoints[axis][axis]) maxPoints[axis] = p;
+				}
+			}
+			uint32_t widestAxis = 0;
+			float widestSpan = -1.0f;
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				float span = glm::dot(maxPoints[axis] - minPoints[axis], maxPoints[axis] - minPoints[axis]);
+				if (span > widestSpan) {
+					widestSpan = span;
+					widestAxis = axis;
+				}
+			}
+			glm::vec3 center = (minPoints[widestAxis] + maxPoints[widestAxis]) * 0.5f;
+			float radius = std::sqrt(widestSpan) * 0.5f;
+			for (size_t i = 0; i < indexCount; ++i) {
+				const glm::vec3& p = pVertices[pIndices[i]].position;
+				float distance = glm::length(p - center);
+				if (distance > radius) {
+					float newRadius = (radius + distance) * 0.5f;
+					center += (p - center) * ((newRadius - radius) / distance);
+					radius = newRadius;
+				}
+			}
+			return glm::vec4(center, radius);
+		}
+
+		glm::vec4 ComputeNormalCone(const uint32_t* pIndices, size_t indexCount, const GenericModel::Vertex* pVertices) {
+			const glm::vec4 NO_CONE = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+			glm::vec3 normalSum(0.0f);
+			for (size_t i = 0; i < indexCount; i += 3) {
+				glm::vec3 normal = glm::cross(pVertices[pIndices[i + 1]].position - pVertices[pIndices[i]].position, pVertices[pIndices[i + 2]].position - pVertices[pIndices[i]].position);
+				float length = glm::length(normal);
+				if (length > 0.0f) normalSum += normal / length;
+			}
+			float sumLength = glm::length(normalSum);
+			if (sumLength <= 0.0f) return NO_CONE;
+			glm::vec3 axis = normalSum / sumLength;
+			float minDot = 1.0f;
+			for (size_t i = 0; i < indexCount; i += 3) {
+				glm::vec3 normal = glm::cross(pVertices[pIndices[i + 1]].position - pVertices[pIndices[i]].position, pVertices[pIndices[i + 2]].position - pVertices[pIndices[i]].position);
+				float length = glm::length(normal);
+				if (length > 0.0f) minDot = std::min(minDot, glm::dot(normal / length, axis));
+			}
+			// Normals more than 90 degrees apart from the axis face the camera from every direction
+			if (minDot <= 0.0f) return NO_CONE;
+			return glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+		}
+	}
+
+	void BuildMeshlets(GenericModel& model) {
+		std::vector<std::vector<MeshletInfo>> meshMeshlets(model.meshes.size());
+		ThreadPool::Get().ParallelFor(model.meshes.size(), [&](size_t meshIndex) {
+			const auto& mesh = model.meshes[meshIndex];
+			const uint32_t* pIndices = model.indices.data() + mesh.indexOffset;
+			const GenericModel::Vertex* pVertices = model.vertices.data() + mesh.vertexOffset;
+			auto& meshlets = meshMeshlets[meshIndex];
+			// Id of the last meshlet that referenced a vertex
+			std::vector<uint32_t> vertexMeshlet(mesh.vertexCount, UINT32_MAX);
+
+			auto finishMeshlet = [&](uint32_t begin, uint32_t end, uint32_t vertexCount) {
+				MeshletInfo meshlet;
+				meshlet.boundingSphere = ComputeBoundingSphere(pIndices + begin, end - begin, pVertices);
+				meshlet.normalCone = ComputeNormalCone(pIndices + begin, end - begin, pVertices);
+				meshlet.indexOffset = mesh.indexOffset + begin;
+				meshlet.triangleCount = (uint8_t)((end - begin) / 3);
+				meshlet.vertexCount = (uint8_t)vertexCount;
+				meshlets.push_back(meshlet);
+			};
+
+			uint32_t begin = 0;
+			uint32_t vertexCount = 0;
+			for (uint32_t i = 0; i < mesh.indexCount; i += 3) {
+				uint32_t id = (uint32_t)meshlets.size();
+				uint32_t a = pIndices[i], b = pIndices[i + 1], c = pIndices[i + 2];
+				uint32_t newVertexCount = (vertexMeshlet[a] != id ? 1 : 0) + (b != a && vertexMeshlet[b] != id ? 1 : 0) +
+					(c != a && c != b && vertexMeshlet[c] != id ? 1 : 0);
+				if (vertexCount + newVertexCount > MAX_MESHLET_VERTICES || (i - begin) / 3 >= MAX_MESHLET_TRIANGLES) {
+					finishMeshlet(begin, i, vertexCount);
+					begin = i;
+					vertexCount = 0;
+					id++;
+				}
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t index = pIndices[i + k];
+					if (vertexMeshlet[index] != id) {
+						vertexMeshlet[index] = id;
+						vertexCount++;
+					}
+				}
+			}
+			if (begin < mesh.indexCount) {
+				finishMeshlet(begin, mesh.indexCount, vertexCount);
+			}
+		});
+
+		model.meshlets.Clear();
+		size_t totalCount = 0;
+		for (const auto& meshlets : meshMeshlets) {
+			totalCount += meshlets.size();
+		}
+		auto& data = model.meshlets;
+		data.boundingSpheres.reserve(totalCount);
+		data.normalCones.reserve(totalCount);
+		data.indexOffsets.reserve(totalCount);
+		data.triangleCounts.reserve(totalCount);
+		data.vertexCounts.reserve(totalCount);
+		for (size_t meshIndex = 0; meshIndex < model.meshes.size(); ++meshIndex) {
+			auto& mesh = model.meshes[meshIndex];
+			mesh.firstMeshlet = (uint32_t)data.GetCount();
+			mesh.meshletCount = (uint32_t)meshMeshlets[meshIndex].size();
+			for (const auto& meshlet : meshMeshlets[meshIndex]) {
+				data.boundingSpheres.push_back(meshlet.boundingSphere);
+				data.normalCones.push_back(meshlet.normalCone);
+				data.indexOffsets.push_back(meshlet.indexOffset);
+				data.triangleCounts.push_back(meshlet.triangleCount);
+				data.vertexCounts.push_back(meshlet.vertexCount);
+			}
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+	constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+	// Splits the index range of every mesh into meshlets without reordering it, so the triangle order of the
+	// vertex cache optimization is kept and a meshlet can be drawn as a plain index range.
+	void BuildMeshlets(GenericModel& model);
+
+	// Transforms a mesh space bounding sphere, the radius is scaled by the largest axis scale
+	inline glm::vec4 TransformBoundingSphere(const glm::mat4& transform, const glm::vec4& sphere) {
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		return glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * scale);
+	}
+	// All triangles of the cluster face away from the camera, the sphere and cone axis are in world space
+	inline bool IsMeshletBackfacing(const glm::vec4& sphere, const glm::vec3& coneAxis, float coneCutoff, const glm::vec3& cameraPosition) {
+		glm::vec3 toCenter = glm::vec3(sphere) - cameraPosition;
+		return glm::dot(toCenter, coneAxis) >= coneCutoff * glm::length(toCenter) + sphere.w;
+	}
+}
@@ -1,5 +1,11 @@
 #include "Model.hpp"
+#include "ModelCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include "AnimationCompression.hpp"
 #include "Filesystem/File.hpp"
+#include "Threading/ThreadPool.hpp"
 
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
@@ -10,19 +16,40 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
 
 namespace SGF {
 	void TraverseNode(GenericModel* pModel, aiNode* pNode, uint32_t parentIndex = 0);
 
 	void BuildNode(GenericModel* pModel, aiNode* pNode, GenericModel::Node& node);
 
-	void LoadSkeletalAnimations(GenericModel* pModel, const aiScene* pScene) {
+	inline std::string_view ToStringView(const aiString& str) {
+		return std::string_view(str.C_Str(), str.length);
+	}
+
+	// Maps every node name of the scene to its first node in depth first order
+	void BuildNodeNameIndex(const aiNode* pNode, std::unordered_map<std::string_view, const aiNode*>& nodeIndex) {
+		nodeIndex.try_emplace(ToStringView(pNode->mName), pNode);
+		for (uint32_t i = 0; i < pNode->mNumChildren; ++i) {
+			BuildNodeNameIndex(pNode->mChildren[i], nodeIndex);
+		}
+	}
+
+	// Only reads the bones, so it can run in the background while the model is already in use
+	void LoadSkeletalAnimations(const std::vector<GenericModel::Bone>& bones, const aiScene* pScene, std::vector<GenericModel::Animation>& animations) {
 		if (pScene->mNumAnimations == 0) {
 			Log::Info("Model has no animations!");
 			return;
 		}
 
-		pModel->animations.reserve(pScene->mNumAnimations);
+		animations.reserve(animations.size() + pScene->mNumAnimations);
+
+		// Bone names are looked up once per channel of every animation
+		std::unordered_map<std::string_view, uint32_t> boneNameToIndex;
+		boneNameToIndex.reserve(bones.size());
+		for (uint32_t i = 0; i < bones.size(); ++i) {
+			boneNameToIndex.try_emplace(bones[i].name, i);
+		}
 
 		for (uint32_t animIndex = 0; animIndex < pScene->mNumAnimations; ++animIndex) {
 			const aiAnimation* pAnim = pScene->mAnimations[animIndex];
@@ -36,22 +63,14 @@ namespace SGF {
 			for (uint32_t channelIndex = 0; channelIndex < pAnim->mNumChannels; ++channelIndex) {
 				const aiNodeAnim* pNodeAnim = pAnim->mChannels[channelIndex];
 
-				// Find bone index by name
-				uint32_t boneIndex = UINT32_MAX;
-				for (uint32_t i = 0; i < pModel->bones.size(); ++i) {
-					if (pModel->bones[i].name == pNodeAnim->mNodeName.C_Str()) {
-						boneIndex = i;
-						break;
-					}
-				}
-
-				if (boneIndex == UINT32_MAX) {
+				auto boneIt = boneNameToIndex.find(ToStringView(pNodeAnim->mNodeName));
+				if (boneIt == boneNameToIndex.end()) {
 					Log::Warn("Animation channel '{}' references unknown bone '{}'", pAnim->mName.C_Str(), pNodeAnim->mNodeName.C_Str());
 					continue;
 				}
 
 				GenericModel::AnimationChannel channel;
-				channel.boneIndex = boneIndex;
+				channel.boneIndex = boneIt->second;
 
 				// Load position keys
 				channel.positionKeys.reserve(pNodeAnim->mNumPositionKeys);
@@ -89,7 +108,7 @@ namespace SGF {
 				animation.channels.push_back(channel);
 			}
 
-			pModel->animations.push_back(animation);
+			animations.push_back(animation);
 			Log::Info("Loaded animation '{}' with {} channels, duration: {:.2f}s",
 				animation.name, animation.channels.size(), animation.duration);
 		}
@@ -101,8 +120,8 @@ namespace SGF {
 			return;
 		}
 
-		// Map bone names to indices for quick lookup
-		std::unordered_map<std::string, uint32_t> boneNameToIndex;
+		// Map bone names to indices for quick lookup, the names are owned by the scene
+		std::unordered_map<std::string_view, uint32_t> boneNameToIndex;
 
 		// Collect all bones from all meshes
 		for (uint32_t meshIndex = 0; meshIndex < pScene->mNumMeshes; ++meshIndex) {
@@ -110,15 +129,12 @@ namespace SGF {
 
 			for (uint32_t boneIndex = 0; boneIndex < pMesh->mNumBones; ++boneIndex) {
 				const aiBone* pBone = pMesh->mBones[boneIndex];
-				std::string boneName = pBone->mName.C_Str();
+				uint32_t newBoneIndex = (uint32_t)(pModel->bones.size());
 
 				// Check if bone already added
-				if (boneNameToIndex.find(boneName) == boneNameToIndex.end()) {
-					uint32_t newBoneIndex = (uint32_t)(pModel->bones.size());
-					boneNameToIndex[boneName] = newBoneIndex;
-
+				if (boneNameToIndex.try_emplace(ToStringView(pBone->mName), newBoneIndex).second) {
 					GenericModel::Bone bone;
-					bone.name = boneName;
+					bone.name = pBone->mName.C_Str();
 					bone.index = newBoneIndex;
 					bone.parent = UINT32_MAX;
 					bone.currentTransform = glm::mat4(1.0f);
@@ -141,34 +157,24 @@ namespace SGF {
 		}
 
 		// Setup bone hierarchy from skeleton
+		std::unordered_map<std::string_view, const aiNode*> nodeNameToNode;
+		BuildNodeNameIndex(pScene->mRootNode, nodeNameToNode);
 		for (uint32_t boneIndex = 0; boneIndex < pModel->bones.size(); ++boneIndex) {
-			const auto& boneName = pModel->bones[boneIndex].name;
+			auto& bone = pModel->bones[boneIndex];
 
 			// Find bone node in armature
-			std::function<aiNode* (aiNode*, const std::string&)> findBoneNode =
-				[&](aiNode* node, const std::string& name) -> aiNode* {
-				if (strncmp(node->mName.C_Str(), name.c_str(), name.size()) == 0) {
-					return node;
-				}
-				for (uint32_t i = 0; i < node->mNumChildren; ++i) {
-					auto* result = findBoneNode(node->mChildren[i], name);
-					if (result) return result;
-				}
-				return nullptr;
-				};
-
-			aiNode* boneNode = findBoneNode(pScene->mRootNode, boneName);
-			if (boneNode) {
-				auto& bone = pModel->bones[boneIndex];
+			auto nodeIt = nodeNameToNode.find(bone.name);
+			if (nodeIt != nodeNameToNode.end()) {
+				const aiNode* boneNode = nodeIt->second;
 				for (uint32_t j = 0; j < 4; ++j) {
 					for (uint32_t k = 0; k < 4; ++k) {
 						bone.nodeTransform[k][j] = boneNode->mTransformation[j][k];
 					}
 				}
 				if (boneNode->mParent) {
-					const std::string parentName = boneNode->mParent->mName.C_Str();
-					if (boneNameToIndex.find(parentName) != boneNameToIndex.end()) {
-						bone.parent = boneNameToIndex[parentName];
+					auto parentIt = boneNameToIndex.find(ToStringView(boneNode->mParent->mName));
+					if (parentIt != boneNameToIndex.end()) {
+						bone.parent = parentIt->second;
 					}
 				}
 			}
@@ -177,27 +183,20 @@ namespace SGF {
 		{
 			std::vector<GenericModel::Bone> sortedBones;
 			sortedBones.reserve(pModel->bones.size());
-			std::unordered_map<uint32_t, uint32_t> oldToNewIndex;
+			std::vector<uint32_t> oldToNewIndex(pModel->bones.size(), UINT32_MAX);
+			std::vector<uint32_t> unsortedAncestors;
 
-			std::function<void(uint32_t)> addBoneRecursive = [&](uint32_t boneIdx) {
-				if (oldToNewIndex.find(boneIdx) != oldToNewIndex.end()) {
-					return; // Already added
+			// Process all bones, the ancestors of a bone are added first
+			for (uint32_t i = 0; i < pModel->bones.size(); ++i) {
+				unsortedAncestors.clear();
+				for (uint32_t boneIdx = i; boneIdx != UINT32_MAX && oldToNewIndex[boneIdx] == UINT32_MAX; boneIdx = pModel->bones[boneIdx].parent) {
+					unsortedAncestors.push_back(boneIdx);
 				}
-
-				// Add all ancestors first
-				if (pModel->bones[boneIdx].parent != UINT32_MAX) {
-					addBoneRecursive(pModel->bones[boneIdx].parent);
+				for (auto it = unsortedAncestors.rbegin(); it != unsortedAncestors.rend(); ++it) {
+					oldToNewIndex[*it] = (uint32_t)(sortedBones.size());
+					sortedBones.push_back(pModel->bones[*it]);
+					sortedBones.back().index = (uint32_t)(sortedBones.size() - 1);
 				}
-
-				// Now add this bone
-				oldToNewIndex[boneIdx] = (uint32_t)(sortedBones.size());
-				sortedBones.push_back(pModel->bones[boneIdx]);
-				sortedBones.back().index = (uint32_t)(sortedBones.size() - 1);
-				};
-
-			// Process all bones
-			for (uint32_t i = 0; i < pModel->bones.size(); ++i) {
-				addBoneRecursive(i);
 			}
 
 			// Update parent indices to reference the new ordering
@@ -212,6 +211,9 @@ namespace SGF {
 				for (auto& channel : animation.channels) {
 					channel.boneIndex = oldToNewIndex[channel.boneIndex];
 				}
+				for (auto& channel : animation.compressed.channels) {
+					channel.boneIndex = oldToNewIndex[channel.boneIndex];
+				}
 			}
 			// Update vertex weights to reference new bone indices
 			for (auto& weight : pModel->vertexWeights) {
@@ -229,6 +231,10 @@ namespace SGF {
 			}
 
 			pModel->bones = std::move(sortedBones);
+			// The vertex weights below are loaded with the sorted indices
+			for (auto& [boneName, boneIndex] : boneNameToIndex) {
+				boneIndex = oldToNewIndex[boneIndex];
+			}
 		}
 
 		// Load vertex weights
@@ -249,7 +255,7 @@ namespace SGF {
 
 			for (uint32_t boneIndex = 0; boneIndex < pMesh->mNumBones; ++boneIndex) {
 				const aiBone* pBone = pMesh->mBones[boneIndex];
-				uint32_t globalBoneIndex = boneNameToIndex[pBone->mName.C_Str()];
+				uint32_t globalBoneIndex = boneNameToIndex[ToStringView(pBone->mName)];
 
 				for (uint32_t weightIndex = 0; weightIndex < pBone->mNumWeights; ++weightIndex) {
 					const aiVertexWeight& vWeight = pBone->mWeights[weightIndex];
@@ -313,6 +319,52 @@ namespace SGF {
 		}
 		//assert(textures[i].GetWidth() != 0 && textures[i].GetHeight() != 0);
 	}
+	// Texture job table of an import: every unique texture path gets an index and one decode job on the thread pool.
+	// Meshes only need the index, so geometry conversion continues while the images are decoded.
+	class TextureLoadTable {
+	public:
+		inline TextureLoadTable(uint32_t firstTextureIndex) : firstIndex(firstTextureIndex) {}
+		uint32_t GetTextureIndex(GenericModel* pModel, const aiScene* pScene, const aiString& path, const char* filename) {
+			std::string texturePath(path.C_Str(), path.length);
+			std::lock_guard lock(mutex);
+			auto [it, inserted] = pathToIndex.try_emplace(std::move(texturePath), (uint32_t)pendingTextures.size());
+			if (inserted) {
+				// The scene is owned by the importer of the running import and outlives all jobs
+				pendingTextures.push_back(ThreadPool::Get().Submit([pModel, pScene, path = it->first, filename]() mutable {
+					return LoadTextureFromAssimp(pModel, pScene, path, filename);
+				}));
+			}
+			return firstIndex + it->second;
+		}
+		inline uint32_t GetTextureCount() const { return (uint32_t)pendingTextures.size(); }
+		uint32_t GetFinishedCount() const {
+			uint32_t finishedCount = 0;
+			for (const auto& future : pendingTextures) {
+				if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) ++finishedCount;
+			}
+			return finishedCount;
+		}
+		inline bool IsFinished() const { return GetFinishedCount() == GetTextureCount(); }
+		// Waits for all decode jobs and appends the textures in index order, placeholders behind firstIndex get replaced
+		void MoveTextures(std::vector<Texture>& textures) {
+			assert(textures.size() >= firstIndex);
+			while (textures.size() > firstIndex) {
+				textures.pop_back();
+			}
+			textures.reserve(textures.size() + pendingTextures.size());
+			for (auto& future : pendingTextures) {
+				ThreadPool::Get().Wait(future);
+				textures.push_back(future.get());
+			}
+			pendingTextures.clear();
+		}
+	private:
+		std::mutex mutex;
+		std::unordered_map<std::string, uint32_t> pathToIndex;
+		std::vector<std::future<Texture>> pendingTextures;
+		uint32_t firstIndex;
+	};
+
 	void GetVertexPositionsAndNormals(GenericModel* pModel, const aiMesh* pMesh, GenericModel::Mesh& meshInfo) {
 		for (uint32_t j = 0; j < pMesh->mNumVertices; ++j) {
 			auto& vert = pMesh->mVertices[j];
@@ -336,7 +388,7 @@ namespace SGF {
 		}
 	}
 
-	void LoadMesh(GenericModel* pModel, const aiScene* pScene, const aiMesh* pMesh, GenericModel::Mesh& meshInfo, std::vector<std::string>& diffuseTextures, const char* filename) {
+	void LoadMesh(GenericModel* pModel, const aiScene* pScene, const aiMesh* pMesh, GenericModel::Mesh& meshInfo, TextureLoadTable& textureTable, const char* filename) {
 		// Get vertex positions and indices
 		GetIndices(pModel, pMesh, meshInfo);
 		
@@ -355,19 +407,7 @@ namespace SGF {
 				if (material->GetTextureCount(type) > 0) {
 					// Get the first diffuse texture, along with the UV index it uses
 					if (material->GetTexture(type, 0, &texPath, nullptr, &uvChannelIndex) == AI_SUCCESS) {
-						bool isAlreadyInside = false;
-						for (size_t i = 0; i < diffuseTextures.size(); ++i) {
-							if ((diffuseTextures[i].length() == texPath.length) && strncmp(diffuseTextures[i].c_str(), texPath.C_Str(), texPath.length) == 0) {
-								isAlreadyInside = true;
-								meshInfo.textureIndex = (uint32_t)i;
-								break;
-							}
-						}
-						if (!isAlreadyInside) {
-							meshInfo.textureIndex = (uint32_t)pModel->textures.size();
-							diffuseTextures.emplace_back(texPath.C_Str());
-							pModel->textures.push_back(LoadTextureFromAssimp(pModel, pScene, diffuseTextures.back(), filename));
-						}
+						meshInfo.textureIndex = textureTable.GetTextureIndex(pModel, pScene, texPath, filename);
 
 						hasTexture = true;
 						break;
@@ -416,44 +456,72 @@ namespace SGF {
 		}
 	}
 
-	const GenericModel::Node* GenericModel::ImportModel(const char* filename) {
-		Timer importTime;
-		//Clear();
-		Assimp::Importer importer;
+	inline bool IsImportCancelled(const ImportProgress* pProgress) {
+		return pProgress != nullptr && pProgress->isCancelled;
+	}
+	inline void SetImportProgress(ImportProgress* pProgress, float progress) {
+		if (pProgress != nullptr) pProgress->progress = progress;
+	}
+
+	// Forwards the read progress of Assimp and aborts the read when the import gets cancelled
+	class ImportProgressHandler : public Assimp::ProgressHandler {
+	public:
+		inline ImportProgressHandler(ImportProgress* pProgress, float progressScale) : pProgress(pProgress), progressScale(progressScale) {}
+		virtual bool Update(float percentage = -1.f) override {
+			if (percentage >= 0.0f) SetImportProgress(pProgress, percentage * progressScale);
+			return !IsImportCancelled(pProgress);
+		}
+	private:
+		ImportProgress* pProgress;
+		float progressScale;
+	};
+
+	// The progress of the import goes up to progressScale while Assimp reads the file
+	const aiScene* ReadScene(Assimp::Importer& importer, const char* filename, ImportProgress* pProgress, float progressScale) {
+		if (pProgress != nullptr) {
+			// The importer takes ownership of the handler
+			importer.SetProgressHandler(new ImportProgressHandler(pProgress, progressScale));
+		}
 		const aiScene* scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals | aiProcess_GenBoundingBoxes | aiProcess_FlipUVs);
-		auto assimpLoadTime = importTime.currentMillis();
+		if (IsImportCancelled(pProgress)) {
+			SGF::Log::Info("Import of file: {} was cancelled", filename);
+			return nullptr;
+		}
 		if (scene == nullptr) {
 			SGF::Log::Error("No Scene available for file: {}", filename);
-			return nullptr;
 		}
-		name = scene->mName.C_Str();
+		SetImportProgress(pProgress, progressScale);
+		return scene;
+	}
 
-		const GenericModel::Node* pAttachmentNode = nullptr;
-		
+	// Builds the nodes and meshes of the scene and starts the texture jobs, returns the node the scene was attached to
+	const GenericModel::Node* LoadSceneGeometry(GenericModel* pModel, const aiScene* scene, TextureLoadTable& textureTable, const char* filename) {
+		pModel->name = scene->mName.C_Str();
+
+		const bool isFirstImport = pModel->nodes.empty();
 		auto* pRoot = scene->mRootNode;
-		if (nodes.size() == 0) {
+		if (isFirstImport) {
 			// Get root from model:
-			nodes.emplace_back();
-			auto& root = nodes[0];
+			pModel->nodes.emplace_back();
+			auto& root = pModel->nodes[0];
 			root.parent = UINT32_MAX;
 			root.name = pRoot->mName.Empty() ? "root" : pRoot->mName.C_Str();
 			root.index = 0;
-			BuildNode(this, pRoot, root);
+			BuildNode(pModel, pRoot, root);
 			root.children.reserve(pRoot->mNumChildren);
-			pAttachmentNode = &root;
 			for (unsigned int i = 0; i < pRoot->mNumChildren; ++i) {
-				TraverseNode(this, pRoot->mChildren[i], 0);
+				TraverseNode(pModel, pRoot->mChildren[i], 0);
 			}
 		} else {
-			TraverseNode(this, pRoot, 0);
+			TraverseNode(pModel, pRoot, 0);
 		}
-		
 
 		// Set Bounding-Boxes for each mesh and reserve the Containers
 		{
+			auto& meshes = pModel->meshes;
 			meshes.resize(scene->mNumMeshes);
-			uint32_t totalIndices = (uint32_t)indices.size();
-			uint32_t totalVertices = (uint32_t)vertices.size();
+			uint32_t totalIndices = (uint32_t)pModel->indices.size();
+			uint32_t totalVertices = (uint32_t)pModel->vertices.size();
 			for (uint32_t i = 0; i < scene->mNumMeshes; ++i) {
 				auto& m = meshes[i];
 				auto& sm = scene->mMeshes[i];
@@ -469,40 +537,250 @@ namespace SGF {
 				m.vertexOffset = totalVertices;
 				m.indexCount = sm->mNumFaces * 3;
 				m.indexOffset = totalIndices;
+				m.firstLod = 0;
+				m.lodCount = 0;
+				m.firstMeshlet = 0;
+				m.meshletCount = 0;
 
 				totalVertices += sm->mNumVertices;
 				totalIndices += sm->mNumFaces * 3;
 			}
 
-			vertices.resize(totalVertices);
-			indices.resize(totalIndices);
+			pModel->vertices.resize(totalVertices);
+			pModel->indices.resize(totalIndices);
 		}
 		// Get texture uv-coordinates and texture indices
-		{
-			std::vector<std::string> diffuseTextures;
-			diffuseTextures.reserve(scene->mNumMeshes);
-			std::vector<aiColor4D> baseColors;
-			textures.reserve(scene->mNumMeshes);
-
-			for (uint32_t meshIndex = 0; meshIndex < scene->mNumMeshes; ++meshIndex) {
-				aiMesh* mesh = scene->mMeshes[meshIndex];
-				auto& m = meshes[meshIndex];
-				LoadMesh(this, scene, mesh, m, diffuseTextures, filename);
+		// Every mesh writes only to its own vertex and index range, so the meshes can be converted in parallel
+		ThreadPool::Get().ParallelFor(scene->mNumMeshes, [&](size_t meshIndex) {
+			aiMesh* mesh = scene->mMeshes[meshIndex];
+			auto& m = pModel->meshes[meshIndex];
+			LoadMesh(pModel, scene, mesh, m, textureTable, filename);
+		});
+		return isFirstImport ? &pModel->nodes[0] : nullptr;
+	}
+
+	void OptimizeImportedMeshes(GenericModel* pModel) {
+		Timer optimizeTime;
+		MeshOptimizationReport report = OptimizeMeshes(*pModel);
+		SGF::Log::Info("Optimized meshes of model: {} in {} milliseconds, ACMR: {:.3f} -> {:.3f}, ATVR: {:.3f} -> {:.3f}", pModel->name, optimizeTime.currentMillis(),
+			report.before.GetACMR(), report.after.GetACMR(), report.before.GetATVR(), report.after.GetATVR());
+	}
+
+	void GenerateImportedMeshLods(GenericModel* pModel) {
+		Timer lodTime;
+		size_t lodIndexCount = pModel->indices.size();
+		GenerateMeshLods(*pModel);
+		lodIndexCount = pModel->indices.size() - lodIndexCount;
+		SGF::Log::Info("Generated {} LODs for meshes of model: {} in {} milliseconds, {} additional indices", pModel->meshLods.size(), pModel->name,
+			lodTime.currentMillis(), lodIndexCount);
+	}
+
+	void BuildImportedMeshlets(GenericModel* pModel) {
+		Timer meshletTime;
+		BuildMeshlets(*pModel);
+		SGF::Log::Info("Built {} meshlets for model: {} in {} milliseconds", pModel->meshlets.GetCount(), pModel->name, meshletTime.currentMillis());
+	}
+
+	// Already compressed animations are skipped, compressing them again would add to their error
+	void CompressImportedAnimations(std::vector<GenericModel::Animation>& animations) {
+		Timer compressTime;
+		std::vector<AnimationCompressionReport> reports(animations.size());
+		ThreadPool::Get().ParallelFor(animations.size(), [&](size_t i) {
+			if (!animations[i].IsCompressed()) {
+				reports[i] = CompressAnimation(animations[i]);
 			}
-			// load all textures:
-			{
-				for (size_t i = 0; i < diffuseTextures.size(); ++i) {
-					assert(textures[i].GetWidth() != 0 && textures[i].GetHeight() != 0);
-				}
-				textures.shrink_to_fit();
+		});
+		AnimationCompressionReport total;
+		for (size_t i = 0; i < animations.size(); ++i) {
+			const auto& report = reports[i];
+			if (report.size == 0) continue;
+			SGF::Log::Info("Compressed animation '{}': {} -> {} keys, {} -> {} bytes ({:.1f}x)", animations[i].name, report.keyCount, report.compressedKeyCount,
+				report.size, report.compressedSize, report.GetRatio());
+			total.Add(report);
+		}
+		if (total.size != 0) {
+			SGF::Log::Info("Compressed animations in {} milliseconds, {} -> {} bytes", compressTime.currentMillis(), total.size, total.compressedSize);
+		}
+	}
+
+	const GenericModel::Node* GenericModel::ImportModel(const char* filename, uint32_t importFlags, ImportProgress* pProgress) {
+		Timer importTime;
+		//Clear();
+		// The cache only holds complete models, so it can only be used when importing into an empty model
+		const bool useCache = nodes.empty();
+		if (useCache && LoadModelCache(*this, filename, importFlags)) {
+			// The cache stores the animations decompressed
+			if (importFlags & MODEL_IMPORT_COMPRESS_ANIMATIONS) {
+				CompressImportedAnimations(animations);
 			}
+			SetImportProgress(pProgress, 1.0f);
+			return &nodes[0];
 		}
+		Assimp::Importer importer;
+		const aiScene* scene = ReadScene(importer, filename, pProgress, 0.6f);
+		auto assimpLoadTime = importTime.currentMillis();
+		if (scene == nullptr) {
+			return nullptr;
+		}
+
+		TextureLoadTable textureTable((uint32_t)textures.size());
+		const GenericModel::Node* pAttachmentNode = LoadSceneGeometry(this, scene, textureTable, filename);
+		SetImportProgress(pProgress, 0.8f);
+		// Skeleton and animations get loaded while the texture jobs are still decoding
 		LoadSkeletalBones(this, scene);
-		LoadSkeletalAnimations(this, scene);
+		LoadSkeletalAnimations(bones, scene, animations);
+		// Runs after the bones, the vertex weights get reordered together with the vertices
+		if (importFlags & MODEL_IMPORT_OPTIMIZE_MESHES) {
+			OptimizeImportedMeshes(this);
+		}
+		// The LODs reference the final vertex order
+		if (importFlags & MODEL_IMPORT_GENERATE_LODS) {
+			GenerateImportedMeshLods(this);
+		}
+		if (importFlags & MODEL_IMPORT_BUILD_MESHLETS) {
+			BuildImportedMeshlets(this);
+		}
+		SetImportProgress(pProgress, 0.9f);
+		// load all textures:
+		{
+			textureTable.MoveTextures(textures);
+			for (size_t i = 0; i < textures.size(); ++i) {
+				assert(textures[i].GetWidth() != 0 && textures[i].GetHeight() != 0);
+			}
+			textures.shrink_to_fit();
+		}
+		if (IsImportCancelled(pProgress)) {
+			SGF::Log::Info("Import of file: {} was cancelled", filename);
+			return nullptr;
+		}
+		if (useCache) {
+			SaveModelCache(*this, filename, importFlags);
+		}
+		// After the cache was written, it keeps the full precision keys
+		if (importFlags & MODEL_IMPORT_COMPRESS_ANIMATIONS) {
+			CompressImportedAnimations(animations);
+		}
 
 		SGF::Log::Info("Loading model file: {} finished, took: {} milliseconds, time for Assimp Scene: {}", filename, importTime.currentMillis(), assimpLoadTime);
+		SetImportProgress(pProgress, 1.0f);
 		return pAttachmentNode;
 	}
+
+	ProgressiveModelImport::ProgressiveModelImport(const std::string& filename, uint32_t importFlags, ImportProgress* pProgress) : filename(filename), importFlags(importFlags), pProgress(pProgress) {}
+	ProgressiveModelImport::~ProgressiveModelImport() {
+		// Running jobs reference the scene of the importer
+		if (animations.valid()) {
+			ThreadPool::Get().Wait(animations);
+		}
+		if (cacheWrite.valid()) {
+			ThreadPool::Get().Wait(cacheWrite);
+		}
+		if (textureTable) {
+			std::vector<Texture> discarded;
+			textureTable->MoveTextures(discarded);
+		}
+	}
+
+	std::unique_ptr<GenericModel> ProgressiveModelImport::LoadGeometry() {
+		Timer importTime;
+		auto pModel = std::make_unique<GenericModel>();
+		if (LoadModelCache(*pModel, filename.c_str(), importFlags)) {
+			if (importFlags & MODEL_IMPORT_COMPRESS_ANIMATIONS) {
+				CompressImportedAnimations(pModel->animations);
+			}
+			SetImportProgress(pProgress, 1.0f);
+			return pModel;
+		}
+		importer = std::make_unique<Assimp::Importer>();
+		const aiScene* scene = ReadScene(*importer, filename.c_str(), pProgress, 0.7f);
+		if (scene == nullptr) {
+			return nullptr;
+		}
+		textureTable = std::make_unique<TextureLoadTable>(0);
+		LoadSceneGeometry(pModel.get(), scene, *textureTable, filename.c_str());
+		if (IsImportCancelled(pProgress)) {
+			SGF::Log::Info("Import of file: {} was cancelled", filename);
+			return nullptr;
+		}
+		SetImportProgress(pProgress, 0.9f);
+		LoadSkeletalBones(pModel.get(), scene);
+		if (importFlags & MODEL_IMPORT_OPTIMIZE_MESHES) {
+			OptimizeImportedMeshes(pModel.get());
+		}
+		if (importFlags & MODEL_IMPORT_GENERATE_LODS) {
+			GenerateImportedMeshLods(pModel.get());
+		}
+		if (importFlags & MODEL_IMPORT_BUILD_MESHLETS) {
+			BuildImportedMeshlets(pModel.get());
+		}
+		cacheModel = std::make_unique<GenericModel>(*pModel);
+
+		// The renderer gets a white placeholder for every texture slot until the decoded textures arrive
+		const uint8_t white[4] = { 255, 255, 255, 255 };
+		pModel->textures.reserve(textureTable->GetTextureCount());
+		for (uint32_t i = 0; i < textureTable->GetTextureCount(); ++i) {
+			pModel->textures.emplace_back(1, 1, white);
+		}
+		animations = ThreadPool::Get().Submit([bones = pModel->bones, scene, compress = (importFlags & MODEL_IMPORT_COMPRESS_ANIMATIONS) != 0]() {
+			StreamedAnimations loaded;
+			LoadSkeletalAnimations(bones, scene, loaded.animations);
+			loaded.cacheAnimations = loaded.animations;
+			if (compress) {
+				CompressImportedAnimations(loaded.animations);
+			}
+			return loaded;
+		});
+		SGF::Log::Info("Loading geometry of model file: {} finished, took: {} milliseconds", filename, importTime.currentMillis());
+		SetImportProgress(pProgress, 1.0f);
+		return pModel;
+	}
+
+	bool ProgressiveModelImport::IsStreamingFinished() const {
+		if (animations.valid() && animations.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		return textureTable == nullptr || textureTable->IsFinished();
+	}
+
+	float ProgressiveModelImport::GetStreamingProgress() const {
+		// The animations count as one job next to the textures
+		uint32_t totalCount = 1;
+		uint32_t finishedCount = (!animations.valid() || animations.wait_for(std::chrono::seconds(0)) == std::future_status::ready) ? 1 : 0;
+		if (textureTable) {
+			totalCount += textureTable->GetTextureCount();
+			finishedCount += textureTable->GetFinishedCount();
+		}
+		return (float)finishedCount / (float)totalCount;
+	}
+
+	void ProgressiveModelImport::ApplyStreamedData(GenericModel& model) {
+		assert(IsStreamingFinished());
+		if (textureTable) {
+			textureTable->MoveTextures(model.textures);
+			textureTable.reset();
+		}
+		StreamedAnimations loaded;
+		if (animations.valid()) {
+			loaded = animations.get();
+			model.animations = std::move(loaded.animations);
+		}
+		importer.reset();
+		if (!cacheModel) return;
+		// The copy gets textures of its own, the model may be removed while the cache is written
+		cacheModel->textures.clear();
+		cacheModel->textures.reserve(model.textures.size());
+		for (const auto& texture : model.textures) {
+			cacheModel->textures.emplace_back(texture);
+		}
+		cacheModel->animations = std::move(loaded.cacheAnimations);
+		cacheWrite = ThreadPool::Get().Submit([this]() {
+			SaveModelCache(*cacheModel, filename.c_str(), importFlags);
+			cacheModel.reset();
+		});
+	}
+
+	bool ProgressiveModelImport::HasRunningJobs() const {
+		if (!IsStreamingFinished()) return true;
+		return cacheWrite.valid() && cacheWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
 	void BuildNode(GenericModel* pModel, aiNode* pNode, GenericModel::Node& node) {
 		// Copy transformation matrix
 		glm::mat4 localTransform(1.f);
@@ -5,8 +5,32 @@
 #include "Render/Texture.hpp"
 
 #include <glm/gtc/quaternion.hpp>
+#include <future>
+#include <atomic>
+
+namespace Assimp {
+	class Importer;
+}
 
 namespace SGF {
+	// Shared between an importing thread and the thread observing it.
+	// The progress goes from 0 to 1, a cancelled import stops at the next stage and returns nullptr.
+	struct ImportProgress {
+		std::atomic<float> progress = 0.0f;
+		std::atomic<bool> isCancelled = false;
+	};
+
+	enum ModelImportFlagBits : uint32_t {
+		// Reorders triangles and vertices of every mesh for the vertex cache, overdraw and vertex fetch
+		MODEL_IMPORT_OPTIMIZE_MESHES = BIT(0),
+		// Builds simplified index ranges of every mesh for drawing it at a distance
+		MODEL_IMPORT_GENERATE_LODS = BIT(1),
+		// Splits every mesh into small clusters with bounds for per cluster culling
+		MODEL_IMPORT_BUILD_MESHLETS = BIT(2),
+		// Drops redundant animation keys within a tolerance and stores the rest quantized with shared key times
+		MODEL_IMPORT_COMPRESS_ANIMATIONS = BIT(3),
+	};
+
 	class GenericModel {
 	public:
 		struct Bone {
@@ -41,11 +65,47 @@ namespace SGF {
 			std::vector<KeyFrame> scaleKeys;
 		};
 
+		// Keys of a track in a compressed animation, a track without keys keeps the bind pose
+		struct CompressedTrack {
+			// First key time in times, tracks with the same key times share them
+			uint32_t timeOffset = 0;
+			uint32_t keyCount = 0;
+			// First key in values, every key is 3 uint16_t
+			uint32_t valueOffset = 0;
+		};
+
+		// Positions and scales are quantized to 16 bits per component inside the range of their track.
+		// Rotations are stored as smallest three: the largest component is dropped and rebuilt from the unit length.
+		struct CompressedChannel {
+			uint32_t boneIndex;
+			CompressedTrack positions;
+			CompressedTrack rotations;
+			CompressedTrack scales;
+			glm::vec3 positionMin;
+			glm::vec3 positionExtent;
+			glm::vec3 scaleMin;
+			glm::vec3 scaleExtent;
+		};
+
+		struct CompressedAnimation {
+			std::vector<float> times;
+			std::vector<uint16_t> values;
+			std::vector<CompressedChannel> channels;
+
+			inline size_t GetMemorySize() const { return times.size() * sizeof(float) + values.size() * sizeof(uint16_t) + channels.size() * sizeof(CompressedChannel); }
+		};
+
 		struct Animation {
 			std::string name;
 			float duration;
 			float ticksPerSecond;
+			// Empty once the animation is compressed
 			std::vector<AnimationChannel> channels;
+			CompressedAnimation compressed;
+
+			inline bool IsCompressed() const { return !compressed.channels.empty(); }
+			inline size_t GetChannelCount() const { return IsCompressed() ? compressed.channels.size() : channels.size(); }
+			inline uint32_t GetChannelBone(size_t index) const { return IsCompressed() ? compressed.channels[index].boneIndex : channels[index].boneIndex; }
 		};
 
 	public:
@@ -60,6 +120,8 @@ namespace SGF {
 			glm::mat4 globalTransform;
 			uint32_t parent;
 			uint32_t index;
+			// Incremented by TransformNode, lets caches of derived data detect moved nodes
+			uint32_t transformVersion = 0;
 			std::vector<uint32_t> children;
 			std::vector<uint32_t> meshes;
 			std::string name;
@@ -72,6 +134,36 @@ namespace SGF {
 			uint32_t vertexOffset;
 			uint32_t vertexCount;
 			uint32_t textureIndex;
+			// Simplified versions in meshLods, ordered from fine to coarse. The mesh itself is LOD 0.
+			uint32_t firstLod;
+			uint32_t lodCount;
+			// Clusters covering the index range of the mesh in order
+			uint32_t firstMeshlet;
+			uint32_t meshletCount;
+		};
+
+		// Index range drawn with the vertices of its mesh
+		struct MeshLod {
+			uint32_t indexOffset;
+			uint32_t indexCount;
+			// Largest distance to the surface of the full mesh in model space
+			float error;
+		};
+
+		// Meshlets are contiguous triangle ranges of a mesh with at most MAX_MESHLET_VERTICES vertices and MAX_MESHLET_TRIANGLES triangles.
+		// They are stored as separate arrays, the culling loops only touch the bounds.
+		struct Meshlets {
+			// Mesh space center and radius
+			std::vector<glm::vec4> boundingSpheres;
+			// Average normal and sine of the cone angle, a cluster facing away from the camera can be culled.
+			// A value of 1 or more means the normals are spread too far for culling.
+			std::vector<glm::vec4> normalCones;
+			std::vector<uint32_t> indexOffsets;
+			std::vector<uint8_t> triangleCounts;
+			std::vector<uint8_t> vertexCounts;
+
+			inline size_t GetCount() const { return indexOffsets.size(); }
+			inline void Clear() { boundingSpheres.clear(); normalCones.clear(); indexOffsets.clear(); triangleCounts.clear(); vertexCounts.clear(); }
 		};
 
 		struct Model {
@@ -84,6 +176,8 @@ namespace SGF {
 		std::vector<Texture> textures;
 		std::vector<Node> nodes;
 		std::vector<Mesh> meshes;
+		std::vector<MeshLod> meshLods;
+		Meshlets meshlets;
 
 		// Animation Data:
 		std::vector<Bone> bones;
@@ -105,6 +199,8 @@ namespace SGF {
 		inline Node& GetNode(size_t index) { return nodes[index]; }
 		inline const Node& GetNode(size_t index) const { return nodes[index]; }
 		inline const std::vector<Mesh>& GetMeshes() const { return meshes; }
+		inline const std::vector<MeshLod>& GetMeshLods() const { return meshLods; }
+		inline const Meshlets& GetMeshlets() const { return meshlets; }
 		inline size_t GetVertexCount() const { return vertices.size(); }
 		inline size_t GetIndexCount() const { return indices.size(); }
 		inline size_t GetTextureCount() const { return textures.size(); }
@@ -115,13 +211,14 @@ namespace SGF {
 		inline bool HasAnimations() const { return !animations.empty(); }
 		inline bool HasSkeletalAnimation() const { return !bones.empty() && !animations.empty(); }
 
-		const Node* ImportModel(const char* filename);
+		// A cancelled import leaves the model incomplete
+		const Node* ImportModel(const char* filename, uint32_t importFlags = 0, ImportProgress* pProgress = nullptr);
 		void RemoveModel(const char* name);
         const Node& Duplicate(const Node& node);
 		const Node& AddChild(const Node& node, const std::string& name, const glm::mat4& transform);
         void Remove(const Node& node);
 
-		inline void TransformNode(Node& node, const glm::mat4& deltaTransform) { node.globalTransform = deltaTransform * node.globalTransform; }
+		inline void TransformNode(Node& node, const glm::mat4& deltaTransform) { node.globalTransform = deltaTransform * node.globalTransform; node.transformVersion++; }
 		void TransformNodeRecursive(Node& node, const glm::mat4& deltaTransform);
 
 		std::vector<Node> GetChildren(const Node& node) const;
@@ -135,4 +232,45 @@ namespace SGF {
 		inline size_t GetChildCount(const Node& node) const { return node.children.size(); }
 	};
 
+	class TextureLoadTable;
+	// Imports a model in two stages: LoadGeometry returns a drawable model with nodes, meshes and skeleton
+	// while the textures and animations are still loading in the background.
+	// Until ApplyStreamedData is called the model holds a 1x1 white placeholder for every texture.
+	// Models found in the model cache are returned complete from LoadGeometry, others are written to it by a job ApplyStreamedData starts.
+	class ProgressiveModelImport {
+	public:
+		// The progress only covers LoadGeometry, use GetStreamingProgress for the textures and animations
+		ProgressiveModelImport(const std::string& filename, uint32_t importFlags = 0, ImportProgress* pProgress = nullptr);
+		~ProgressiveModelImport();
+		ProgressiveModelImport(const ProgressiveModelImport&) = delete;
+		ProgressiveModelImport& operator=(const ProgressiveModelImport&) = delete;
+
+		// Can be called from any thread, returns nullptr if the file can not be imported
+		std::unique_ptr<GenericModel> LoadGeometry();
+		// Returns true once all textures and animations are loaded
+		bool IsStreamingFinished() const;
+		float GetStreamingProgress() const;
+		// Moves the loaded textures and animations into the model and starts writing it to the model cache, requires IsStreamingFinished
+		void ApplyStreamedData(GenericModel& model);
+		// The import has to be kept alive until its streaming and cache jobs finished, the destructor waits for them
+		bool HasRunningJobs() const;
+		inline const std::string& GetFilename() const { return filename; }
+	private:
+		std::string filename;
+		uint32_t importFlags;
+		ImportProgress* pProgress;
+		std::unique_ptr<Assimp::Importer> importer;
+		std::unique_ptr<TextureLoadTable> textureTable;
+		struct StreamedAnimations {
+			std::vector<GenericModel::Animation> animations;
+			// Full precision keys for the model cache
+			std::vector<GenericModel::Animation> cacheAnimations;
+		};
+		std::future<StreamedAnimations> animations;
+		// Copy of the model as imported for the model cache, the nodes of the returned model may be moved while streaming.
+		// nullptr if the model was found in the cache.
+		std::unique_ptr<GenericModel> cacheModel;
+		std::future<void> cacheWrite;
+	};
+
 }
\ No newline at end of file
@@ -0,0 +1,616 @@
+#include "ModelBVH.hpp"
+#include "Threading/ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace SGF {
+	namespace {
+		constexpr uint32_t SAH_BIN_COUNT = 16;
+		constexpr uint32_t MAX_TRAVERSAL_DEPTH = 128;
+		// From this depth on nodes are split at the object median. Halving a range of at most 2^32 primitives
+		// adds at most 32 levels, so the tree fits the traversal stacks for any input.
+		constexpr uint32_t MEDIAN_SPLIT_DEPTH = MAX_TRAVERSAL_DEPTH - 32;
+		constexpr size_t REFIT_BATCH_SIZE = 4096;
+
+		inline float GetSurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+			glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.f));
+			return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+
+		struct Bin {
+			glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+			uint32_t count = 0;
+			inline void Add(const BVHBuildPrimitive& primitive) {
+				boundsMin = glm::min(boundsMin, primitive.boundsMin);
+				boundsMax = glm::max(boundsMax, primitive.boundsMax);
+				count++;
+			}
+			inline void Add(const Bin& other) {
+				boundsMin = glm::min(boundsMin, other.boundsMin);
+				boundsMax = glm::max(boundsMax, other.boundsMax);
+				count += other.count;
+			}
+		};
+
+		struct TraversalEntry {
+			uint32_t nodeIndex;
+			float t;
+		};
+
+		// Calls intersectLeaf(firstIndex, count, t) for all leaves the ray enters closer than t, which intersectLeaf may shrink
+		template<typename Func>
+		inline void TraverseBVH(const std::vector<BVHNode>& nodes, const BVHRay& ray, float& t, Func intersectLeaf) {
+			if (nodes.empty() || IntersectBVHBounds(ray, nodes[0].boundsMin, nodes[0].boundsMax, t) < 0.f) return;
+			TraversalEntry stack[MAX_TRAVERSAL_DEPTH];
+			uint32_t stackSize = 0;
+			uint32_t nodeIndex = 0;
+			while (true) {
+				const BVHNode& node = nodes[nodeIndex];
+				if (node.IsLeaf()) {
+					intersectLeaf(node.firstIndex, node.primitiveCount, t);
+				} else {
+					const BVHNode& left = nodes[node.firstIndex];
+					const BVHNode& right = nodes[node.firstIndex + 1];
+					float tLeft = IntersectBVHBounds(ray, left.boundsMin, left.boundsMax, t);
+					float tRight = IntersectBVHBounds(ray, right.boundsMin, right.boundsMax, t);
+					uint32_t nearIndex = node.firstIndex, farIndex = node.firstIndex + 1;
+					if (tRight >= 0.f && (tLeft < 0.f || tRight < tLeft)) {
+						std::swap(tLeft, tRight);
+						std::swap(nearIndex, farIndex);
+					}
+					if (tLeft >= 0.f) {
+						if (tRight >= 0.f) {
+							assert(stackSize < MAX_TRAVERSAL_DEPTH);
+							stack[stackSize++] = { farIndex, tRight };
+						}
+						nodeIndex = nearIndex;
+						continue;
+					}
+				}
+				// Skip nodes that are further away than the closest hit found since they were pushed
+				while (stackSize != 0 && stack[stackSize - 1].t > t) {
+					stackSize--;
+				}
+				if (stackSize == 0) break;
+				nodeIndex = stack[--stackSize].nodeIndex;
+			}
+		}
+
+		inline float GetDistanceSquaredToBounds(const glm::vec3& point, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+			glm::vec3 offset = glm::max(glm::max(boundsMin - point, point - boundsMax), glm::vec3(0.f));
+			return glm::dot(offset, offset);
+		}
+
+		// Same traversal as TraverseBVH, ordered by the squared distance of the bounds to point times boundsScaleSquared.
+		// Calls visitLeaf(firstIndex, count, distanceSquared) for all leaves closer than distanceSquared, which visitLeaf may shrink.
+		template<typename Func>
+		inline void TraverseBVHByDistance(const std::vector<BVHNode>& nodes, const glm::vec3& point, float boundsScaleSquared, float& distanceSquared, Func visitLeaf) {
+			if (nodes.empty() || GetDistanceSquaredToBounds(point, nodes[0].boundsMin, nodes[0].boundsMax) * boundsScaleSquared > distanceSquared) return;
+			TraversalEntry stack[MAX_TRAVERSAL_DEPTH];
+			uint32_t stackSize = 0;
+			uint32_t nodeIndex = 0;
+			while (true) {
+				const BVHNode& node = nodes[nodeIndex];
+				if (node.IsLeaf()) {
+					visitLeaf(node.firstIndex, node.primitiveCount, distanceSquared);
+				} else {
+					const BVHNode& left = nodes[node.firstIndex];
+					const BVHNode& right = nodes[node.firstIndex + 1];
+					float dLeft = GetDistanceSquaredToBounds(point, left.boundsMin, left.boundsMax) * boundsScaleSquared;
+					float dRight = GetDistanceSquaredToBounds(point, right.boundsMin, right.boundsMax) * boundsScaleSquared;
+					uint32_t nearIndex = node.firstIndex, farIndex = node.firstIndex + 1;
+					if (dRight < dLeft) {
+						std::swap(dLeft, dRight);
+						std::swap(nearIndex, farIndex);
+					}
+					if (dLeft <= distanceSquared) {
+						if (dRight <= distanceSquared) {
+							assert(stackSize < MAX_TRAVERSAL_DEPTH);
+							stack[stackSize++] = { farIndex, dRight };
+						}
+						nodeIndex = nearIndex;
+						continue;
+					}
+				}
+				while (stackSize != 0 && stack[stackSize - 1].t > distanceSquared) {
+					stackSize--;
+				}
+				if (stackSize == 0) break;
+				nodeIndex = stack[--stackSize].nodeIndex;
+			}
+		}
+
+		// Calls visitLeaf(firstIndex, count) for all leaves whose bounds pass overlaps(boundsMin, boundsMax)
+		template<typename Overlaps, typename Func>
+		inline void ForEachOverlappingLeaf(const std::vector<BVHNode>& nodes, Overlaps overlaps, Func visitLeaf) {
+			if (nodes.empty()) return;
+			uint32_t stack[MAX_TRAVERSAL_DEPTH + 1];
+			uint32_t stackSize = 0;
+			stack[stackSize++] = 0;
+			while (stackSize != 0) {
+				const BVHNode& node = nodes[stack[--stackSize]];
+				if (!overlaps(node.boundsMin, node.boundsMax)) continue;
+				if (node.IsLeaf()) {
+					visitLeaf(node.firstIndex, node.primitiveCount);
+				} else {
+					assert(stackSize + 2 <= MAX_TRAVERSAL_DEPTH + 1);
+					stack[stackSize++] = node.firstIndex + 1;
+					stack[stackSize++] = node.firstIndex;
+				}
+			}
+		}
+
+		// Real-Time Collision Detection, Ericson, 5.1.5: closest point by the Voronoi region of the triangle containing p
+		glm::vec3 GetClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+			glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+			float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+			if (d1 <= 0.f && d2 <= 0.f) return a;
+			glm::vec3 bp = p - b;
+			float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+			if (d3 >= 0.f && d4 <= d3) return b;
+			float vc = d1 * d4 - d3 * d2;
+			if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) return a + ab * (d1 / (d1 - d3));
+			glm::vec3 cp = p - c;
+			float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+			if (d6 >= 0.f && d5 <= d6) return c;
+			float vb = d5 * d2 - d1 * d6;
+			if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) return a + ac * (d2 / (d2 - d6));
+			float va = d3 * d6 - d5 * d4;
+			if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+			float denom = 1.f / (va + vb + vc);
+			return a + ab * (vb * denom) + ac * (vc * denom);
+		}
+	}
+
+	float IntersectBVHBounds(const BVHRay& ray, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxT) {
+		glm::vec3 tMin = (boundsMin - ray.origin) * ray.invDirection;
+		glm::vec3 tMax = (boundsMax - ray.origin) * ray.invDirection;
+		glm::vec3 t1 = glm::min(tMin, tMax);
+		glm::vec3 t2 = glm::max(tMin, tMax);
+		float tNear = std::max(std::max(t1.x, t1.y), std::max(t1.z, 0.f));
+		float tFar = std::min(std::min(t2.x, t2.y), std::min(t2.z, maxT));
+		return tNear <= tFar ? tNear : -1.f;
+	}
+
+	void BuildBVH(const std::vector<BVHBuildPrimitive>& primitives, uint32_t maxLeafSize, std::vector<BVHNode>& nodes, std::vector<uint32_t>& primitiveOrder) {
+		const uint32_t primitiveCount = (uint32_t)primitives.size();
+		nodes.clear();
+		primitiveOrder.resize(primitiveCount);
+		if (primitiveCount == 0) return;
+
+		// The primitives are partitioned in place, so every node works on a contiguous range
+		struct BuildItem {
+			BVHBuildPrimitive bounds;
+			glm::vec3 centroid;
+			uint32_t index;
+		};
+		std::vector<BuildItem> items(primitiveCount);
+		for (uint32_t i = 0; i < primitiveCount; ++i) {
+			items[i].bounds = primitives[i];
+			items[i].centroid = (primitives[i].boundsMin + primitives[i].boundsMax) * 0.5f;
+			items[i].index = i;
+		}
+		// A binary tree with one primitive per leaf has 2n - 1 nodes, so the node references stay valid
+		nodes.reserve(2 * (size_t)primitiveCount - 1);
+		nodes.push_back({ glm::vec3(0.f), 0, glm::vec3(0.f), primitiveCount });
+		struct PendingNode {
+			uint32_t index;
+			uint32_t depth;
+		};
+		std::vector<PendingNode> pendingNodes = { { 0, 0 } };
+		while (!pendingNodes.empty()) {
+			const PendingNode pending = pendingNodes.back();
+			BVHNode& node = nodes[pending.index];
+			pendingNodes.pop_back();
+			const uint32_t first = node.firstIndex;
+			const uint32_t count = node.primitiveCount;
+			BuildItem* pItems = items.data() + first;
+
+			Bin nodeBounds;
+			glm::vec3 centroidMin(std::numeric_limits<float>::max());
+			glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+			for (uint32_t i = 0; i < count; ++i) {
+				nodeBounds.Add(pItems[i].bounds);
+				centroidMin = glm::min(centroidMin, pItems[i].centroid);
+				centroidMax = glm::max(centroidMax, pItems[i].centroid);
+			}
+			node.boundsMin = nodeBounds.boundsMin;
+			node.boundsMax = nodeBounds.boundsMax;
+			if (count <= maxLeafSize) continue;
+
+			// Find the cheapest split plane between the bins of every axis
+			Bin bins[3][SAH_BIN_COUNT];
+			glm::vec3 centroidExtent = centroidMax - centroidMin;
+			glm::vec3 binScale;
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				binScale[axis] = centroidExtent[axis] > 0.f ? (float)SAH_BIN_COUNT / centroidExtent[axis] : 0.f;
+			}
+			for (uint32_t i = 0; i < count; ++i) {
+				glm::vec3 binPosition = (pItems[i].centroid - centroidMin) * binScale;
+				for (uint32_t axis = 0; axis < 3; ++axis) {
+					bins[axis][std::min((uint32_t)binPosition[axis], SAH_BIN_COUNT - 1)].Add(pItems[i].bounds);
+				}
+			}
+			float bestCost = std::numeric_limits<float>::max();
+			uint32_t bestAxis = 0;
+			uint32_t bestSplit = 0;
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				if (centroidExtent[axis] <= 0.f) continue;
+				float leftCosts[SAH_BIN_COUNT - 1];
+				Bin left;
+				for (uint32_t split = 0; split < SAH_BIN_COUNT - 1; ++split) {
+					left.Add(bins[axis][split]);
+					leftCosts[split] = left.count * GetSurfaceArea(left.boundsMin, left.boundsMax);
+				}
+				Bin right;
+				for (uint32_t split = SAH_BIN_COUNT - 1; split > 0; --split) {
+					right.Add(bins[axis][split]);
+					if (right.count == 0 || right.count == count) continue;
+					float cost = leftCosts[split - 1] + right.count * GetSurfaceArea(right.boundsMin, right.boundsMax);
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = split;
+					}
+				}
+			}
+
+			uint32_t middle;
+			if (pending.depth >= MEDIAN_SPLIT_DEPTH) {
+				// Degenerate input like many coincident or collinear triangles can make the SAH split off a few primitives per level
+				const uint32_t axis = centroidExtent.x >= centroidExtent.y && centroidExtent.x >= centroidExtent.z ? 0 : (centroidExtent.y >= centroidExtent.z ? 1 : 2);
+				middle = count / 2;
+				std::nth_element(pItems, pItems + middle, pItems + count, [axis](const BuildItem& a, const BuildItem& b) {
+					return a.centroid[axis] < b.centroid[axis];
+				});
+			} else if (bestCost == std::numeric_limits<float>::max()) {
+				// All centroids are in the same place
+				middle = count / 2;
+			} else {
+				BuildItem* pMiddle = std::partition(pItems, pItems + count, [&](const BuildItem& item) {
+					return std::min((uint32_t)((item.centroid[bestAxis] - centroidMin[bestAxis]) * binScale[bestAxis]), SAH_BIN_COUNT - 1) < bestSplit;
+				});
+				middle = (uint32_t)(pMiddle - pItems);
+			}
+
+			uint32_t leftIndex = (uint32_t)nodes.size();
+			node.firstIndex = leftIndex;
+			node.primitiveCount = 0;
+			nodes.push_back({ glm::vec3(0.f), first, glm::vec3(0.f), middle });
+			nodes.push_back({ glm::vec3(0.f), first + middle, glm::vec3(0.f), count - middle });
+			pendingNodes.push_back({ leftIndex, pending.depth + 1 });
+			pendingNodes.push_back({ leftIndex + 1, pending.depth + 1 });
+		}
+		for (uint32_t i = 0; i < primitiveCount; ++i) {
+			primitiveOrder[i] = items[i].index;
+		}
+	}
+
+	void MeshBVH::Build(const GenericModel& model, const GenericModel::Mesh& mesh) {
+		triangleCount = mesh.indexCount / 3;
+		packetWidth = GetTrianglePacketWidth();
+		const uint32_t* pIndices = model.indices.data() + mesh.indexOffset;
+		const GenericModel::Vertex* pVertices = model.vertices.data() + mesh.vertexOffset;
+		std::vector<BVHBuildPrimitive> primitives(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; ++i) {
+			const glm::vec3& v0 = pVertices[pIndices[i * 3 + 0]].position;
+			const glm::vec3& v1 = pVertices[pIndices[i * 3 + 1]].position;
+			const glm::vec3& v2 = pVertices[pIndices[i * 3 + 2]].position;
+			primitives[i].boundsMin = glm::min(v0, glm::min(v1, v2));
+			primitives[i].boundsMax = glm::max(v0, glm::max(v1, v2));
+		}
+		std::vector<uint32_t> triangleOrder;
+		BuildBVH(primitives, packetWidth, nodes, triangleOrder);
+
+		// Repack the leaf ranges into padded packets
+		uint32_t leafCount = 0;
+		for (const auto& node : nodes) {
+			if (node.IsLeaf()) leafCount++;
+		}
+		const size_t packetSize = (size_t)TRIANGLE_PACKET_ROWS * packetWidth;
+		packets.assign(leafCount * packetSize, 0.f);
+		triangleIndices.assign((size_t)leafCount * packetWidth, UINT32_MAX);
+		uint32_t packetIndex = 0;
+		for (auto& node : nodes) {
+			if (!node.IsLeaf()) continue;
+			float* pPacket = packets.data() + packetIndex * packetSize;
+			for (uint32_t lane = 0; lane < node.primitiveCount; ++lane) {
+				uint32_t triangle = triangleOrder[node.firstIndex + lane];
+				WriteTrianglePacketLane(pPacket, packetWidth, lane, pVertices[pIndices[triangle * 3]].position,
+					pVertices[pIndices[triangle * 3 + 1]].position, pVertices[pIndices[triangle * 3 + 2]].position);
+				triangleIndices[packetIndex * packetWidth + lane] = triangle;
+			}
+			node.firstIndex = packetIndex++;
+		}
+	}
+
+	void MeshBVH::Refit(const GenericModel& model, const GenericModel::Mesh& mesh, const glm::vec3* pPositions) {
+		const uint32_t* pIndices = model.indices.data() + mesh.indexOffset;
+		const glm::vec3* pVertices = pPositions + mesh.vertexOffset;
+		const size_t packetSize = (size_t)TRIANGLE_PACKET_ROWS * packetWidth;
+		// The leaves are independent, large meshes are split over the thread pool
+		ThreadPool::Get().ParallelFor(nodes.size(), [&](size_t i) {
+			BVHNode& node = nodes[i];
+			if (!node.IsLeaf()) return;
+			float* pPacket = packets.data() + node.firstIndex * packetSize;
+			node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			node.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+			for (uint32_t lane = 0; lane < node.primitiveCount; ++lane) {
+				uint32_t triangle = triangleIndices[node.firstIndex * packetWidth + lane];
+				const glm::vec3& v0 = pVertices[pIndices[triangle * 3]];
+				const glm::vec3& v1 = pVertices[pIndices[triangle * 3 + 1]];
+				const glm::vec3& v2 = pVertices[pIndices[triangle * 3 + 2]];
+				WriteTrianglePacketLane(pPacket, packetWidth, lane, v0, v1, v2);
+				node.boundsMin = glm::min(node.boundsMin, glm::min(v0, glm::min(v1, v2)));
+				node.boundsMax = glm::max(node.boundsMax, glm::max(v0, glm::max(v1, v2)));
+			}
+		}, REFIT_BATCH_SIZE);
+		// Children are always stored after their parent, so a reverse pass sees them first
+		for (size_t i = nodes.size(); i-- > 0;) {
+			BVHNode& node = nodes[i];
+			if (node.IsLeaf()) continue;
+			const BVHNode& left = nodes[node.firstIndex];
+			const BVHNode& right = nodes[node.firstIndex + 1];
+			node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+			node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+		}
+	}
+
+	bool MeshBVH::Intersect(const BVHRay& ray, float& t, uint32_t& triangleIndex, glm::vec3& normal) const {
+		const size_t packetSize = (size_t)TRIANGLE_PACKET_ROWS * packetWidth;
+		uint32_t hitPacket = UINT32_MAX;
+		int hitLane = -1;
+		TraverseBVH(nodes, ray, t, [&](uint32_t packetIndex, uint32_t count, float& closestT) {
+			int lane = IntersectTrianglePacket(packets.data() + packetIndex * packetSize, ray.origin, ray.direction, closestT);
+			if (lane >= 0) {
+				hitPacket = packetIndex;
+				hitLane = lane;
+			}
+		});
+		if (hitLane < 0) return false;
+		triangleIndex = triangleIndices[hitPacket * packetWidth + hitLane];
+		normal = GetTrianglePacketNormal(packets.data() + hitPacket * packetSize, packetWidth, hitLane);
+		return true;
+	}
+
+	bool MeshBVH::IntersectAny(const BVHRay& ray, float maxT) const {
+		const size_t packetSize = (size_t)TRIANGLE_PACKET_ROWS * packetWidth;
+		bool isHit = false;
+		float t = maxT;
+		TraverseBVH(nodes, ray, t, [&](uint32_t packetIndex, uint32_t count, float& closestT) {
+			if (isHit) return;
+			float packetT = closestT;
+			if (IntersectTrianglePacket(packets.data() + packetIndex * packetSize, ray.origin, ray.direction, packetT) >= 0) {
+				isHit = true;
+				// Every pending node is further away than a negative distance, so the traversal ends
+				closestT = -1.f;
+			}
+		});
+		return isHit;
+	}
+
+	bool MeshBVH::FindClosestPoint(const glm::vec3& worldPoint, const glm::vec3& meshPoint, const glm::mat4& transform, float minScale,
+		float& distanceSquared, uint32_t& triangleIndex, glm::vec3& closestPoint, glm::vec3& normal) const {
+		const size_t packetSize = (size_t)TRIANGLE_PACKET_ROWS * packetWidth;
+		const glm::mat3 linearTransform(transform);
+		bool isFound = false;
+		TraverseBVHByDistance(nodes, meshPoint, minScale * minScale, distanceSquared, [&](uint32_t packetIndex, uint32_t count, float& closestDistanceSquared) {
+			const float* pPacket = packets.data() + packetIndex * packetSize;
+			for (uint32_t lane = 0; lane < count; ++lane) {
+				// Closest points are not preserved by non uniform scaling, so the triangle is measured in world space
+				glm::vec3 v0 = glm::vec3(transform * glm::vec4(pPacket[lane], pPacket[packetWidth + lane], pPacket[2 * packetWidth + lane], 1.f));
+				glm::vec3 edge1 = linearTransform * glm::vec3(pPacket[3 * packetWidth + lane], pPacket[4 * packetWidth + lane], pPacket[5 * packetWidth + lane]);
+				glm::vec3 edge2 = linearTransform * glm::vec3(pPacket[6 * packetWidth + lane], pPacket[7 * packetWidth + lane], pPacket[8 * packetWidth + lane]);
+				glm::vec3 point = GetClosestPointOnTriangle(worldPoint, v0, v0 + edge1, v0 + edge2);
+				float pointDistanceSquared = glm::dot(point - worldPoint, point - worldPoint);
+				if (pointDistanceSquared <= closestDistanceSquared) {
+					closestDistanceSquared = pointDistanceSquared;
+					triangleIndex = triangleIndices[packetIndex * packetWidth + lane];
+					closestPoint = point;
+					normal = glm::cross(edge1, edge2);
+					isFound = true;
+				}
+			}
+		});
+		return isFound;
+	}
+
+	void GetOverlappingNodes(const std::vector<InstanceOverlap>& overlaps, std::vector<uint32_t>& outNodeIndices) {
+		outNodeIndices.clear();
+		outNodeIndices.reserve(overlaps.size());
+		for (const auto& overlap : overlaps) {
+			outNodeIndices.push_back(overlap.nodeIndex);
+		}
+		std::sort(outNodeIndices.begin(), outNodeIndices.end());
+		outNodeIndices.erase(std::unique(outNodeIndices.begin(), outNodeIndices.end()), outNodeIndices.end());
+	}
+
+	void ModelBVH::Build(const GenericModel& model) {
+		meshBVHs.clear();
+		meshBVHs.resize(model.meshes.size());
+		ThreadPool::Get().ParallelFor(model.meshes.size(), [&](size_t meshIndex) {
+			meshBVHs[meshIndex].Build(model, model.meshes[meshIndex]);
+		}, 1);
+		isBuilt = true;
+		transformCache.Clear();
+		UpdateInstances(model);
+	}
+
+	void ModelBVH::UpdateInstances(const GenericModel& model) {
+		assert(isBuilt);
+		if (!transformCache.Update(model) && !instances.empty()) return;
+		BuildInstances(model);
+	}
+
+	void ModelBVH::Refit(const GenericModel& model, const std::vector<glm::vec3>& positions) {
+		assert(isBuilt && positions.size() == model.vertices.size());
+		ThreadPool::Get().ParallelFor(model.meshes.size(), [&](size_t meshIndex) {
+			meshBVHs[meshIndex].Refit(model, model.meshes[meshIndex], positions.data());
+		}, 1);
+		// The instance bounds depend on the mesh bounds
+		transformCache.Update(model);
+		BuildInstances(model);
+	}
+
+	void ModelBVH::BuildInstances(const GenericModel& model) {
+		std::vector<Instance> newInstances;
+		std::vector<BVHBuildPrimitive> primitives;
+		for (const auto& node : model.nodes) {
+			if (node.meshes.empty()) continue;
+			const glm::mat4& inverseTransform = transformCache.GetInverseTransform(node.index);
+			// The spectral norm of the inverse is at most its Frobenius norm
+			const glm::mat3 inverseLinear(inverseTransform);
+			const float minScale = 1.f / std::sqrt(glm::dot(inverseLinear[0], inverseLinear[0]) + glm::dot(inverseLinear[1], inverseLinear[1]) + glm::dot(inverseLinear[2], inverseLinear[2]));
+			for (uint32_t meshIndex : node.meshes) {
+				const MeshBVH& meshBVH = meshBVHs[meshIndex];
+				if (meshBVH.IsEmpty()) continue;
+				const BVHNode& root = meshBVH.GetRoot();
+				BVHBuildPrimitive primitive;
+				primitive.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+				primitive.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+				for (uint32_t corner = 0; corner < 8; ++corner) {
+					glm::vec3 p((corner & 1) ? root.boundsMax.x : root.boundsMin.x, (corner & 2) ? root.boundsMax.y : root.boundsMin.y, (corner & 4) ? root.boundsMax.z : root.boundsMin.z);
+					p = glm::vec3(node.globalTransform * glm::vec4(p, 1.f));
+					primitive.boundsMin = glm::min(primitive.boundsMin, p);
+					primitive.boundsMax = glm::max(primitive.boundsMax, p);
+				}
+				primitives.push_back(primitive);
+				newInstances.push_back({ inverseTransform, node.globalTransform, primitive.boundsMin, minScale, primitive.boundsMax, node.index, meshIndex });
+			}
+		}
+		std::vector<uint32_t> order;
+		BuildBVH(primitives, MAX_LEAF_INSTANCES, instanceNodes, order);
+		instances.resize(order.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			instances[i] = newInstances[order[i]];
+		}
+	}
+
+	bool ModelBVH::Intersect(const Ray& ray, HitInfo& outHit) const {
+		assert(isBuilt);
+		const BVHRay worldRay(ray.GetOrigin(), ray.GetDirection());
+		float t = outHit.t;
+		const Instance* pHitInstance = nullptr;
+		uint32_t hitTriangle = 0;
+		glm::vec3 hitNormal;
+		TraverseBVH(instanceNodes, worldRay, t, [&](uint32_t first, uint32_t count, float& closestT) {
+			for (uint32_t i = first; i < first + count; ++i) {
+				const Instance& instance = instances[i];
+				const BVHRay meshRay(glm::vec3(instance.inverseTransform * glm::vec4(worldRay.origin, 1.f)), glm::vec3(instance.inverseTransform * glm::vec4(worldRay.direction, 0.f)));
+				if (meshBVHs[instance.meshIndex].Intersect(meshRay, closestT, hitTriangle, hitNormal)) {
+					pHitInstance = &instance;
+				}
+			}
+		});
+		if (pHitInstance == nullptr) return false;
+		glm::mat3 inverseTransform(pHitInstance->inverseTransform);
+		// The cross product of transformed edges flips with mirroring transforms, like the normal of GetMeshIntersection
+		glm::vec3 normal = glm::transpose(inverseTransform) * hitNormal;
+		if (glm::dot(glm::cross(inverseTransform[0], inverseTransform[1]), inverseTransform[2]) < 0.f) normal = -normal;
+		outHit.t = t;
+		outHit.position = ray.GetPoint(t);
+		outHit.normal = glm::normalize(normal);
+		outHit.triangleIndex = hitTriangle;
+		outHit.meshIndex = pHitInstance->meshIndex;
+		outHit.nodeIndex = pHitInstance->nodeIndex;
+		return true;
+	}
+
+	bool ModelBVH::IsOccluded(const Ray& ray, float maxT) const {
+		assert(isBuilt);
+		const BVHRay worldRay(ray.GetOrigin(), ray.GetDirection());
+		bool isOccluded = false;
+		float t = maxT;
+		TraverseBVH(instanceNodes, worldRay, t, [&](uint32_t first, uint32_t count, float& closestT) {
+			for (uint32_t i = first; i < first + count && !isOccluded; ++i) {
+				const Instance& instance = instances[i];
+				const BVHRay meshRay(glm::vec3(instance.inverseTransform * glm::vec4(worldRay.origin, 1.f)), glm::vec3(instance.inverseTransform * glm::vec4(worldRay.direction, 0.f)));
+				isOccluded = meshBVHs[instance.meshIndex].IntersectAny(meshRay, maxT);
+			}
+			if (isOccluded) closestT = -1.f;
+		});
+		return isOccluded;
+	}
+
+	void ModelBVH::IntersectRays(const Ray* pRays, size_t rayCount, HitInfo* pHits) const {
+		ThreadPool::Get().ParallelFor(rayCount, [&](size_t i) {
+			Intersect(pRays[i], pHits[i]);
+		}, RAY_BATCH_SIZE);
+	}
+
+	void ModelBVH::TestOcclusion(const Ray* pRays, const float* pMaxT, size_t rayCount, bool* pOccluded) const {
+		ThreadPool::Get().ParallelFor(rayCount, [&](size_t i) {
+			pOccluded[i] = IsOccluded(pRays[i], pMaxT[i]);
+		}, RAY_BATCH_SIZE);
+	}
+
+	void IntersectRays(const ModelBVH* pModels, size_t modelCount, const Ray* pRays, size_t rayCount, HitInfo* pHits, uint32_t* pModelIndices) {
+		ThreadPool::Get().ParallelFor(rayCount, [&](size_t i) {
+			pModelIndices[i] = UINT32_MAX;
+			for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex) {
+				if (pModels[modelIndex].IsBuilt() && pModels[modelIndex].Intersect(pRays[i], pHits[i])) {
+					pModelIndices[i] = (uint32_t)modelIndex;
+				}
+			}
+		}, ModelBVH::RAY_BATCH_SIZE);
+	}
+
+	bool ModelBVH::FindClosestPoint(const glm::vec3& point, HitInfo& outHit) const {
+		assert(isBuilt);
+		const bool hasLimit = outHit.t != std::numeric_limits<float>::max();
+		float distanceSquared = hasLimit ? outHit.t * outHit.t : std::numeric_limits<float>::max();
+		const Instance* pClosestInstance = nullptr;
+		uint32_t closestTriangle = 0;
+		glm::vec3 closestPoint, closestNormal;
+		TraverseBVHByDistance(instanceNodes, point, 1.f, distanceSquared, [&](uint32_t first, uint32_t count, float& closestDistanceSquared) {
+			for (uint32_t i = first; i < first + count; ++i) {
+				const Instance& instance = instances[i];
+				const glm::vec3 meshPoint = glm::vec3(instance.inverseTransform * glm::vec4(point, 1.f));
+				if (meshBVHs[instance.meshIndex].FindClosestPoint(point, meshPoint, instance.transform, instance.minScale, closestDistanceSquared, closestTriangle, closestPoint, closestNormal)) {
+					pClosestInstance = &instance;
+				}
+			}
+		});
+		if (pClosestInstance == nullptr) return false;
+		outHit.t = std::sqrt(distanceSquared);
+		outHit.position = closestPoint;
+		outHit.normal = glm::normalize(closestNormal);
+		outHit.triangleIndex = closestTriangle;
+		outHit.meshIndex = pClosestInstance->meshIndex;
+		outHit.nodeIndex = pClosestInstance->nodeIndex;
+		return true;
+	}
+
+	template<typename Func>
+	void ModelBVH::QueryOverlaps(Func overlaps, std::vector<InstanceOverlap>& outOverlaps) const {
+		assert(isBuilt);
+		ForEachOverlappingLeaf(instanceNodes, overlaps, [&](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; ++i) {
+				const Instance& instance = instances[i];
+				if (overlaps(instance.boundsMin, instance.boundsMax)) {
+					outOverlaps.push_back({ instance.nodeIndex, instance.meshIndex });
+				}
+			}
+		});
+	}
+
+	void ModelBVH::QuerySphere(const glm::vec3& center, float radius, std::vector<InstanceOverlap>& outOverlaps) const {
+		QueryOverlaps([&](const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+			return GetDistanceSquaredToBounds(center, boundsMin, boundsMax) <= radius * radius;
+		}, outOverlaps);
+	}
+
+	void ModelBVH::QueryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<InstanceOverlap>& outOverlaps) const {
+		QueryOverlaps([&](const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+			return boundsMin.x <= boxMax.x && boundsMin.y <= boxMax.y && boundsMin.z <= boxMax.z &&
+				boxMin.x <= boundsMax.x && boxMin.y <= boundsMax.y && boxMin.z <= boundsMax.z;
+		}, outOverlaps);
+	}
+
+	void ModelBVH::QueryFrustum(const Frustum& frustum, std::vector<InstanceOverlap>& outOverlaps) const {
+		QueryOverlaps([&](const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+			return frustum.IsBoxVisible(boundsMin, boundsMax);
+		}, outOverlaps);
+	}
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+#include "ModelSelectionCPU.hpp"
+#include "TrianglePacket.hpp"
+#include "NodeTransformCache.hpp"
+#include "Geometry/Frustum.hpp"
+
+namespace SGF {
+	// 32 byte node, the two children of an inner node are stored next to each other
+	struct BVHNode {
+		glm::vec3 boundsMin;
+		// First child for inner nodes, first primitive for leaves
+		uint32_t firstIndex;
+		glm::vec3 boundsMax;
+		// 0 for inner nodes
+		uint32_t primitiveCount;
+
+		inline bool IsLeaf() const { return primitiveCount != 0; }
+	};
+
+	struct BVHBuildPrimitive {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	// Builds a BVH with the surface area heuristic over binned centroids.
+	// primitiveOrder receives the primitive indices in leaf order, leaves reference ranges of it.
+	void BuildBVH(const std::vector<BVHBuildPrimitive>& primitives, uint32_t maxLeafSize, std::vector<BVHNode>& nodes, std::vector<uint32_t>& primitiveOrder);
+
+	// Ray in the space of a BVH. The direction is not normalized, so the ray parameter t stays the same
+	// when the ray gets transformed into the space of an instance.
+	struct BVHRay {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 invDirection;
+
+		inline BVHRay(const glm::vec3& origin, const glm::vec3& direction) : origin(origin), direction(direction),
+			invDirection(1.f / (direction + glm::vec3(std::numeric_limits<float>::min()))) {}
+	};
+	// Returns the entry distance or a negative value if the box is missed or further away than maxT
+	float IntersectBVHBounds(const BVHRay& ray, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxT);
+
+	// Triangle BVH of a single mesh in mesh space, shared by all nodes that reference the mesh.
+	// Every leaf holds one triangle packet, so a leaf is tested with a single call of the SIMD kernel.
+	class MeshBVH {
+	public:
+		void Build(const GenericModel& model, const GenericModel::Mesh& mesh);
+		// Moves the triangles to new vertex positions of the whole model and recomputes the bounds bottom up without
+		// changing the tree. Much faster than a rebuild, but the tree gets worse the further the vertices moved.
+		void Refit(const GenericModel& model, const GenericModel::Mesh& mesh, const glm::vec3* pPositions);
+		// Finds the closest hit closer than t, t and triangleIndex are only written on a hit.
+		// The normal is the unnormalized geometric normal in mesh space.
+		bool Intersect(const BVHRay& ray, float& t, uint32_t& triangleIndex, glm::vec3& normal) const;
+		// Stops at the first hit closer than maxT
+		bool IntersectAny(const BVHRay& ray, float maxT) const;
+		// Closest point to worldPoint on the mesh transformed by transform, only closer than sqrt(distanceSquared).
+		// meshPoint is worldPoint in mesh space and minScale a lower bound of how much transform shrinks distances.
+		bool FindClosestPoint(const glm::vec3& worldPoint, const glm::vec3& meshPoint, const glm::mat4& transform, float minScale,
+			float& distanceSquared, uint32_t& triangleIndex, glm::vec3& closestPoint, glm::vec3& normal) const;
+
+		inline bool IsEmpty() const { return nodes.empty(); }
+		inline const BVHNode& GetRoot() const { return nodes[0]; }
+		inline size_t GetNodeCount() const { return nodes.size(); }
+		inline size_t GetTriangleCount() const { return triangleCount; }
+		inline uint32_t GetPacketWidth() const { return packetWidth; }
+	private:
+		std::vector<BVHNode> nodes;
+		// One SoA triangle packet per leaf, the firstIndex of a leaf is its packet index
+		std::vector<float> packets;
+		// Triangle index in the mesh for every packet lane, UINT32_MAX for unused lanes
+		std::vector<uint32_t> triangleIndices;
+		uint32_t packetWidth = 0;
+		uint32_t triangleCount = 0;
+	};
+
+	// A mesh instance found by an overlap query
+	struct InstanceOverlap {
+		uint32_t nodeIndex;
+		uint32_t meshIndex;
+	};
+	// Sorted node indices of the overlaps without duplicates, nodes with several meshes overlap once per mesh
+	void GetOverlappingNodes(const std::vector<InstanceOverlap>& overlaps, std::vector<uint32_t>& outNodeIndices);
+
+	// Two level BVH for CPU picking: a triangle BVH per mesh and a top level BVH over the mesh instances of the nodes.
+	// After node transforms changed only the top level has to be rebuilt with UpdateInstances, which does nothing
+	// if no node was transformed since the last call.
+	class ModelBVH {
+	public:
+		static constexpr uint32_t MAX_LEAF_INSTANCES = 2;
+		// Rays per thread pool task of the batched queries
+		static constexpr size_t RAY_BATCH_SIZE = 32;
+
+		// Builds the mesh BVHs in parallel and the top level BVH
+		void Build(const GenericModel& model);
+		void UpdateInstances(const GenericModel& model);
+		// Refits the mesh BVHs to skinned vertex positions of the whole model, see SkinVertexPositions
+		void Refit(const GenericModel& model, const std::vector<glm::vec3>& positions);
+		// Same result as GetModelIntersection, outHit is only written if the hit is closer than outHit.t
+		bool Intersect(const Ray& ray, HitInfo& outHit) const;
+		// True if anything is hit closer than maxT, cheaper than Intersect since it stops at the first hit
+		bool IsOccluded(const Ray& ray, float maxT) const;
+		// Batched versions of Intersect and IsOccluded, the rays are traced in parallel on the thread pool.
+		// pHits[i] and pOccluded[i] belong to pRays[i], pHits[i] is only written if the hit is closer than pHits[i].t.
+		void IntersectRays(const Ray* pRays, size_t rayCount, HitInfo* pHits) const;
+		void TestOcclusion(const Ray* pRays, const float* pMaxT, size_t rayCount, bool* pOccluded) const;
+		// Closest point on any triangle to point, outHit.t is the distance and the hit is only written if it is closer than outHit.t
+		bool FindClosestPoint(const glm::vec3& point, HitInfo& outHit) const;
+		// Overlap queries against the world bounds of the mesh instances, the overlaps are appended to outOverlaps
+		void QuerySphere(const glm::vec3& center, float radius, std::vector<InstanceOverlap>& outOverlaps) const;
+		void QueryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<InstanceOverlap>& outOverlaps) const;
+		void QueryFrustum(const Frustum& frustum, std::vector<InstanceOverlap>& outOverlaps) const;
+
+		inline bool IsBuilt() const { return isBuilt; }
+		inline size_t GetInstanceCount() const { return instances.size(); }
+		inline const MeshBVH& GetMeshBVH(size_t meshIndex) const { return meshBVHs[meshIndex]; }
+		inline const NodeTransformCache& GetTransformCache() const { return transformCache; }
+	private:
+		struct Instance {
+			glm::mat4 inverseTransform;
+			glm::mat4 transform;
+			glm::vec3 boundsMin;
+			// Lower bound of the factor the transform scales distances by
+			float minScale;
+			glm::vec3 boundsMax;
+			uint32_t nodeIndex;
+			uint32_t meshIndex;
+		};
+		void BuildInstances(const GenericModel& model);
+		template<typename Func>
+		void QueryOverlaps(Func overlaps, std::vector<InstanceOverlap>& outOverlaps) const;
+		std::vector<MeshBVH> meshBVHs;
+		std::vector<Instance> instances;
+		std::vector<BVHNode> instanceNodes;
+		NodeTransformCache transformCache;
+		bool isBuilt = false;
+	};
+
+	// Closest hit of every ray over several models, traced in parallel on the thread pool.
+	// pModelIndices[i] receives the model of pHits[i] or UINT32_MAX if the ray hit nothing, models that are not built are skipped.
+	void IntersectRays(const ModelBVH* pModels, size_t modelCount, const Ray* pRays, size_t rayCount, HitInfo* pHits, uint32_t* pModelIndices);
+}
@@ -0,0 +1,580 @@
+#include "ModelCache.hpp"
+#include "Model.hpp"
+#include "Filesystem/File.hpp"
+
+#include <fstream>
+#include <filesystem>
+
+namespace SGF {
+	namespace {
+		constexpr uint32_t MODEL_CACHE_MAGIC = 0x4D464753; // "SGFM"
+		constexpr size_t MODEL_CACHE_ALIGNMENT = 16;
+
+		enum CacheSection : uint32_t {
+			CACHE_SECTION_VERTICES,
+			CACHE_SECTION_INDICES,
+			CACHE_SECTION_MESHES,
+			CACHE_SECTION_MESH_LODS,
+			CACHE_SECTION_MESHLET_SPHERES,
+			CACHE_SECTION_MESHLET_CONES,
+			CACHE_SECTION_MESHLET_INDEX_OFFSETS,
+			CACHE_SECTION_MESHLET_TRIANGLE_COUNTS,
+			CACHE_SECTION_MESHLET_VERTEX_COUNTS,
+			CACHE_SECTION_NODES,
+			CACHE_SECTION_NODE_LINKS,
+			CACHE_SECTION_BONES,
+			CACHE_SECTION_VERTEX_WEIGHTS,
+			CACHE_SECTION_ANIMATIONS,
+			CACHE_SECTION_CHANNELS,
+			CACHE_SECTION_POSITION_KEYS,
+			CACHE_SECTION_ROTATION_KEYS,
+			CACHE_SECTION_SCALE_KEYS,
+			CACHE_SECTION_TEXTURES,
+			CACHE_SECTION_TEXELS,
+			CACHE_SECTION_STRINGS,
+			CACHE_SECTION_COUNT
+		};
+
+		struct StringRef {
+			uint32_t offset;
+			uint32_t length;
+		};
+		struct SectionRange {
+			uint64_t offset;
+			uint64_t size;
+		};
+		struct SourceInfo {
+			uint64_t size;
+			int64_t modifiedTime;
+			uint64_t contentHash;
+			uint64_t pathHash;
+		};
+		struct CacheHeader {
+			uint32_t magic;
+			uint32_t version;
+			// Strides of the raw copied structs, so a layout change invalidates old files
+			uint32_t vertexStride;
+			uint32_t meshStride;
+			uint32_t weightStride;
+			uint32_t keyFrameStride;
+			// The ModelImportFlagBits the model was imported with
+			uint32_t importFlags;
+			SourceInfo source;
+			StringRef name;
+			SectionRange sections[CACHE_SECTION_COUNT];
+		};
+
+		struct NodeRecord {
+			glm::mat4 globalTransform;
+			uint32_t parent;
+			uint32_t index;
+			uint32_t childOffset;
+			uint32_t childCount;
+			uint32_t meshOffset;
+			uint32_t meshCount;
+			StringRef name;
+		};
+		struct BoneRecord {
+			glm::mat4 offsetMatrix;
+			glm::mat4 currentTransform;
+			glm::mat4 nodeTransform;
+			glm::mat4 globalTransform;
+			uint32_t parent;
+			uint32_t index;
+			StringRef name;
+		};
+		struct AnimationRecord {
+			float duration;
+			float ticksPerSecond;
+			uint32_t channelOffset;
+			uint32_t channelCount;
+			StringRef name;
+		};
+		struct ChannelRecord {
+			uint32_t boneIndex;
+			uint32_t positionOffset;
+			uint32_t positionCount;
+			uint32_t rotationOffset;
+			uint32_t rotationCount;
+			uint32_t scaleOffset;
+			uint32_t scaleCount;
+		};
+		struct TextureRecord {
+			uint32_t width;
+			uint32_t height;
+			uint64_t texelOffset;
+		};
+
+		// FNV-1a
+		uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+			const uint8_t* bytes = (const uint8_t*)data;
+			for (size_t i = 0; i < size; ++i) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL;
+			}
+			return hash;
+		}
+
+		bool GetSourceInfo(const char* sourceFilename, SourceInfo& info) {
+			std::error_code error;
+			std::filesystem::path path(sourceFilename);
+			info.size = (uint64_t)std::filesystem::file_size(path, error);
+			if (error) return false;
+			auto writeTime = std::filesystem::last_write_time(path, error);
+			if (error) return false;
+			info.modifiedTime = (int64_t)writeTime.time_since_epoch().count();
+			auto content = LoadBinaryFile(sourceFilename);
+			if (content.size() != info.size) return false;
+			info.contentHash = HashBytes(content.data(), content.size());
+			std::string absolutePath = std::filesystem::absolute(path, error).string();
+			info.pathHash = HashBytes(absolutePath.data(), absolutePath.size());
+			return true;
+		}
+
+		class CacheWriter {
+		public:
+			inline CacheWriter() : data(sizeof(CacheHeader)) {}
+			template<typename T>
+			inline void WriteSection(CacheHeader& header, CacheSection section, const T* pData, size_t count) {
+				static_assert(std::is_trivially_copyable_v<T>);
+				size_t offset = (data.size() + MODEL_CACHE_ALIGNMENT - 1) & ~(MODEL_CACHE_ALIGNMENT - 1);
+				size_t size = sizeof(T) * count;
+				data.resize(offset + size);
+				if (size != 0) memcpy(data.data() + offset, pData, size);
+				header.sections[section].offset = offset;
+				header.sections[section].size = size;
+			}
+			template<typename T>
+			inline void WriteSection(CacheHeader& header, CacheSection section, const std::vector<T>& values) {
+				WriteSection(header, section, values.data(), values.size());
+			}
+			inline StringRef AddString(const std::string& str) {
+				StringRef ref = { (uint32_t)strings.size(), (uint32_t)str.size() };
+				strings.insert(strings.end(), str.begin(), str.end());
+				return ref;
+			}
+			inline void Finish(CacheHeader& header) {
+				WriteSection(header, CACHE_SECTION_STRINGS, strings);
+				memcpy(data.data(), &header, sizeof(CacheHeader));
+			}
+			inline const std::vector<char>& GetData() const { return data; }
+		private:
+			std::vector<char> data;
+			std::vector<char> strings;
+		};
+
+		class CacheReader {
+		public:
+			inline CacheReader(const std::vector<char>& data, const CacheHeader& header) : data(data), header(header) {}
+			template<typename T>
+			inline bool GetSection(CacheSection section, const T*& pData, size_t& count) const {
+				const auto& range = header.sections[section];
+				if (range.offset + range.size > data.size() || range.size % sizeof(T) != 0) return false;
+				pData = (const T*)(data.data() + range.offset);
+				count = range.size / sizeof(T);
+				return true;
+			}
+			template<typename T>
+			inline bool CopySection(CacheSection section, std::vector<T>& values) const {
+				const T* pData;
+				size_t count;
+				if (!GetSection(section, pData, count)) return false;
+				values.assign(pData, pData + count);
+				return true;
+			}
+			inline bool GetString(const char* pStrings, size_t stringSize, StringRef ref, std::string& out) const {
+				if ((size_t)ref.offset + ref.length > stringSize) return false;
+				out.assign(pStrings + ref.offset, ref.length);
+				return true;
+			}
+		private:
+			const std::vector<char>& data;
+			const CacheHeader& header;
+		};
+
+		bool ReadCacheHeader(const std::string& cacheFilename, CacheHeader& header) {
+			std::ifstream file(cacheFilename, std::ios::binary);
+			if (!file.is_open()) return false;
+			file.read((char*)&header, sizeof(CacheHeader));
+			return file.gcount() == sizeof(CacheHeader);
+		}
+
+		void FillLayoutInfo(CacheHeader& header) {
+			header.magic = MODEL_CACHE_MAGIC;
+			header.version = MODEL_CACHE_VERSION;
+			header.vertexStride = sizeof(GenericModel::Vertex);
+			header.meshStride = sizeof(GenericModel::Mesh);
+			header.weightStride = sizeof(GenericModel::VertexWeight);
+			header.keyFrameStride = sizeof(GenericModel::KeyFrame);
+		}
+
+		bool IsHeaderValid(const CacheHeader& header, const SourceInfo& source, uint32_t importFlags) {
+			CacheHeader expected;
+			FillLayoutInfo(expected);
+			return header.magic == expected.magic && header.version == expected.version &&
+				header.vertexStride == expected.vertexStride && header.meshStride == expected.meshStride &&
+				header.weightStride == expected.weightStride && header.keyFrameStride == expected.keyFrameStride && header.importFlags == importFlags &&
+				header.source.size == source.size && header.source.modifiedTime == source.modifiedTime &&
+				header.source.contentHash == source.contentHash && header.source.pathHash == source.pathHash;
+		}
+
+		inline bool IsRangeValid(size_t offset, size_t count, size_t size) {
+			return offset <= size && count <= size - offset;
+		}
+
+		// Every stored index has to point into its array, a damaged file would be read out of bounds by the draw code,
+		// the BVH build and skinning. Expects the sections and links to be read already.
+		bool IsModelValid(const GenericModel& model) {
+			if (model.nodes.empty() || model.nodes[0].parent != UINT32_MAX) return false;
+			const size_t nodeCount = model.nodes.size();
+			for (const auto& node : model.nodes) {
+				if (node.index >= nodeCount || (node.parent != UINT32_MAX && node.parent >= nodeCount)) return false;
+				for (uint32_t child : node.children) {
+					if (child >= nodeCount) return false;
+				}
+				for (uint32_t mesh : node.meshes) {
+					if (mesh >= model.meshes.size()) return false;
+				}
+			}
+			for (const auto& mesh : model.meshes) {
+				if (!IsRangeValid(mesh.indexOffset, mesh.indexCount, model.indices.size()) ||
+					!IsRangeValid(mesh.vertexOffset, mesh.vertexCount, model.vertices.size()) ||
+					!IsRangeValid(mesh.firstLod, mesh.lodCount, model.meshLods.size()) ||
+					!IsRangeValid(mesh.firstMeshlet, mesh.meshletCount, model.meshlets.GetCount()) ||
+					(mesh.textureIndex != UINT32_MAX && mesh.textureIndex >= model.textures.size())) return false;
+				// Indices are relative to the vertices of the mesh, LODs share them
+				for (uint32_t i = mesh.indexOffset; i < mesh.indexOffset + mesh.indexCount; ++i) {
+					if (model.indices[i] >= mesh.vertexCount) return false;
+				}
+				for (uint32_t lod = mesh.firstLod; lod < mesh.firstLod + mesh.lodCount; ++lod) {
+					const auto& meshLod = model.meshLods[lod];
+					if (!IsRangeValid(meshLod.indexOffset, meshLod.indexCount, model.indices.size())) return false;
+					for (uint32_t i = meshLod.indexOffset; i < meshLod.indexOffset + meshLod.indexCount; ++i) {
+						if (model.indices[i] >= mesh.vertexCount) return false;
+					}
+				}
+			}
+			for (size_t i = 0; i < model.meshlets.GetCount(); ++i) {
+				if (!IsRangeValid(model.meshlets.indexOffsets[i], model.meshlets.triangleCounts[i] * 3, model.indices.size())) return false;
+			}
+			const size_t boneCount = model.bones.size();
+			// Bones are sorted, parents come first
+			for (size_t i = 0; i < boneCount; ++i) {
+				if (model.bones[i].parent != UINT32_MAX && model.bones[i].parent >= i) return false;
+			}
+			if (!model.vertexWeights.empty() && model.vertexWeights.size() != model.vertices.size()) return false;
+			// Models without bones keep zero weights of bone 0, they are never skinned
+			for (size_t i = 0; i < model.vertexWeights.size() && boneCount != 0; ++i) {
+				for (uint32_t boneIndex : model.vertexWeights[i].boneIndices) {
+					if (boneIndex >= boneCount) return false;
+				}
+			}
+			for (const auto& animation : model.animations) {
+				for (const auto& channel : animation.channels) {
+					if (channel.boneIndex >= boneCount) return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	std::string GetModelCacheFilename(const char* sourceFilename) {
+		std::error_code error;
+		std::string absolutePath = std::filesystem::absolute(std::filesystem::path(sourceFilename), error).string();
+		return fmt::format("{}/{:016x}.sgfm", MODEL_CACHE_DIRECTORY, HashBytes(absolutePath.data(), absolutePath.size()));
+	}
+
+	bool SaveModelCache(const GenericModel& model, const char* sourceFilename, uint32_t importFlags) {
+		Timer timer;
+		// The cache keeps full precision keys, compressed keys would get compressed a second time on load
+		for (const auto& animation : model.animations) {
+			if (animation.IsCompressed()) {
+				Log::Warn("Model: {} has compressed animations, it is not written to the cache", sourceFilename);
+				return false;
+			}
+		}
+		CacheHeader header = {};
+		FillLayoutInfo(header);
+		header.importFlags = importFlags;
+		if (!GetSourceInfo(sourceFilename, header.source)) {
+			Log::Warn("Failed to read source file info for model cache: {}", sourceFilename);
+			return false;
+		}
+		CacheWriter writer;
+		header.name = writer.AddString(model.name);
+		writer.WriteSection(header, CACHE_SECTION_VERTICES, model.vertices);
+		writer.WriteSection(header, CACHE_SECTION_INDICES, model.indices);
+		writer.WriteSection(header, CACHE_SECTION_MESHES, model.meshes);
+		writer.WriteSection(header, CACHE_SECTION_MESH_LODS, model.meshLods);
+		writer.WriteSection(header, CACHE_SECTION_MESHLET_SPHERES, model.meshlets.boundingSpheres);
+		writer.WriteSection(header, CACHE_SECTION_MESHLET_CONES, model.meshlets.normalCones);
+		writer.WriteSection(header, CACHE_SECTION_MESHLET_INDEX_OFFSETS, model.meshlets.indexOffsets);
+		writer.WriteSection(header, CACHE_SECTION_MESHLET_TRIANGLE_COUNTS, model.meshlets.triangleCounts);
+		writer.WriteSection(header, CACHE_SECTION_MESHLET_VERTEX_COUNTS, model.meshlets.vertexCounts);
+		writer.WriteSection(header, CACHE_SECTION_VERTEX_WEIGHTS, model.vertexWeights);
+
+		// Nodes: children and mesh indices are flattened into one link array
+		{
+			std::vector<NodeRecord> nodeRecords(model.nodes.size());
+			std::vector<uint32_t> links;
+			for (size_t i = 0; i < model.nodes.size(); ++i) {
+				const auto& node = model.nodes[i];
+				auto& record = nodeRecords[i];
+				record.globalTransform = node.globalTransform;
+				record.parent = node.parent;
+				record.index = node.index;
+				record.childOffset = (uint32_t)links.size();
+				record.childCount = (uint32_t)node.children.size();
+				links.insert(links.end(), node.children.begin(), node.children.end());
+				record.meshOffset = (uint32_t)links.size();
+				record.meshCount = (uint32_t)node.meshes.size();
+				links.insert(links.end(), node.meshes.begin(), node.meshes.end());
+				record.name = writer.AddString(node.name);
+			}
+			writer.WriteSection(header, CACHE_SECTION_NODES, nodeRecords);
+			writer.WriteSection(header, CACHE_SECTION_NODE_LINKS, links);
+		}
+		// Bones:
+		{
+			std::vector<BoneRecord> boneRecords(model.bones.size());
+			for (size_t i = 0; i < model.bones.size(); ++i) {
+				const auto& bone = model.bones[i];
+				auto& record = boneRecords[i];
+				record.offsetMatrix = bone.offsetMatrix;
+				record.currentTransform = bone.currentTransform;
+				record.nodeTransform = bone.nodeTransform;
+				record.globalTransform = bone.globalTransform;
+				record.parent = bone.parent;
+				record.index = bone.index;
+				record.name = writer.AddString(bone.name);
+			}
+			writer.WriteSection(header, CACHE_SECTION_BONES, boneRecords);
+		}
+		// Animations: all keys of all channels share one array per key type
+		{
+			std::vector<AnimationRecord> animationRecords(model.animations.size());
+			std::vector<ChannelRecord> channelRecords;
+			std::vector<GenericModel::KeyFrame> positionKeys;
+			std::vector<GenericModel::RotationKeyFrame> rotationKeys;
+			std::vector<GenericModel::KeyFrame> scaleKeys;
+			for (size_t i = 0; i < model.animations.size(); ++i) {
+				const auto& animation = model.animations[i];
+				auto& record = animationRecords[i];
+				record.duration = animation.duration;
+				record.ticksPerSecond = animation.ticksPerSecond;
+				record.channelOffset = (uint32_t)channelRecords.size();
+				record.channelCount = (uint32_t)animation.channels.size();
+				record.name = writer.AddString(animation.name);
+				for (const auto& channel : animation.channels) {
+					ChannelRecord channelRecord;
+					channelRecord.boneIndex = channel.boneIndex;
+					channelRecord.positionOffset = (uint32_t)positionKeys.size();
+					channelRecord.positionCount = (uint32_t)channel.positionKeys.size();
+					channelRecord.rotationOffset = (uint32_t)rotationKeys.size();
+					channelRecord.rotationCount = (uint32_t)channel.rotationKeys.size();
+					channelRecord.scaleOffset = (uint32_t)scaleKeys.size();
+					channelRecord.scaleCount = (uint32_t)channel.scaleKeys.size();
+					positionKeys.insert(positionKeys.end(), channel.positionKeys.begin(), channel.positionKeys.end());
+					rotationKeys.insert(rotationKeys.end(), channel.rotationKeys.begin(), channel.rotationKeys.end());
+					scaleKeys.insert(scaleKeys.end(), channel.scaleKeys.begin(), channel.scaleKeys.end());
+					channelRecords.push_back(channelRecord);
+				}
+			}
+			writer.WriteSection(header, CACHE_SECTION_ANIMATIONS, animationRecords);
+			writer.WriteSection(header, CACHE_SECTION_CHANNELS, channelRecords);
+			writer.WriteSection(header, CACHE_SECTION_POSITION_KEYS, positionKeys);
+			writer.WriteSection(header, CACHE_SECTION_ROTATION_KEYS, rotationKeys);
+			writer.WriteSection(header, CACHE_SECTION_SCALE_KEYS, scaleKeys);
+		}
+		// Decoded textures (RGBA8):
+		{
+			std::vector<TextureRecord> textureRecords(model.textures.size());
+			std::vector<uint8_t> texels;
+			size_t totalSize = 0;
+			for (const auto& texture : model.textures) {
+				totalSize += texture.GetMemorySize();
+			}
+			texels.reserve(totalSize);
+			for (size_t i = 0; i < model.textures.size(); ++i) {
+				const auto& texture = model.textures[i];
+				textureRecords[i].width = texture.GetWidth();
+				textureRecords[i].height = texture.GetHeight();
+				textureRecords[i].texelOffset = texels.size();
+				texels.insert(texels.end(), texture.GetData(), texture.GetData() + texture.GetMemorySize());
+			}
+			writer.WriteSection(header, CACHE_SECTION_TEXTURES, textureRecords);
+			writer.WriteSection(header, CACHE_SECTION_TEXELS, texels);
+		}
+		writer.Finish(header);
+
+		std::error_code error;
+		std::filesystem::create_directories(MODEL_CACHE_DIRECTORY, error);
+		if (error) {
+			Log::Warn("Failed to create model cache directory: {}", MODEL_CACHE_DIRECTORY);
+			return false;
+		}
+		std::string cacheFilename = GetModelCacheFilename(sourceFilename);
+		if (!SaveBinaryFile(cacheFilename.c_str(), writer.GetData())) {
+			return false;
+		}
+		Log::Info("Saved model cache: {} ({} bytes), took: {} milliseconds", cacheFilename, writer.GetData().size(), timer.currentMillis());
+		return true;
+	}
+
+	bool LoadModelCache(GenericModel& model, const char* sourceFilename, uint32_t importFlags) {
+		Timer timer;
+		std::string cacheFilename = GetModelCacheFilename(sourceFilename);
+		CacheHeader header;
+		if (!ReadCacheHeader(cacheFilename, header)) {
+			return false;
+		}
+		SourceInfo source;
+		if (!GetSourceInfo(sourceFilename, source) || !IsHeaderValid(header, source, importFlags)) {
+			Log::Info("Model cache for file: {} is outdated", sourceFilename);
+			return false;
+		}
+		auto data = LoadBinaryFile(cacheFilename.c_str());
+		if (data.size() < sizeof(CacheHeader)) {
+			return false;
+		}
+		CacheReader reader(data, header);
+
+		const char* pStrings;
+		size_t stringSize;
+		const NodeRecord* pNodes;
+		size_t nodeCount;
+		const uint32_t* pLinks;
+		size_t linkCount;
+		const BoneRecord* pBones;
+		size_t boneCount;
+		const AnimationRecord* pAnimations;
+		size_t animationCount;
+		const ChannelRecord* pChannels;
+		size_t channelCount;
+		const GenericModel::KeyFrame* pPositionKeys;
+		size_t positionKeyCount;
+		const GenericModel::RotationKeyFrame* pRotationKeys;
+		size_t rotationKeyCount;
+		const GenericModel::KeyFrame* pScaleKeys;
+		size_t scaleKeyCount;
+		const TextureRecord* pTextures;
+		size_t textureCount;
+		const uint8_t* pTexels;
+		size_t texelCount;
+		bool valid = reader.GetSection(CACHE_SECTION_STRINGS, pStrings, stringSize) &&
+			reader.GetSection(CACHE_SECTION_NODES, pNodes, nodeCount) &&
+			reader.GetSection(CACHE_SECTION_NODE_LINKS, pLinks, linkCount) &&
+			reader.GetSection(CACHE_SECTION_BONES, pBones, boneCount) &&
+			reader.GetSection(CACHE_SECTION_ANIMATIONS, pAnimations, animationCount) &&
+			reader.GetSection(CACHE_SECTION_CHANNELS, pChannels, channelCount) &&
+			reader.GetSection(CACHE_SECTION_POSITION_KEYS, pPositionKeys, positionKeyCount) &&
+			reader.GetSection(CACHE_SECTION_ROTATION_KEYS, pRotationKeys, rotationKeyCount) &&
+			reader.GetSection(CACHE_SECTION_SCALE_KEYS, pScaleKeys, scaleKeyCount) &&
+			reader.GetSection(CACHE_SECTION_TEXTURES, pTextures, textureCount) &&
+			reader.GetSection(CACHE_SECTION_TEXELS, pTexels, texelCount) &&
+			reader.CopySection(CACHE_SECTION_VERTICES, model.vertices) &&
+			reader.CopySection(CACHE_SECTION_INDICES, model.indices) &&
+			reader.CopySection(CACHE_SECTION_MESHES, model.meshes) &&
+			reader.CopySection(CACHE_SECTION_MESH_LODS, model.meshLods) &&
+			reader.CopySection(CACHE_SECTION_MESHLET_SPHERES, model.meshlets.boundingSpheres) &&
+			reader.CopySection(CACHE_SECTION_MESHLET_CONES, model.meshlets.normalCones) &&
+			reader.CopySection(CACHE_SECTION_MESHLET_INDEX_OFFSETS, model.meshlets.indexOffsets) &&
+			reader.CopySection(CACHE_SECTION_MESHLET_TRIANGLE_COUNTS, model.meshlets.triangleCounts) &&
+			reader.CopySection(CACHE_SECTION_MESHLET_VERTEX_COUNTS, model.meshlets.vertexCounts) &&
+			reader.CopySection(CACHE_SECTION_VERTEX_WEIGHTS, model.vertexWeights) &&
+			reader.GetString(pStrings, stringSize, header.name, model.name);
+		const size_t meshletCount = model.meshlets.GetCount();
+		valid = valid && model.meshlets.boundingSpheres.size() == meshletCount && model.meshlets.normalCones.size() == meshletCount &&
+			model.meshlets.triangleCounts.size() == meshletCount && model.meshlets.vertexCounts.size() == meshletCount;
+
+		if (valid) {
+			model.nodes.resize(nodeCount);
+			for (size_t i = 0; i < nodeCount && valid; ++i) {
+				const auto& record = pNodes[i];
+				auto& node = model.nodes[i];
+				if ((size_t)record.childOffset + record.childCount > linkCount || (size_t)record.meshOffset + record.meshCount > linkCount) {
+					valid = false;
+					break;
+				}
+				node.globalTransform = record.globalTransform;
+				node.parent = record.parent;
+				node.index = record.index;
+				node.children.assign(pLinks + record.childOffset, pLinks + record.childOffset + record.childCount);
+				node.meshes.assign(pLinks + record.meshOffset, pLinks + record.meshOffset + record.meshCount);
+				valid = reader.GetString(pStrings, stringSize, record.name, node.name);
+			}
+		}
+		if (valid) {
+			model.bones.resize(boneCount);
+			for (size_t i = 0; i < boneCount && valid; ++i) {
+				const auto& record = pBones[i];
+				auto& bone = model.bones[i];
+				bone.offsetMatrix = record.offsetMatrix;
+				bone.currentTransform = record.currentTransform;
+				bone.nodeTransform = record.nodeTransform;
+				bone.globalTransform = record.globalTransform;
+				bone.parent = record.parent;
+				bone.index = record.index;
+				valid = reader.GetString(pStrings, stringSize, record.name, bone.name);
+			}
+		}
+		if (valid) {
+			model.animations.resize(animationCount);
+			for (size_t i = 0; i < animationCount && valid; ++i) {
+				const auto& record = pAnimations[i];
+				auto& animation = model.animations[i];
+				if ((size_t)record.channelOffset + record.channelCount > channelCount) {
+					valid = false;
+					break;
+				}
+				animation.duration = record.duration;
+				animation.ticksPerSecond = record.ticksPerSecond;
+				valid = reader.GetString(pStrings, stringSize, record.name, animation.name);
+				animation.channels.resize(record.channelCount);
+				for (uint32_t j = 0; j < record.channelCount && valid; ++j) {
+					const auto& channelRecord = pChannels[record.channelOffset + j];
+					if ((size_t)channelRecord.positionOffset + channelRecord.positionCount > positionKeyCount ||
+						(size_t)channelRecord.rotationOffset + channelRecord.rotationCount > rotationKeyCount ||
+						(size_t)channelRecord.scaleOffset + channelRecord.scaleCount > scaleKeyCount) {
+						valid = false;
+						break;
+					}
+					auto& channel = animation.channels[j];
+					channel.boneIndex = channelRecord.boneIndex;
+					channel.positionKeys.assign(pPositionKeys + channelRecord.positionOffset, pPositionKeys + channelRecord.positionOffset + channelRecord.positionCount);
+					channel.rotationKeys.assign(pRotationKeys + channelRecord.rotationOffset, pRotationKeys + channelRecord.rotationOffset + channelRecord.rotationCount);
+					channel.scaleKeys.assign(pScaleKeys + channelRecord.scaleOffset, pScaleKeys + channelRecord.scaleOffset + channelRecord.scaleCount);
+				}
+			}
+		}
+		if (valid) {
+			model.textures.reserve(textureCount);
+			for (size_t i = 0; i < textureCount; ++i) {
+				const auto& record = pTextures[i];
+				if (record.texelOffset + (uint64_t)record.width * record.height * 4 > texelCount) {
+					valid = false;
+					break;
+				}
+				model.textures.emplace_back(record.width, record.height, pTexels + record.texelOffset);
+			}
+		}
+		valid = valid && IsModelValid(model);
+		if (!valid) {
+			Log::Warn("Model cache file: {} is corrupted", cacheFilename);
+			model.indices.clear();
+			model.vertices.clear();
+			model.textures.clear();
+			model.nodes.clear();
+			model.meshes.clear();
+			model.meshLods.clear();
+			model.meshlets.Clear();
+			model.bones.clear();
+			model.vertexWeights.clear();
+			model.animations.clear();
+			model.name.clear();
+			return false;
+		}
+		Log::Info("Loaded model: {} from cache, took: {} milliseconds", sourceFilename, timer.currentMillis());
+		return true;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+
+namespace SGF {
+	class GenericModel;
+
+	// Binary cache for imported models, stored in MODEL_CACHE_DIRECTORY.
+	// A cache file is keyed by the source path, its modification time, its size and a hash of its content.
+	// All sections are 16 byte aligned flat arrays so the file can be used directly from a single read or a memory mapping.
+	constexpr const char* MODEL_CACHE_DIRECTORY = "cache/models";
+	constexpr uint32_t MODEL_CACHE_VERSION = 6;
+
+	// Tries to load the model from the cache, returns false if no valid cache entry exists for the source file and import flags.
+	bool LoadModelCache(GenericModel& model, const char* sourceFilename, uint32_t importFlags);
+	// Writes the model to the cache, overwriting an existing entry for the source file.
+	bool SaveModelCache(const GenericModel& model, const char* sourceFilename, uint32_t importFlags);
+
+	std::string GetModelCacheFilename(const char* sourceFilename);
+}
@@ -0,0 +1,178 @@
+#include "ModelImportQueue.hpp"
+#include "Threading/ThreadPool.hpp"
+
+namespace SGF {
+	ModelImportQueue::ModelImportQueue(uint32_t maxRunningJobs, uint32_t maxQueuedJobs) : maxRunningJobs(std::max(maxRunningJobs, 1u)), maxQueuedJobs(maxQueuedJobs) {}
+
+	ModelImportQueue::~ModelImportQueue() {
+		CancelAll();
+		// Running imports reference their job
+		for (auto& job : jobs) {
+			if (job->state == JobState::LOADING) {
+				ThreadPool::Get().Wait(job->model);
+			}
+		}
+	}
+
+	uint32_t ModelImportQueue::Enqueue(const std::string& filename, int32_t priority, bool isProgressive, uint32_t importFlags) {
+		if (jobs.size() >= maxQueuedJobs) {
+			SGF::Log::Warn("Import queue is full, model file: {} is not imported!", filename);
+			return UINT32_MAX;
+		}
+		auto job = std::make_unique<Job>();
+		job->id = nextJobId++;
+		job->priority = priority;
+		job->isProgressive = isProgressive;
+		job->importFlags = importFlags;
+		job->filename = filename;
+		uint32_t jobId = job->id;
+		jobs.push_back(std::move(job));
+		StartQueuedJobs();
+		return jobId;
+	}
+
+	bool ModelImportQueue::Cancel(uint32_t jobId) {
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			auto& job = *jobs[i];
+			if (job.id != jobId) continue;
+			if (job.state == JobState::QUEUED) {
+				jobs.erase(jobs.begin() + i);
+				return true;
+			} else if (job.state == JobState::LOADING) {
+				// The result gets discarded once the import stopped
+				job.progress.isCancelled = true;
+				return true;
+			}
+			return false;
+		}
+		return false;
+	}
+
+	void ModelImportQueue::CancelAll() {
+		for (size_t i = 0; i < jobs.size();) {
+			auto& job = *jobs[i];
+			if (job.state == JobState::QUEUED) {
+				jobs.erase(jobs.begin() + i);
+				continue;
+			} else if (job.state == JobState::LOADING) {
+				job.progress.isCancelled = true;
+			}
+			++i;
+		}
+	}
+
+	bool ModelImportQueue::SetPriority(uint32_t jobId, int32_t priority) {
+		Job* pJob = FindJob(jobId);
+		if (pJob == nullptr || pJob->state != JobState::QUEUED) return false;
+		pJob->priority = priority;
+		return true;
+	}
+
+	void ModelImportQueue::Update(std::vector<std::unique_ptr<GenericModel>>& loadedModels, std::vector<GenericModel*>& streamedModels) {
+		for (size_t i = 0; i < discardedImports.size();) {
+			if (!discardedImports[i]->HasRunningJobs()) {
+				discardedImports.erase(discardedImports.begin() + i);
+			} else {
+				++i;
+			}
+		}
+		for (size_t i = 0; i < jobs.size();) {
+			auto& job = *jobs[i];
+			bool isFinished = false;
+			if (job.state == JobState::LOADING && job.model.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				runningJobCount--;
+				auto pModel = job.model.get();
+				if (job.progress.isCancelled || pModel == nullptr || pModel->GetVertexCount() == 0) {
+					if (!job.progress.isCancelled) {
+						SGF::Log::Warn("Import of model file: {} failed!", job.filename);
+					}
+					isFinished = true;
+				} else if (job.import && !job.import->IsStreamingFinished()) {
+					job.state = JobState::STREAMING;
+					job.pStreamingModel = pModel.get();
+					loadedModels.push_back(std::move(pModel));
+				} else {
+					if (job.import) {
+						job.import->ApplyStreamedData(*pModel);
+					}
+					loadedModels.push_back(std::move(pModel));
+					isFinished = true;
+				}
+			} else if (job.state == JobState::STREAMING && job.import->IsStreamingFinished()) {
+				job.import->ApplyStreamedData(*job.pStreamingModel);
+				streamedModels.push_back(job.pStreamingModel);
+				isFinished = true;
+			}
+			if (isFinished) {
+				// The model cache is written in the background
+				if (job.import && job.import->HasRunningJobs()) {
+					discardedImports.push_back(std::move(job.import));
+				}
+				jobs.erase(jobs.begin() + i);
+			} else {
+				++i;
+			}
+		}
+		StartQueuedJobs();
+	}
+
+	void ModelImportQueue::GetJobInfos(std::vector<JobInfo>& jobInfos) const {
+		jobInfos.clear();
+		jobInfos.reserve(jobs.size());
+		for (const auto& job : jobs) {
+			JobInfo info;
+			info.id = job->id;
+			info.priority = job->priority;
+			info.state = job->state;
+			info.pFilename = &job->filename;
+			if (job->state == JobState::LOADING) {
+				info.progress = job->progress.progress;
+			} else if (job->state == JobState::STREAMING) {
+				info.progress = job->import->GetStreamingProgress();
+			} else {
+				info.progress = 0.0f;
+			}
+			jobInfos.push_back(info);
+		}
+	}
+
+	ModelImportQueue::Job* ModelImportQueue::FindJob(uint32_t jobId) {
+		for (auto& job : jobs) {
+			if (job->id == jobId) return job.get();
+		}
+		return nullptr;
+	}
+
+	void ModelImportQueue::StartJob(Job& job) {
+		assert(job.state == JobState::QUEUED);
+		job.state = JobState::LOADING;
+		runningJobCount++;
+		// The job object stays in place until its future is ready
+		if (job.isProgressive) {
+			job.import = std::make_unique<ProgressiveModelImport>(job.filename, job.importFlags, &job.progress);
+			job.model = ThreadPool::Get().Submit([pImport = job.import.get()]() {
+				return pImport->LoadGeometry();
+			});
+		} else {
+			job.model = ThreadPool::Get().Submit([pJob = &job]() -> std::unique_ptr<GenericModel> {
+				auto pModel = std::make_unique<GenericModel>();
+				if (pModel->ImportModel(pJob->filename.c_str(), pJob->importFlags, &pJob->progress) == nullptr) return nullptr;
+				return pModel;
+			});
+		}
+	}
+
+	void ModelImportQueue::StartQueuedJobs() {
+		while (runningJobCount < maxRunningJobs) {
+			Job* pNext = nullptr;
+			for (auto& job : jobs) {
+				// Equal priorities start in the order they were enqueued
+				if (job->state == JobState::QUEUED && (pNext == nullptr || job->priority > pNext->priority)) {
+					pNext = job.get();
+				}
+			}
+			if (pNext == nullptr) break;
+			StartJob(*pNext);
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	// Imports model files on the thread pool. At most maxRunningJobs imports run at the same time,
+	// the queued jobs are started in order of their priority, higher priorities first.
+	// All functions are called from the main thread, the imported models are handed out by Update.
+	class ModelImportQueue {
+	public:
+		enum class JobState {
+			QUEUED,
+			LOADING,
+			STREAMING,
+		};
+		struct JobInfo {
+			uint32_t id;
+			int32_t priority;
+			JobState state;
+			float progress;
+			const std::string* pFilename;
+		};
+
+		ModelImportQueue(uint32_t maxRunningJobs, uint32_t maxQueuedJobs);
+		~ModelImportQueue();
+		ModelImportQueue(const ModelImportQueue&) = delete;
+		ModelImportQueue& operator=(const ModelImportQueue&) = delete;
+
+		// Returns the id of the job or UINT32_MAX if the queue is full
+		uint32_t Enqueue(const std::string& filename, int32_t priority = 0, bool isProgressive = true, uint32_t importFlags = MODEL_IMPORT_OPTIMIZE_MESHES | MODEL_IMPORT_GENERATE_LODS | MODEL_IMPORT_BUILD_MESHLETS);
+		// Streaming jobs can not be cancelled anymore, their model is already handed out
+		bool Cancel(uint32_t jobId);
+		void CancelAll();
+		bool SetPriority(uint32_t jobId, int32_t priority);
+
+		// Starts queued jobs and collects finished ones.
+		// loadedModels receives the new models that are ready to be drawn.
+		// streamedModels receives models handed out earlier whose textures and animations finished loading,
+		// the model must stay alive until then.
+		void Update(std::vector<std::unique_ptr<GenericModel>>& loadedModels, std::vector<GenericModel*>& streamedModels);
+
+		void GetJobInfos(std::vector<JobInfo>& jobInfos) const;
+		inline size_t GetJobCount() const { return jobs.size(); }
+		inline bool IsEmpty() const { return jobs.empty(); }
+		inline uint32_t GetRunningJobCount() const { return runningJobCount; }
+		inline uint32_t GetMaxRunningJobs() const { return maxRunningJobs; }
+		inline void SetMaxRunningJobs(uint32_t count) { maxRunningJobs = std::max(count, 1u); }
+	private:
+		struct Job {
+			uint32_t id;
+			int32_t priority;
+			bool isProgressive;
+			uint32_t importFlags;
+			JobState state = JobState::QUEUED;
+			std::string filename;
+			// Referenced by the import, so it is declared first
+			ImportProgress progress;
+			std::unique_ptr<ProgressiveModelImport> import;
+			std::future<std::unique_ptr<GenericModel>> model;
+			GenericModel* pStreamingModel = nullptr;
+		};
+		std::vector<std::unique_ptr<Job>> jobs;
+		// Imports of finished or cancelled jobs, kept until their texture, animation and cache jobs finished
+		std::vector<std::unique_ptr<ProgressiveModelImport>> discardedImports;
+		uint32_t maxRunningJobs;
+		uint32_t maxQueuedJobs;
+		uint32_t runningJobCount = 0;
+		uint32_t nextJobId = 0;
+	private:
+		Job* FindJob(uint32_t jobId);
+		void StartJob(Job& job);
+		void StartQueuedJobs();
+	};
+}
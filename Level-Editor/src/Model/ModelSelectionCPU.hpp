@@ -3,6 +3,8 @@
 #include "SGF_Core.hpp"
 #include "Geometry/Ray.hpp"
 #include "Model.hpp"
+#include "Meshlets.hpp"
+#include "NodeTransformCache.hpp"
 #include <limits>
 
 namespace SGF {
@@ -52,6 +54,36 @@ namespace SGF {
         return Ray{ nearPoint, direction };
     }
 
+    // Rays through a grid of pixels inside [minX, maxX] x [minY, maxY] with the given pixel spacing, row by row.
+    // Same rays as CreateRayFromPixel, but the matrices are only inverted once for the whole grid.
+    inline void CreateRaysFromPixelRect(
+        uint32_t minX, uint32_t minY,
+        uint32_t maxX, uint32_t maxY,
+        uint32_t spacing,
+        uint32_t screenWidth,
+        uint32_t screenHeight,
+        const glm::mat4& view, const glm::mat4& projection,
+        std::vector<Ray>& outRays)
+    {
+        outRays.clear();
+        if (minX > maxX || minY > maxY) return;
+        spacing = std::max(spacing, 1u);
+        const glm::mat4 inverseViewProj = glm::inverse(projection * view);
+        auto unproject = [&](float px, float py, float depth) {
+            glm::vec4 ndc(px / (float)screenWidth * 2.f - 1.f, py / (float)screenHeight * 2.f - 1.f, depth, 1.f);
+            glm::vec4 world = inverseViewProj * ndc;
+            return glm::vec3(world) / world.w;
+        };
+        outRays.reserve((size_t)((maxX - minX) / spacing + 1) * ((maxY - minY) / spacing + 1));
+        for (uint32_t py = minY; py <= maxY; py += spacing) {
+            for (uint32_t px = minX; px <= maxX; px += spacing) {
+                glm::vec3 nearPoint = unproject((float)px, (float)py, 0.f);
+                glm::vec3 farPoint = unproject((float)px, (float)py, 1.f);
+                outRays.emplace_back(nearPoint, glm::normalize(farPoint - nearPoint));
+            }
+        }
+    }
+
 
     // Source - https://stackoverflow.com/a/69185265
 	// Posted by paulytools, modified by community. See post 'Timeline' for change history
@@ -135,70 +167,127 @@ namespace SGF {
 
         return true;
     }
+    // Ray direction must be normalized
+    inline bool IntersectRaySphere(const Ray& ray, const glm::vec4& sphere, float maxT) {
+        glm::vec3 toCenter = glm::vec3(sphere) - ray.GetOrigin();
+        float tCenter = glm::dot(toCenter, ray.GetDirection());
+        float distanceSquared = glm::dot(toCenter, toCenter) - tCenter * tCenter;
+        float radiusSquared = sphere.w * sphere.w;
+        if (distanceSquared > radiusSquared) return false;
+        float halfChord = std::sqrt(radiusSquared - distanceSquared);
+        return tCenter + halfChord >= 0.0f && tCenter - halfChord <= maxT;
+    }
+    // Calls func(firstTriangle, triangleCount) for the triangle ranges of the mesh the ray can hit.
+    // Meshes with meshlets only report the meshlets whose bounding sphere is hit, sphereTransform brings the spheres into the space of the ray.
+    template<typename Func>
+    inline void ForEachMeshTriangleRange(const Ray& ray, const GenericModel& model, const GenericModel::Mesh& mesh, const glm::mat4* pSphereTransform, float maxT, Func func) {
+        if (mesh.meshletCount == 0) {
+            func(0u, mesh.indexCount / 3);
+            return;
+        }
+        const auto& meshlets = model.GetMeshlets();
+        for (uint32_t i = mesh.firstMeshlet; i < mesh.firstMeshlet + mesh.meshletCount; ++i) {
+            glm::vec4 sphere = pSphereTransform ? TransformBoundingSphere(*pSphereTransform, meshlets.boundingSpheres[i]) : meshlets.boundingSpheres[i];
+            if (IntersectRaySphere(ray, sphere, maxT)) {
+                func((meshlets.indexOffsets[i] - mesh.indexOffset) / 3, (uint32_t)meshlets.triangleCounts[i]);
+            }
+        }
+    }
     inline bool GetMeshIntersection(const Ray& ray, const GenericModel& model, const GenericModel::Mesh& mesh, const glm::mat4& transform, HitInfo& outHit) {
         bool hit = false;
         const auto& vertices = model.GetVertices();
         const auto& indices = model.GetIndices();
-        for (size_t i = 0; i < mesh.indexCount / 3; ++i) {
-            uint32_t i0 = indices[mesh.indexOffset + i * 3 + 0];
-            uint32_t i1 = indices[mesh.indexOffset + i * 3 + 1];
-            uint32_t i2 = indices[mesh.indexOffset + i * 3 + 2];
-
-            glm::vec3 v0 = vertices[mesh.vertexOffset + i0].position;
-            glm::vec3 v1 = vertices[mesh.vertexOffset + i1].position;
-            glm::vec3 v2 = vertices[mesh.vertexOffset + i2].position;
-
-            v0 = glm::vec3(transform * glm::vec4(v0, 1.f));
-            v1 = glm::vec3(transform * glm::vec4(v1, 1.f));
-            v2 = glm::vec3(transform * glm::vec4(v2, 1.f));
-
-            float t, u, v;
-            if (IntersectTriangle(ray, v0, v1, v2, t, u, v)) {
-                if (t <= outHit.t) {
-                    hit = true;
-                    outHit.t = t;
-                    outHit.position = ray.GetOrigin() + t * ray.GetDirection();
-                    outHit.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
-                    outHit.triangleIndex = static_cast<uint32_t>(i);
-                    outHit.meshIndex = 0;
-					outHit.nodeIndex = 0;
+        ForEachMeshTriangleRange(ray, model, mesh, &transform, outHit.t, [&](uint32_t firstTriangle, uint32_t triangleCount) {
+            for (size_t i = firstTriangle; i < firstTriangle + triangleCount; ++i) {
+                uint32_t i0 = indices[mesh.indexOffset + i * 3 + 0];
+                uint32_t i1 = indices[mesh.indexOffset + i * 3 + 1];
+                uint32_t i2 = indices[mesh.indexOffset + i * 3 + 2];
+
+                glm::vec3 v0 = vertices[mesh.vertexOffset + i0].position;
+                glm::vec3 v1 = vertices[mesh.vertexOffset + i1].position;
+                glm::vec3 v2 = vertices[mesh.vertexOffset + i2].position;
+
+                v0 = glm::vec3(transform * glm::vec4(v0, 1.f));
+                v1 = glm::vec3(transform * glm::vec4(v1, 1.f));
+                v2 = glm::vec3(transform * glm::vec4(v2, 1.f));
+
+                float t, u, v;
+                if (IntersectTriangle(ray, v0, v1, v2, t, u, v)) {
+                    if (t <= outHit.t) {
+                        hit = true;
+                        outHit.t = t;
+                        outHit.position = ray.GetOrigin() + t * ray.GetDirection();
+                        outHit.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+                        outHit.triangleIndex = static_cast<uint32_t>(i);
+                        outHit.meshIndex = 0;
+                        outHit.nodeIndex = 0;
+                    }
                 }
             }
-        }
+        });
         return hit;
     }
 
-    inline bool GetMeshIntersection2(const Ray& ray, const GenericModel& model, const GenericModel::Mesh& mesh, const glm::mat4& transform, HitInfo& outHit) {
+    // Same as GetMeshIntersection2 with an inverse transform that was already computed, e.g. by a NodeTransformCache
+    inline bool GetMeshIntersectionInverse(const Ray& ray, const GenericModel& model, const GenericModel::Mesh& mesh, const glm::mat4& invTransform, HitInfo& outHit) {
         bool hit = false;
         const auto& vertices = model.GetVertices();
         const auto& indices = model.GetIndices();
-        auto invTransform = glm::inverse(transform);
         glm::vec3 transformedDir = ray.GetTransformedDirection(invTransform);
+        // Mesh space distances are scaled by the length of the transformed direction
         float scale = glm::length(transformedDir);
-        Ray invRay(ray.GetTransformedDirection(invTransform), transformedDir);
-        for (size_t i = 0; i < mesh.indexCount / 3; ++i) {
-            uint32_t i0 = indices[mesh.indexOffset + i * 3 + 0];
-            uint32_t i1 = indices[mesh.indexOffset + i * 3 + 1];
-            uint32_t i2 = indices[mesh.indexOffset + i * 3 + 2];
-
-            glm::vec3 v0 = vertices[mesh.vertexOffset + i0].position;
-            glm::vec3 v1 = vertices[mesh.vertexOffset + i1].position;
-            glm::vec3 v2 = vertices[mesh.vertexOffset + i2].position;
-            float t, u, v;
-
-            if (IntersectTriangle(invRay, v0, v1, v2, t, u, v)) {
-                t = t * scale;
-                if (t <= outHit.t) {
+        Ray invRay(ray.GetTransformedOrigin(invTransform), transformedDir);
+        float maxT = outHit.t == std::numeric_limits<float>::max() ? outHit.t : outHit.t * scale;
+        ForEachMeshTriangleRange(invRay, model, mesh, nullptr, maxT, [&](uint32_t firstTriangle, uint32_t triangleCount) {
+            for (size_t i = firstTriangle; i < firstTriangle + triangleCount; ++i) {
+                uint32_t i0 = indices[mesh.indexOffset + i * 3 + 0];
+                uint32_t i1 = indices[mesh.indexOffset + i * 3 + 1];
+                uint32_t i2 = indices[mesh.indexOffset + i * 3 + 2];
+
+                glm::vec3 v0 = vertices[mesh.vertexOffset + i0].position;
+                glm::vec3 v1 = vertices[mesh.vertexOffset + i1].position;
+                glm::vec3 v2 = vertices[mesh.vertexOffset + i2].position;
+                float meshT, u, v;
+
+                if (IntersectTriangle(invRay, v0, v1, v2, meshT, u, v)) {
+                    float t = meshT / scale;
+                    if (t <= outHit.t) {
+                        hit = true;
+                        outHit.t = t;
+                        outHit.position = ray.GetPoint(t);
+                        outHit.normal = glm::normalize(glm::vec3(glm::transpose(invTransform) * glm::vec4(glm::cross(v1 - v0, v2 - v0), 0.f)));
+                        outHit.triangleIndex = static_cast<uint32_t>(i);
+                        outHit.meshIndex = 0;
+                        outHit.nodeIndex = 0;
+                    }
+                }
+            }
+        });
+        return hit;
+    }
+    inline bool GetMeshIntersection2(const Ray& ray, const GenericModel& model, const GenericModel::Mesh& mesh, const glm::mat4& transform, HitInfo& outHit) {
+        return GetMeshIntersectionInverse(ray, model, mesh, glm::inverse(transform), outHit);
+    }
+    // Tests triangles that were already transformed to world space, three corners per triangle in the index order of the mesh
+    inline bool GetMeshIntersectionWorld(const Ray& ray, const GenericModel& model, const GenericModel::Mesh& mesh, const glm::mat4& transform, const glm::vec3* pWorldTriangles, HitInfo& outHit) {
+        bool hit = false;
+        ForEachMeshTriangleRange(ray, model, mesh, &transform, outHit.t, [&](uint32_t firstTriangle, uint32_t triangleCount) {
+            for (size_t i = firstTriangle; i < firstTriangle + triangleCount; ++i) {
+                const glm::vec3& v0 = pWorldTriangles[i * 3 + 0];
+                const glm::vec3& v1 = pWorldTriangles[i * 3 + 1];
+                const glm::vec3& v2 = pWorldTriangles[i * 3 + 2];
+                float t, u, v;
+                if (IntersectTriangle(ray, v0, v1, v2, t, u, v) && t <= outHit.t) {
                     hit = true;
                     outHit.t = t;
-                    outHit.position = transform * glm::vec4((invRay.GetOrigin() + t * invRay.GetDirection()), 1.f);
-                    outHit.normal = glm::transpose(invTransform) * glm::vec4(glm::normalize(glm::cross(v1 - v0, v2 - v0)), 1.f);
+                    outHit.position = ray.GetPoint(t);
+                    outHit.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
                     outHit.triangleIndex = static_cast<uint32_t>(i);
                     outHit.meshIndex = 0;
-					outHit.nodeIndex = 0;
+                    outHit.nodeIndex = 0;
                 }
             }
-        }
+        });
         return hit;
     }
     inline bool GetNodeIntersection2(const Ray& ray, const GenericModel& model, const GenericModel::Node& node, HitInfo& outHit) {
@@ -280,4 +369,27 @@ namespace SGF {
         }
         return hit;
     }
-}
\ No newline at end of file
+    // Brute force over all nodes like GetModelIntersection, but without transforming anything per query.
+    // The cache has to be updated for the model, it provides world space triangles if enabled and inverse transforms otherwise.
+    inline bool GetModelIntersection(
+        const Ray& ray,
+        const GenericModel& model,
+        const NodeTransformCache& cache,
+        HitInfo& outHit) {
+        bool hit = false;
+        for (const auto& node : model.nodes) {
+            for (size_t i = 0; i < node.meshes.size(); ++i) {
+                auto& m = model.GetMesh(node, i);
+                bool meshHit = cache.IsWorldTrianglesEnabled() ?
+                    GetMeshIntersectionWorld(ray, model, m, node.globalTransform, cache.GetWorldTriangles(node.index, i), outHit) :
+                    GetMeshIntersectionInverse(ray, model, m, cache.GetInverseTransform(node.index), outHit);
+                if (meshHit) {
+                    outHit.meshIndex = node.meshes[i];
+                    outHit.nodeIndex = node.index;
+                    hit = true;
+                }
+            }
+        }
+        return hit;
+    }
+}
@@ -0,0 +1,54 @@
+#include "NodeTransformCache.hpp"
+#include "Threading/ThreadPool.hpp"
+
+namespace SGF {
+	void NodeTransformCache::SetWorldTrianglesEnabled(bool enabled) {
+		if (enabled == storeWorldTriangles) return;
+		storeWorldTriangles = enabled;
+		// Entries without triangles have to be filled on the next update
+		for (auto& entry : entries) {
+			entry.isValid = false;
+			entry.worldPositions.clear();
+			entry.worldPositions.shrink_to_fit();
+			entry.meshOffsets.clear();
+		}
+	}
+
+	bool NodeTransformCache::Update(const GenericModel& model) {
+		entries.resize(model.nodes.size());
+		std::vector<uint32_t> changedNodes;
+		for (uint32_t i = 0; i < (uint32_t)model.nodes.size(); ++i) {
+			const Entry& entry = entries[i];
+			if (!entry.isValid || entry.transformVersion != model.nodes[i].transformVersion) {
+				changedNodes.push_back(i);
+			}
+		}
+		if (changedNodes.empty()) return false;
+
+		ThreadPool::Get().ParallelFor(changedNodes.size(), [&](size_t i) {
+			const GenericModel::Node& node = model.nodes[changedNodes[i]];
+			Entry& entry = entries[node.index];
+			entry.inverseTransform = glm::inverse(node.globalTransform);
+			entry.transformVersion = node.transformVersion;
+			entry.isValid = true;
+			if (!storeWorldTriangles) return;
+			entry.meshOffsets.resize(node.meshes.size());
+			size_t positionCount = 0;
+			for (size_t slot = 0; slot < node.meshes.size(); ++slot) {
+				entry.meshOffsets[slot] = positionCount;
+				positionCount += model.meshes[node.meshes[slot]].indexCount;
+			}
+			entry.worldPositions.resize(positionCount);
+			glm::vec3* pPositions = entry.worldPositions.data();
+			for (uint32_t meshIndex : node.meshes) {
+				const auto& mesh = model.meshes[meshIndex];
+				const uint32_t* pIndices = model.indices.data() + mesh.indexOffset;
+				const GenericModel::Vertex* pVertices = model.vertices.data() + mesh.vertexOffset;
+				for (uint32_t k = 0; k < mesh.indexCount; ++k) {
+					*pPositions++ = glm::vec3(node.globalTransform * glm::vec4(pVertices[pIndices[k]].position, 1.f));
+				}
+			}
+		});
+		return true;
+	}
+}
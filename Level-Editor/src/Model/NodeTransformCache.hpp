@@ -0,0 +1,37 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+#include "Model.hpp"
+
+namespace SGF {
+	// Per node data derived from the global transform for CPU picking: the inverse transform and optionally the
+	// triangles of all meshes of the node in world space. An entry is only recomputed when the transformVersion
+	// of its node changed, which happens in GenericModel::TransformNode and TransformNodeRecursive.
+	class NodeTransformCache {
+	public:
+		// World space triangles cost 36 bytes per triangle and mesh instance, so they are off by default
+		void SetWorldTrianglesEnabled(bool enabled);
+		inline bool IsWorldTrianglesEnabled() const { return storeWorldTriangles; }
+		// Recomputes the entries of moved or new nodes, returns true if any entry changed
+		bool Update(const GenericModel& model);
+		inline void Clear() { entries.clear(); }
+
+		inline const glm::mat4& GetInverseTransform(uint32_t nodeIndex) const { return entries[nodeIndex].inverseTransform; }
+		// Three corners per triangle of the mesh at node.meshes[meshSlot], in the index order of the mesh
+		inline const glm::vec3* GetWorldTriangles(uint32_t nodeIndex, size_t meshSlot) const {
+			const Entry& entry = entries[nodeIndex];
+			return entry.worldPositions.data() + entry.meshOffsets[meshSlot];
+		}
+	private:
+		struct Entry {
+			glm::mat4 inverseTransform;
+			std::vector<glm::vec3> worldPositions;
+			// First world position of every mesh slot
+			std::vector<size_t> meshOffsets;
+			uint32_t transformVersion = 0;
+			bool isValid = false;
+		};
+		std::vector<Entry> entries;
+		bool storeWorldTriangles = false;
+	};
+}
@@ -0,0 +1,247 @@
+#include "TrianglePacket.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRIANGLE_PACKET_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles intrinsics of every instruction set without flags, GCC and Clang need them enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TRIANGLE_PACKET_TARGET(isa)
+#else
+#define TRIANGLE_PACKET_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace SGF {
+	namespace {
+		constexpr float EPSILON = 1e-8f;
+
+		using IntersectPacketFunc = int(*)(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t);
+
+		// Picks the closest of the lanes set in hitMask, pT holds the distance of every lane
+		inline int SelectClosestLane(uint32_t hitMask, const float* pT, float& t) {
+			int closestLane = -1;
+			while (hitMask != 0) {
+				int lane = 0;
+				while ((hitMask & (1u << lane)) == 0) lane++;
+				hitMask &= ~(1u << lane);
+				if (pT[lane] <= t) {
+					t = pT[lane];
+					closestLane = lane;
+				}
+			}
+			return closestLane;
+		}
+
+		// Same math as IntersectTriangle in ModelSelectionCPU.hpp, one triangle at a time
+		int IntersectPacketScalar(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t) {
+			constexpr uint32_t WIDTH = 4;
+			int closestLane = -1;
+			for (uint32_t lane = 0; lane < WIDTH; ++lane) {
+				glm::vec3 v0(pPacket[0 * WIDTH + lane], pPacket[1 * WIDTH + lane], pPacket[2 * WIDTH + lane]);
+				glm::vec3 edge1(pPacket[3 * WIDTH + lane], pPacket[4 * WIDTH + lane], pPacket[5 * WIDTH + lane]);
+				glm::vec3 edge2(pPacket[6 * WIDTH + lane], pPacket[7 * WIDTH + lane], pPacket[8 * WIDTH + lane]);
+				glm::vec3 pvec = glm::cross(direction, edge2);
+				float det = glm::dot(edge1, pvec);
+				if (fabs(det) < EPSILON) continue;
+				float invDet = 1.0f / det;
+				glm::vec3 tvec = origin - v0;
+				float u = glm::dot(tvec, pvec) * invDet;
+				if (u < 0.0f || u > 1.0f) continue;
+				glm::vec3 qvec = glm::cross(tvec, edge1);
+				float v = glm::dot(direction, qvec) * invDet;
+				if (v < 0.0f || u + v > 1.0f) continue;
+				float triangleT = glm::dot(edge2, qvec) * invDet;
+				if (triangleT < EPSILON || triangleT > t) continue;
+				t = triangleT;
+				closestLane = (int)lane;
+			}
+			return closestLane;
+		}
+
+#ifdef TRIANGLE_PACKET_X86
+		TRIANGLE_PACKET_TARGET("sse2")
+		int IntersectPacketSSE(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t) {
+			constexpr uint32_t WIDTH = 4;
+			const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+			const __m128 e1x = _mm_loadu_ps(pPacket + 3 * WIDTH), e1y = _mm_loadu_ps(pPacket + 4 * WIDTH), e1z = _mm_loadu_ps(pPacket + 5 * WIDTH);
+			const __m128 e2x = _mm_loadu_ps(pPacket + 6 * WIDTH), e2y = _mm_loadu_ps(pPacket + 7 * WIDTH), e2z = _mm_loadu_ps(pPacket + 8 * WIDTH);
+			// pvec = cross(direction, edge2)
+			const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+			const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+			const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+			const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			const __m128 epsilon = _mm_set1_ps(EPSILON);
+			__m128 mask = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), det), epsilon);
+			if (_mm_movemask_ps(mask) == 0) return -1;
+			const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+			// tvec = origin - v0
+			const __m128 tx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(pPacket + 0 * WIDTH));
+			const __m128 ty = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(pPacket + 1 * WIDTH));
+			const __m128 tz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(pPacket + 2 * WIDTH));
+			const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+			// qvec = cross(tvec, edge1)
+			const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(e1y, tz));
+			const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(e1z, tx));
+			const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(e1x, ty));
+			const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+			const __m128 triangleT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(triangleT, epsilon), _mm_cmple_ps(triangleT, _mm_set1_ps(t))));
+			const uint32_t hitMask = (uint32_t)_mm_movemask_ps(mask);
+			if (hitMask == 0) return -1;
+			float triangleTs[WIDTH];
+			_mm_storeu_ps(triangleTs, triangleT);
+			return SelectClosestLane(hitMask, triangleTs, t);
+		}
+
+		TRIANGLE_PACKET_TARGET("avx2")
+		int IntersectPacketAVX2(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t) {
+			constexpr uint32_t WIDTH = 8;
+			const __m256 dx = _mm256_set1_ps(direction.x), dy = _mm256_set1_ps(direction.y), dz = _mm256_set1_ps(direction.z);
+			const __m256 e1x = _mm256_loadu_ps(pPacket + 3 * WIDTH), e1y = _mm256_loadu_ps(pPacket + 4 * WIDTH), e1z = _mm256_loadu_ps(pPacket + 5 * WIDTH);
+			const __m256 e2x = _mm256_loadu_ps(pPacket + 6 * WIDTH), e2y = _mm256_loadu_ps(pPacket + 7 * WIDTH), e2z = _mm256_loadu_ps(pPacket + 8 * WIDTH);
+			const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+			const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+			const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+			const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+			const __m256 epsilon = _mm256_set1_ps(EPSILON);
+			__m256 mask = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), det), epsilon, _CMP_GE_OQ);
+			if (_mm256_movemask_ps(mask) == 0) return -1;
+			const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+			const __m256 tx = _mm256_sub_ps(_mm256_set1_ps(origin.x), _mm256_loadu_ps(pPacket + 0 * WIDTH));
+			const __m256 ty = _mm256_sub_ps(_mm256_set1_ps(origin.y), _mm256_loadu_ps(pPacket + 1 * WIDTH));
+			const __m256 tz = _mm256_sub_ps(_mm256_set1_ps(origin.z), _mm256_loadu_ps(pPacket + 2 * WIDTH));
+			const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), invDet);
+			const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+			mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+			const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(e1y, tz));
+			const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(e1z, tx));
+			const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(e1x, ty));
+			const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+			mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+			const __m256 triangleT = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+			mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(triangleT, epsilon, _CMP_GE_OQ), _mm256_cmp_ps(triangleT, _mm256_set1_ps(t), _CMP_LE_OQ)));
+			const uint32_t hitMask = (uint32_t)_mm256_movemask_ps(mask);
+			if (hitMask == 0) return -1;
+			float triangleTs[WIDTH];
+			_mm256_storeu_ps(triangleTs, triangleT);
+			return SelectClosestLane(hitMask, triangleTs, t);
+		}
+
+		TRIANGLE_PACKET_TARGET("avx512f")
+		int IntersectPacketAVX512(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t) {
+			constexpr uint32_t WIDTH = 16;
+			const __m512 dx = _mm512_set1_ps(direction.x), dy = _mm512_set1_ps(direction.y), dz = _mm512_set1_ps(direction.z);
+			const __m512 e1x = _mm512_loadu_ps(pPacket + 3 * WIDTH), e1y = _mm512_loadu_ps(pPacket + 4 * WIDTH), e1z = _mm512_loadu_ps(pPacket + 5 * WIDTH);
+			const __m512 e2x = _mm512_loadu_ps(pPacket + 6 * WIDTH), e2y = _mm512_loadu_ps(pPacket + 7 * WIDTH), e2z = _mm512_loadu_ps(pPacket + 8 * WIDTH);
+			const __m512 px = _mm512_sub_ps(_mm512_mul_ps(dy, e2z), _mm512_mul_ps(e2y, dz));
+			const __m512 py = _mm512_sub_ps(_mm512_mul_ps(dz, e2x), _mm512_mul_ps(e2z, dx));
+			const __m512 pz = _mm512_sub_ps(_mm512_mul_ps(dx, e2y), _mm512_mul_ps(e2x, dy));
+			const __m512 det = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e1x, px), _mm512_mul_ps(e1y, py)), _mm512_mul_ps(e1z, pz));
+			const __m512 epsilon = _mm512_set1_ps(EPSILON);
+			__mmask16 mask = _mm512_cmp_ps_mask(_mm512_abs_ps(det), epsilon, _CMP_GE_OQ);
+			if (mask == 0) return -1;
+			const __m512 invDet = _mm512_div_ps(_mm512_set1_ps(1.0f), det);
+			const __m512 tx = _mm512_sub_ps(_mm512_set1_ps(origin.x), _mm512_loadu_ps(pPacket + 0 * WIDTH));
+			const __m512 ty = _mm512_sub_ps(_mm512_set1_ps(origin.y), _mm512_loadu_ps(pPacket + 1 * WIDTH));
+			const __m512 tz = _mm512_sub_ps(_mm512_set1_ps(origin.z), _mm512_loadu_ps(pPacket + 2 * WIDTH));
+			const __m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(tx, px), _mm512_mul_ps(ty, py)), _mm512_mul_ps(tz, pz)), invDet);
+			const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+			mask = _mm512_mask_cmp_ps_mask(mask, u, zero, _CMP_GE_OQ);
+			mask = _mm512_mask_cmp_ps_mask(mask, u, one, _CMP_LE_OQ);
+			const __m512 qx = _mm512_sub_ps(_mm512_mul_ps(ty, e1z), _mm512_mul_ps(e1y, tz));
+			const __m512 qy = _mm512_sub_ps(_mm512_mul_ps(tz, e1x), _mm512_mul_ps(e1z, tx));
+			const __m512 qz = _mm512_sub_ps(_mm512_mul_ps(tx, e1y), _mm512_mul_ps(e1x, ty));
+			const __m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, qx), _mm512_mul_ps(dy, qy)), _mm512_mul_ps(dz, qz)), invDet);
+			mask = _mm512_mask_cmp_ps_mask(mask, v, zero, _CMP_GE_OQ);
+			mask = _mm512_mask_cmp_ps_mask(mask, _mm512_add_ps(u, v), one, _CMP_LE_OQ);
+			const __m512 triangleT = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e2x, qx), _mm512_mul_ps(e2y, qy)), _mm512_mul_ps(e2z, qz)), invDet);
+			mask = _mm512_mask_cmp_ps_mask(mask, triangleT, epsilon, _CMP_GE_OQ);
+			mask = _mm512_mask_cmp_ps_mask(mask, triangleT, _mm512_set1_ps(t), _CMP_LE_OQ);
+			if (mask == 0) return -1;
+			float triangleTs[WIDTH];
+			_mm512_storeu_ps(triangleTs, triangleT);
+			return SelectClosestLane((uint32_t)mask, triangleTs, t);
+		}
+
+		TriangleKernel DetectTriangleKernel() {
+#if defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+			__cpuid(info, 1);
+			const bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+			// The OS has to save the wide registers on context switches
+			const bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+			const uint64_t xcr0 = hasOSXSAVE ? _xgetbv(0) : 0;
+			bool hasAVX2 = false, hasAVX512 = false;
+			if (maxLeaf >= 7) {
+				__cpuidex(info, 7, 0);
+				hasAVX2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x06) == 0x06;
+				hasAVX512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+			}
+#else
+			__builtin_cpu_init();
+			const bool hasSSE2 = __builtin_cpu_supports("sse2");
+			const bool hasAVX2 = __builtin_cpu_supports("avx2");
+			const bool hasAVX512 = __builtin_cpu_supports("avx512f");
+#endif
+			if (hasAVX512) return TriangleKernel::AVX512;
+			if (hasAVX2) return TriangleKernel::AVX2;
+			if (hasSSE2) return TriangleKernel::SSE;
+			return TriangleKernel::SCALAR;
+		}
+#else
+		TriangleKernel DetectTriangleKernel() {
+			return TriangleKernel::SCALAR;
+		}
+#endif
+
+		struct KernelInfo {
+			TriangleKernel kernel;
+			uint32_t packetWidth;
+			IntersectPacketFunc pIntersect;
+		};
+		const KernelInfo& GetKernelInfo() {
+			static const KernelInfo info = []() -> KernelInfo {
+				TriangleKernel kernel = DetectTriangleKernel();
+				switch (kernel) {
+#ifdef TRIANGLE_PACKET_X86
+				case TriangleKernel::AVX512: return { kernel, 16, IntersectPacketAVX512 };
+				case TriangleKernel::AVX2: return { kernel, 8, IntersectPacketAVX2 };
+				case TriangleKernel::SSE: return { kernel, 4, IntersectPacketSSE };
+#endif
+				default: return { TriangleKernel::SCALAR, 4, IntersectPacketScalar };
+				}
+			}();
+			return info;
+		}
+	}
+
+	TriangleKernel GetTriangleKernel() {
+		return GetKernelInfo().kernel;
+	}
+
+	const char* GetTriangleKernelName(TriangleKernel kernel) {
+		switch (kernel) {
+		case TriangleKernel::SSE: return "SSE";
+		case TriangleKernel::AVX2: return "AVX2";
+		case TriangleKernel::AVX512: return "AVX-512";
+		default: return "Scalar";
+		}
+	}
+
+	uint32_t GetTrianglePacketWidth() {
+		return GetKernelInfo().packetWidth;
+	}
+
+	int IntersectTrianglePacket(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t) {
+		return GetKernelInfo().pIntersect(pPacket, origin, direction, t);
+	}
+}
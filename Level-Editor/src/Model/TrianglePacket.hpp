@@ -0,0 +1,42 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+
+namespace SGF {
+	// Widest packet any kernel tests at once
+	constexpr uint32_t MAX_TRIANGLE_PACKET_WIDTH = 16;
+
+	enum class TriangleKernel {
+		SCALAR,
+		SSE,
+		AVX2,
+		AVX512
+	};
+	// Widest kernel the CPU supports, detected once on first use
+	TriangleKernel GetTriangleKernel();
+	const char* GetTriangleKernelName(TriangleKernel kernel);
+	// Number of triangles in a packet of the selected kernel: 4, 8 or 16
+	uint32_t GetTrianglePacketWidth();
+
+	// A packet stores its triangles as structure of arrays, 9 rows of width floats:
+	// v0.x, v0.y, v0.z, edge1.x, edge1.y, edge1.z, edge2.x, edge2.y, edge2.z.
+	// Unused lanes must stay zero, their degenerate triangles never hit.
+	constexpr uint32_t TRIANGLE_PACKET_ROWS = 9;
+	inline void WriteTrianglePacketLane(float* pPacket, uint32_t width, uint32_t lane, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
+		const glm::vec3 rows[3] = { v0, v1 - v0, v2 - v0 };
+		for (uint32_t row = 0; row < 3; ++row) {
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				pPacket[(row * 3 + axis) * width + lane] = rows[row][axis];
+			}
+		}
+	}
+	inline glm::vec3 GetTrianglePacketNormal(const float* pPacket, uint32_t width, uint32_t lane) {
+		glm::vec3 edge1(pPacket[3 * width + lane], pPacket[4 * width + lane], pPacket[5 * width + lane]);
+		glm::vec3 edge2(pPacket[6 * width + lane], pPacket[7 * width + lane], pPacket[8 * width + lane]);
+		return glm::cross(edge1, edge2);
+	}
+
+	// Moeller-Trumbore against every triangle of a packet of GetTrianglePacketWidth() lanes with the selected kernel.
+	// Returns the lane of the closest hit closer than t and writes its distance to t, or -1 if nothing was hit.
+	int IntersectTrianglePacket(const float* pPacket, const glm::vec3& origin, const glm::vec3& direction, float& t);
+}
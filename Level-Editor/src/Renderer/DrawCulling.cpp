@@ -0,0 +1,123 @@
+#include "DrawCulling.hpp"
+#include "Model/Meshlets.hpp"
+#include <algorithm>
+#include <tuple>
+
+namespace SGF {
+    namespace {
+        // Test candidates are centered in a cube of this half extent around the origin
+        constexpr float CULL_TEST_EXTENT = 50.f;
+        // Spheres touching a plane closer than this are left out of the test candidates
+        constexpr float CULL_TEST_PLANE_MARGIN = 1e-3f;
+
+        inline auto TieDraw(const VkDrawIndexedIndirectCommand& draw) {
+            return std::tie(draw.firstIndex, draw.indexCount, draw.vertexOffset, draw.firstInstance, draw.instanceCount);
+        }
+    }
+
+    void AppendCullCandidates(const GenericModel& model, std::vector<CullCandidate>& candidates) {
+        for (const auto& node : model.nodes) {
+            for (size_t i = 0; i < node.meshes.size(); ++i) {
+                const auto& mesh = model.GetMesh(node, i);
+                glm::vec3 center = (mesh.boundingBox.min + mesh.boundingBox.max) * 0.5f;
+                float radius = glm::length(mesh.boundingBox.max - mesh.boundingBox.min) * 0.5f;
+                CullCandidate candidate{};
+                candidate.sphere = TransformBoundingSphere(node.globalTransform, glm::vec4(center, radius));
+                candidate.indexCount = mesh.indexCount;
+                candidate.firstIndex = mesh.indexOffset;
+                candidate.vertexOffset = (int32_t)mesh.vertexOffset;
+                candidate.firstInstance = node.index;
+                candidates.push_back(candidate);
+            }
+        }
+    }
+
+    uint32_t CullCandidatesCPU(const CullCandidate* pCandidates, uint32_t candidateCount, const Frustum& frustum,
+        VkDrawIndexedIndirectCommand* pOutput, uint32_t* pCounters) {
+        uint32_t visibleCount = 0;
+        for (uint32_t i = 0; i < candidateCount; ++i) {
+            const auto& candidate = pCandidates[i];
+            if (!frustum.IsSphereVisible(glm::vec3(candidate.sphere), candidate.sphere.w)) continue;
+            uint32_t slot = pCounters[candidate.counterIndex]++;
+            pOutput[candidate.outputOffset + slot] = { candidate.indexCount, 1, candidate.firstIndex, candidate.vertexOffset, candidate.firstInstance };
+            ++visibleCount;
+        }
+        return visibleCount;
+    }
+
+    void CreateCullTestCandidates(const Frustum& frustum, uint32_t modelCount, uint32_t candidatesPerModel, std::vector<CullCandidate>& candidates) {
+        // Linear congruential generator, every run tests the same candidates
+        uint32_t state = 12345;
+        auto next = [&state]() {
+            state = state * 1664525u + 1013904223u;
+            return (float)(state >> 8) / (float)(1u << 24);
+        };
+        for (uint32_t model = 0; model < modelCount; ++model) {
+            const uint32_t outputOffset = (uint32_t)candidates.size();
+            for (uint32_t i = 0; i < candidatesPerModel; ++i) {
+                glm::vec3 center = (glm::vec3(next(), next(), next()) * 2.f - 1.f) * CULL_TEST_EXTENT;
+                float radius = 0.1f + next() * 4.f;
+                bool isAmbiguous = false;
+                for (uint32_t plane = 0; plane < Frustum::PLANE_COUNT; ++plane) {
+                    isAmbiguous |= std::abs(frustum.GetDistance((Frustum::Plane)plane, center) + radius) < CULL_TEST_PLANE_MARGIN;
+                }
+                if (isAmbiguous) continue;
+                CullCandidate candidate{};
+                candidate.sphere = glm::vec4(center, radius);
+                candidate.indexCount = 3 * (i + 1);
+                // Unique, so every draw can be told apart
+                candidate.firstIndex = (uint32_t)candidates.size();
+                candidate.vertexOffset = (int32_t)model;
+                candidate.firstInstance = i;
+                candidate.outputOffset = outputOffset;
+                candidate.counterIndex = model;
+                candidates.push_back(candidate);
+            }
+        }
+    }
+
+    bool CompareCulledDraws(const CullCandidate* pCandidates, uint32_t candidateCount, const Frustum& frustum,
+        const VkDrawIndexedIndirectCommand* pDraws, const uint32_t* pCounters, uint32_t counterCount) {
+        std::vector<VkDrawIndexedIndirectCommand> expectedDraws(candidateCount);
+        std::vector<uint32_t> expectedCounters(counterCount, 0);
+        CullCandidatesCPU(pCandidates, candidateCount, frustum, expectedDraws.data(), expectedCounters.data());
+
+        std::vector<uint32_t> rangeOffsets(counterCount, UINT32_MAX);
+        std::vector<uint32_t> rangeSizes(counterCount, 0);
+        for (uint32_t i = 0; i < candidateCount; ++i) {
+            const auto& candidate = pCandidates[i];
+            assert(candidate.counterIndex < counterCount);
+            rangeOffsets[candidate.counterIndex] = std::min(rangeOffsets[candidate.counterIndex], candidate.outputOffset);
+            ++rangeSizes[candidate.counterIndex];
+        }
+
+        auto isLess = [](const VkDrawIndexedIndirectCommand& a, const VkDrawIndexedIndirectCommand& b) { return TieDraw(a) < TieDraw(b); };
+        std::vector<VkDrawIndexedIndirectCommand> visibleDraws;
+        for (uint32_t counter = 0; counter < counterCount; ++counter) {
+            if (pCounters[counter] != expectedCounters[counter]) {
+                SGF::Log::Error("Culling counter {}: the GPU found {} visible draws, the CPU reference {}", counter, pCounters[counter], expectedCounters[counter]);
+                return false;
+            }
+            if (rangeSizes[counter] == 0) continue;
+            const uint32_t offset = rangeOffsets[counter];
+            const uint32_t visibleCount = expectedCounters[counter];
+            visibleDraws.assign(pDraws + offset, pDraws + offset + visibleCount);
+            std::sort(visibleDraws.begin(), visibleDraws.end(), isLess);
+            std::sort(expectedDraws.begin() + offset, expectedDraws.begin() + offset + visibleCount, isLess);
+            for (uint32_t i = 0; i < visibleCount; ++i) {
+                if (TieDraw(visibleDraws[i]) != TieDraw(expectedDraws[offset + i])) {
+                    SGF::Log::Error("Culling counter {}: the GPU draw of first index {} differs from the CPU reference draw of first index {}", counter,
+                        visibleDraws[i].firstIndex, expectedDraws[offset + i].firstIndex);
+                    return false;
+                }
+            }
+            for (uint32_t i = visibleCount; i < rangeSizes[counter]; ++i) {
+                if (pDraws[offset + i].indexCount != 0) {
+                    SGF::Log::Error("Culling counter {}: draw {} behind the visible ones is not empty", counter, i);
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <SGF.hpp>
+#include "Model/Model.hpp"
+
+namespace SGF {
+    // One full mesh of a node, read by shaders/cull_draws.comp
+    struct CullCandidate {
+        // World space bounding sphere
+        glm::vec4 sphere;
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t firstInstance;
+        // First command of the range of the model in the output buffer
+        uint32_t outputOffset;
+        // Counter of visible draws of the model
+        uint32_t counterIndex;
+        uint32_t padding[2];
+    };
+    static_assert(sizeof(CullCandidate) == 48, "Has to match the std430 layout of the shader");
+
+    // Candidates for every mesh of every node in the current node transforms, outputOffset and counterIndex are left 0
+    void AppendCullCandidates(const GenericModel& model, std::vector<CullCandidate>& candidates);
+
+    // CPU reference of shaders/cull_draws.comp. Visible candidates are written to the front of the range of their model and
+    // counted in pCounters, which have to be zero. The shader writes the same draws per model, in any order.
+    // Returns the number of visible candidates.
+    uint32_t CullCandidatesCPU(const CullCandidate* pCandidates, uint32_t candidateCount, const Frustum& frustum,
+        VkDrawIndexedIndirectCommand* pOutput, uint32_t* pCounters);
+
+    // Fixed inputs of ModelRenderer::RunCullSelfTest: candidatesPerModel pseudo random spheres in and around the frustum for
+    // each of modelCount models, which get consecutive ranges and counters. Spheres within a small distance of a plane are
+    // left out, the GPU may round them to either side.
+    void CreateCullTestCandidates(const Frustum& frustum, uint32_t modelCount, uint32_t candidatesPerModel, std::vector<CullCandidate>& candidates);
+    // Compares culled draws and counters written by shaders/cull_draws.comp with CullCandidatesCPU on the same candidates.
+    // The draws of a model may be in any order, slots behind its visible draws have to be zero.
+    // Logs the first difference and returns false if there is one.
+    bool CompareCulledDraws(const CullCandidate* pCandidates, uint32_t candidateCount, const Frustum& frustum,
+        const VkDrawIndexedIndirectCommand* pDraws, const uint32_t* pCounters, uint32_t counterCount);
+}
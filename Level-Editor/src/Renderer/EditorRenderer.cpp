@@ -10,6 +10,7 @@ namespace SGF {
 			Vk::CreateDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2* SGF_FRAMES_IN_FLIGHT), // Camera and Bone transforms
 			Vk::CreateDescriptorPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, SGF_FRAMES_IN_FLIGHT * 128),
 			Vk::CreateDescriptorPoolSize(VK_DESCRIPTOR_TYPE_SAMPLER, SGF_FRAMES_IN_FLIGHT),
+			Vk::CreateDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * SGF_FRAMES_IN_FLIGHT), // Node data of indirect draws and the culling buffers
 			Vk::CreateDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
 		};
 		descriptorPool = device.CreateDescriptorPool(20, poolSizes);
@@ -34,6 +35,9 @@ namespace SGF {
 			device.UpdateDescriptors(writes);
 		}
 		modelRenderer.Initialize(viewport.GetRenderPass(), 0, descriptorPool, uniformLayout);
+#ifdef SGF_ENABLE_VALIDATION
+		modelRenderer.RunCullSelfTest();
+#endif
 
 		modelPickBuffer = device.CreateBuffer(sizeof(uint32_t) * SGF_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 		modelPickMemory = device.AllocateMemory(modelPickBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
@@ -47,6 +51,11 @@ namespace SGF {
                 uniformLayout,
 				modelRenderer.GetTextureDescriptorSetLayout()
             };
+            VkDescriptorSetLayout indirectDescriptorLayouts[] = {
+                uniformLayout,
+				modelRenderer.GetTextureDescriptorSetLayout(),
+				modelRenderer.GetNodeDataDescriptorSetLayout()
+            };
             VkDescriptorSetLayout skeletalDescriptorLayouts[] = {
                 uniformLayout,
 				modelRenderer.GetTextureDescriptorSetLayout(),
@@ -66,6 +75,12 @@ namespace SGF {
 			outlineLayout = device.CreatePipelineLayout(staticDescriptorLayouts);
 			skeletalRenderPipelineLayout = device.CreatePipelineLayout(skeletalDescriptorLayouts, pushConstantRanges);
 			skeletalOutlinePipelineLayout = device.CreatePipelineLayout(skeletalDescriptorLayouts);
+
+			// Colour, pick id and transparency come from the node data, only its first index is pushed
+			VkPushConstantRange indirectPushConstantRanges[] = {
+				{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t) }
+			};
+			indirectRenderPipelineLayout = device.CreatePipelineLayout(indirectDescriptorLayouts, indirectPushConstantRanges);
         }
 		staticRenderPipeline = device.CreateGraphicsPipeline(staticRenderPipelineLayout, viewport.GetRenderPass(), 0)
             .FragmentShader("shaders/model.frag").VertexShader("shaders/model.vert").VertexInput(modelRenderer.GetStaticModelVertexInput())
@@ -74,6 +89,9 @@ namespace SGF {
             .FragmentShader("shaders/outline.frag").VertexShader("shaders/outline.vert").VertexInput(modelRenderer.GetStaticModelVertexInput())
             .DynamicState(VK_DYNAMIC_STATE_VIEWPORT).DynamicState(VK_DYNAMIC_STATE_SCISSOR).Depth(true, false, VK_COMPARE_OP_LESS_OR_EQUAL).AddColorBlendAttachment(false, 0)
 			.FrontFace(VK_FRONT_FACE_CLOCKWISE).Build();
+		indirectRenderPipeline = device.CreateGraphicsPipeline(indirectRenderPipelineLayout, viewport.GetRenderPass(), 0)
+            .FragmentShader("shaders/model_indirect.frag").VertexShader("shaders/model_indirect.vert").VertexInput(modelRenderer.GetStaticModelVertexInput())
+            .DynamicState(VK_DYNAMIC_STATE_VIEWPORT).DynamicState(VK_DYNAMIC_STATE_SCISSOR).Depth(true, true).AddColorBlendAttachment(false, VK_COLOR_COMPONENT_R_BIT).Build();
 		skeletalRenderPipeline = device.CreateGraphicsPipeline(skeletalRenderPipelineLayout, viewport.GetRenderPass(), 0)
 			.FragmentShader("shaders/model.frag").VertexShader("shaders/model_skeletal.vert").VertexInput(modelRenderer.GetSkeletalModelVertexInput())
 			.DynamicState(VK_DYNAMIC_STATE_VIEWPORT).DynamicState(VK_DYNAMIC_STATE_SCISSOR).Depth(true, true).AddColorBlendAttachment(false, VK_COLOR_COMPONENT_R_BIT).Build();
@@ -86,8 +104,8 @@ namespace SGF {
 	EditorRenderer::~EditorRenderer() {
 		auto& device = Device::Get();
 		device.Destroy(sampler, signalSemaphore, descriptorPool, uniformLayout, staticRenderPipelineLayout, 
-			skeletalRenderPipelineLayout, outlineLayout, skeletalOutlinePipelineLayout, 
-			skeletalRenderPipeline, staticRenderPipeline, skeletalOutlinePipeline, outlinePipeline, modelPickBuffer, modelPickMemory);
+			skeletalRenderPipelineLayout, outlineLayout, skeletalOutlinePipelineLayout, indirectRenderPipelineLayout,
+			skeletalRenderPipeline, staticRenderPipeline, indirectRenderPipeline, skeletalOutlinePipeline, outlinePipeline, modelPickBuffer, modelPickMemory);
 	}
 	void EditorRenderer::BeginFrame(RenderEvent& event, const glm::mat4& viewProj) {
 		VkClearValue clearValues[] = {
@@ -103,9 +121,12 @@ namespace SGF {
 		c.Begin();
 		hoverValue = modelPickMapped[imageIndex];
 		uniformBuffer.SetValueAt(imageIndex, viewProj);
-		c.BeginRenderPass(viewport.GetRenderPass(), viewport.GetFramebuffer(), renderArea, clearValues, ARRAY_SIZE(clearValues), VK_SUBPASS_CONTENTS_INLINE);
 		modelRenderer.PrepareDrawing(imageIndex);
-
+		modelRenderer.SetView(viewProj, (float)renderArea.extent.height, lodPixelError);
+		modelRenderer.SetMeshletCullFlags(isMeshletCullingEnabled ? MESHLET_CULL_FRUSTUM | MESHLET_CULL_BACKFACE : 0);
+		// Compute work is not allowed inside of the render pass
+		modelRenderer.CullDraws(c);
+		c.BeginRenderPass(viewport.GetRenderPass(), viewport.GetFramebuffer(), renderArea, clearValues, ARRAY_SIZE(clearValues), VK_SUBPASS_CONTENTS_INLINE);
 	}
 
 	void EditorRenderer::EndFrame(RenderEvent& event, glm::uvec2 pixelPos) {
@@ -219,16 +240,48 @@ namespace SGF {
 			}
 		}
 	}
+	bool EditorRenderer::DrawModelIndirect(const GenericModel& model, uint32_t modelIndex, const glm::vec4& colorModifier, float transparency,
+		const GenericModel::Node* pHighlightedNode, const glm::vec4& highlightColor) {
+		auto& c = commands[imageIndex];
+		uint32_t firstNode;
+		ModelRenderer::NodeDrawData* pNodes = modelRenderer.AllocateNodeDrawData(model, &firstNode);
+		if (pNodes == nullptr) return false;
+		if (!modelRenderer.BindBuffersToModel(c, model)) return true;
+		for (uint32_t i = 0; i < model.nodes.size(); ++i) {
+			pNodes[i].colorModifier = colorModifier;
+			pNodes[i].pickID = CursorHover(modelIndex, i).ToInt();
+			pNodes[i].transparency = transparency;
+		}
+		if (pHighlightedNode != nullptr) {
+			HighlightNodeRecursive(model, *pHighlightedNode, highlightColor, pNodes);
+		}
+		vkCmdPushConstants(c, indirectRenderPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &firstNode);
+		modelRenderer.DrawModelIndirect(c, model);
+		return true;
+	}
+	void EditorRenderer::HighlightNodeRecursive(const GenericModel& model, const GenericModel::Node& node, const glm::vec4& highlightColor, ModelRenderer::NodeDrawData* pNodes) const {
+		pNodes[node.index].colorModifier = highlightColor;
+		for (uint32_t n : node.children) {
+			HighlightNodeRecursive(model, model.GetNode(n), highlightColor, pNodes);
+		}
+	}
+	// The outline pipelines draw the back faces
 	void EditorRenderer::DrawNodeOutline(const GenericModel& model, const GenericModel::Node& selectedNode) {
 		VkCommandBuffer c = commands[imageIndex];
 		if (modelRenderer.BindBuffersToModel(c, model)) {
+			uint32_t cullFlags = modelRenderer.GetMeshletCullFlags();
+			modelRenderer.SetMeshletCullFlags(cullFlags & ~MESHLET_CULL_BACKFACE);
 			modelRenderer.DrawNodeRecursive(c, model, selectedNode);
+			modelRenderer.SetMeshletCullFlags(cullFlags);
 		}
 	}
 	void EditorRenderer::DrawModelOutline(const GenericModel& model) {
 		VkCommandBuffer c = commands[imageIndex];
 		if (modelRenderer.BindBuffersToModel(c, model)) {
+			uint32_t cullFlags = modelRenderer.GetMeshletCullFlags();
+			modelRenderer.SetMeshletCullFlags(cullFlags & ~MESHLET_CULL_BACKFACE);
 			modelRenderer.DrawModel(c, model);
+			modelRenderer.SetMeshletCullFlags(cullFlags);
 		}
 	}
     void EditorRenderer::DrawGrid() {
@@ -264,6 +317,13 @@ namespace SGF {
         vkCmdSetScissor(c, 0, 1, &scissor);
 	}
 
+	void EditorRenderer::BindIndirectRenderPipeline() {
+		auto& c = commands[imageIndex];
+		BindStaticPipeline(indirectRenderPipeline, indirectRenderPipelineLayout);
+		VkDescriptorSet nodeData = modelRenderer.GetNodeDataDescriptorSet(imageIndex);
+		vkCmdBindDescriptorSets(c, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectRenderPipelineLayout, 2, 1, &nodeData, 0, nullptr);
+	}
+
 	void EditorRenderer::BindSkeletalPipeline(VkPipeline pipeline, VkPipelineLayout layout) {
 		auto& c = commands[imageIndex];
 		VkDescriptorSet sets[] = {
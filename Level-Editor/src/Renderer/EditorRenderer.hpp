@@ -30,19 +30,40 @@ namespace SGF {
 		inline const CommandList& GetCurrentCommandBuffer() const { return commands[imageIndex]; }
 
 		inline void AddModel(const GenericModel& model) { modelRenderer.UploadModel(model); }
+		inline void RemoveModel(const GenericModel& model) { modelRenderer.RemoveModel(model); }
+		inline void CompactGeometry() { modelRenderer.CompactGeometry(); }
+		inline const GeometryArena& GetGeometryArena() const { return modelRenderer.GetGeometryArena(); }
+		inline void UpdateModelTextures(const GenericModel& model) { modelRenderer.UpdateModelTextures(model); }
 		inline void UpdateInstanceTransforms(const GenericModel& model) { modelRenderer.UpdateInstanceTransforms(model); }
 	    inline void UpdateBoneTransforms(const GenericModel& model, const std::vector<glm::mat4>& boneTransforms) { modelRenderer.UpdateBoneTransforms(model, boneTransforms); }
+	    inline glm::mat4* GetBoneTransformsPointer(const GenericModel& model) { return modelRenderer.GetBoneTransformsPointer(model); }
         void BeginFrame(RenderEvent& event, const glm::mat4& viewProj);
 		void EndFrame(RenderEvent& event, glm::uvec2 pixelPos);
         inline void BindStaticRenderPipeline() { BindStaticPipeline(staticRenderPipeline, staticRenderPipelineLayout); };
         inline void BindOutlinePipeline() { BindStaticPipeline(outlinePipeline, outlineLayout); }
         inline void BindSkeletalRenderPipeline() { BindSkeletalPipeline(skeletalRenderPipeline, skeletalRenderPipelineLayout); }
         inline void BindSkeletalOutlinePipeline() { BindSkeletalPipeline(skeletalOutlinePipeline, skeletalOutlinePipelineLayout); }
+        // Static models drawn with DrawModelIndirect, needs IsIndirectDrawSupported
+        void BindIndirectRenderPipeline();
+        inline bool IsIndirectDrawSupported() const { return modelRenderer.IsIndirectDrawSupported(); }
         inline uint32_t GetTotalIndexCount() const { return modelRenderer.GetTotalIndexCount(); }
         inline uint32_t GetTotalVertexCount() const { return modelRenderer.GetTotalVertexCount(); }
         inline uint32_t GetTextureCount() const { return modelRenderer.GetTextureCount(); }
         inline size_t GetTotalDeviceMemoryUsed() const { return modelRenderer.GetTotalDeviceMemoryUsed(); }
         inline size_t GetTotalDeviceMemoryAllocated() const { return modelRenderer.GetTotalDeviceMemoryAllocated(); }
+        // Projected error in pixels up to which mesh LODs are drawn, 0 disables the LODs
+        inline void SetLodPixelError(float pixelError) { lodPixelError = pixelError; }
+        inline float GetLodPixelError() const { return lodPixelError; }
+        // Skips meshlets outside of the view or facing away from the camera
+        inline void SetMeshletCulling(bool enable) { isMeshletCullingEnabled = enable; }
+        inline bool IsMeshletCullingEnabled() const { return isMeshletCullingEnabled; }
+        // Frustum culling of the indirect draws in a compute pass, replaces LOD selection and meshlet culling for those draws
+        inline void SetGpuCulling(bool enable) { modelRenderer.SetGpuCulling(enable); }
+        inline bool IsGpuCullingEnabled() const { return modelRenderer.IsGpuCullingEnabled(); }
+        inline void SetCullValidation(bool enable) { modelRenderer.SetCullValidation(enable); }
+        inline bool IsCullValidationEnabled() const { return modelRenderer.IsCullValidationEnabled(); }
+        inline const ModelRenderer::CullStats& GetCullStats() const { return modelRenderer.GetCullStats(); }
+        inline bool RunCullSelfTest() { return modelRenderer.RunCullSelfTest(); }
 
         void SetColorModifier(const glm::vec4& colorModifier) const;
         void SetModelTransparency(float transparency) const;
@@ -53,6 +74,10 @@ namespace SGF {
         void DrawNodeRecursiveExcludeNode(const GenericModel& model, uint32_t modelIndex, const GenericModel::Node& currentNode, const GenericModel::Node& excludedNode) const;
         void DrawNodeOutline(const GenericModel& model, const GenericModel::Node& node);
         void DrawModelOutline(const GenericModel& model);
+        // Draws every node of a static model with one indirect call, the highlighted node and its children get highlightColor.
+        // Returns false if the indirect buffers of the frame are full, the model has to be drawn directly then.
+        bool DrawModelIndirect(const GenericModel& model, uint32_t modelIndex, const glm::vec4& colorModifier, float transparency,
+            const GenericModel::Node* pHighlightedNode = nullptr, const glm::vec4& highlightColor = glm::vec4(0.0f));
 		void DrawGrid();
 		void ResizeFramebuffer(uint32_t w, uint32_t h);
     private:
@@ -71,6 +96,7 @@ namespace SGF {
 
         void DrawNodeRecursiveExcludeNodePrivate(const GenericModel& model, uint32_t modelIndex, const GenericModel::Node& currentNode, const GenericModel::Node& excludedNode) const;
         void SetCurrentID(CursorHover currentID) const;
+        void HighlightNodeRecursive(const GenericModel& model, const GenericModel::Node& node, const glm::vec4& highlightColor, ModelRenderer::NodeDrawData* pNodes) const;
 		void BindStaticPipeline(VkPipeline pipeline, VkPipelineLayout pipelineLayout);
         void BindSkeletalPipeline(VkPipeline pipeline, VkPipelineLayout layout);
         CommandList commands[SGF_FRAMES_IN_FLIGHT];
@@ -91,6 +117,8 @@ namespace SGF {
         VkPipelineLayout outlineLayout;
 		VkPipeline skeletalOutlinePipeline;
         VkPipelineLayout skeletalOutlinePipelineLayout;
+        VkPipeline indirectRenderPipeline;
+        VkPipelineLayout indirectRenderPipelineLayout;
         //Cursor cursor;
         VkBuffer modelPickBuffer;
         VkDeviceMemory modelPickMemory;
@@ -100,5 +128,7 @@ namespace SGF {
 
         CursorHover hoverValue;
         uint32_t imageIndex = 0;
+        float lodPixelError = 1.0f;
+        bool isMeshletCullingEnabled = true;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "GeometryArena.hpp"
+
+namespace SGF {
+    void RangeAllocator::Initialize(VkDeviceSize rangeSize) {
+        size = rangeSize;
+        usedSize = 0;
+        freeRanges.clear();
+        if (size != 0) {
+            freeRanges.emplace(0, size);
+        }
+    }
+
+    VkDeviceSize RangeAllocator::Allocate(VkDeviceSize allocationSize, VkDeviceSize alignment) {
+        assert(alignment != 0);
+        auto best = freeRanges.end();
+        VkDeviceSize bestWaste = UINT64_MAX;
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            VkDeviceSize alignedOffset = (it->first + alignment - 1) / alignment * alignment;
+            VkDeviceSize padding = alignedOffset - it->first;
+            if (padding + allocationSize > it->second) continue;
+            VkDeviceSize waste = it->second - padding - allocationSize;
+            if (waste < bestWaste) {
+                best = it;
+                bestWaste = waste;
+                if (waste == 0) break;
+            }
+        }
+        if (best == freeRanges.end()) return INVALID_OFFSET;
+
+        const VkDeviceSize rangeOffset = best->first;
+        const VkDeviceSize rangeSize = best->second;
+        const VkDeviceSize alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+        freeRanges.erase(best);
+        // Padding in front and the rest behind stay free
+        if (alignedOffset != rangeOffset) {
+            freeRanges.emplace(rangeOffset, alignedOffset - rangeOffset);
+        }
+        const VkDeviceSize end = alignedOffset + allocationSize;
+        if (end != rangeOffset + rangeSize) {
+            freeRanges.emplace(end, rangeOffset + rangeSize - end);
+        }
+        usedSize += allocationSize;
+        return alignedOffset;
+    }
+
+    void RangeAllocator::Free(VkDeviceSize offset, VkDeviceSize freeSize) {
+        assert(offset + freeSize <= size && usedSize >= freeSize);
+        usedSize -= freeSize;
+        auto next = freeRanges.lower_bound(offset);
+        assert(next == freeRanges.end() || next->first >= offset + freeSize);
+        if (next != freeRanges.begin()) {
+            auto prev = std::prev(next);
+            assert(prev->first + prev->second <= offset);
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                freeSize += prev->second;
+                freeRanges.erase(prev);
+            }
+        }
+        if (next != freeRanges.end() && next->first == offset + freeSize) {
+            freeSize += next->second;
+            freeRanges.erase(next);
+        }
+        freeRanges.emplace(offset, freeSize);
+    }
+
+    VkDeviceSize RangeAllocator::GetLargestFreeRange() const {
+        VkDeviceSize largest = 0;
+        for (const auto& [offset, rangeSize] : freeRanges) {
+            largest = std::max(largest, rangeSize);
+        }
+        return largest;
+    }
+
+    void GeometryArena::Initialize(VkDeviceSize size, VkBufferUsageFlags bufferUsage) {
+        blockSize = size;
+        usage = bufferUsage;
+    }
+
+    void GeometryArena::Destroy() {
+        auto& device = Device::Get();
+        for (auto& block : blocks) {
+            if (block.buffer != VK_NULL_HANDLE) {
+                device.Destroy(block.buffer, block.memory);
+            }
+        }
+        blocks.clear();
+    }
+
+    uint32_t GeometryArena::CreateBlock(VkDeviceSize size) {
+        auto& device = Device::Get();
+        // Slots of destroyed blocks are reused
+        uint32_t index = 0;
+        while (index < blocks.size() && blocks[index].buffer != VK_NULL_HANDLE) {
+            ++index;
+        }
+        if (index == blocks.size()) {
+            blocks.emplace_back();
+        }
+        auto& block = blocks[index];
+        block.buffer = device.CreateBuffer(size, usage);
+        block.memory = device.AllocateMemory(block.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        block.ranges.Initialize(size);
+        block.allocationCount = 0;
+        SGF::Log::Info("Created geometry block {} with {} bytes", index, size);
+        return index;
+    }
+
+    GeometryAllocation GeometryArena::Allocate(VkDeviceSize size, VkDeviceSize alignment) {
+        GeometryAllocation allocation;
+        if (size == 0) return allocation;
+        for (uint32_t i = 0; i < blocks.size(); ++i) {
+            if (blocks[i].buffer == VK_NULL_HANDLE) continue;
+            VkDeviceSize offset = blocks[i].ranges.Allocate(size, alignment);
+            if (offset != RangeAllocator::INVALID_OFFSET) {
+                allocation.block = i;
+                allocation.offset = offset;
+                break;
+            }
+        }
+        if (!allocation.IsValid()) {
+            allocation.block = CreateBlock(std::max(size, blockSize));
+            allocation.offset = blocks[allocation.block].ranges.Allocate(size, alignment);
+            assert(allocation.offset == 0);
+        }
+        allocation.size = size;
+        blocks[allocation.block].allocationCount++;
+        return allocation;
+    }
+
+    void GeometryArena::Free(const GeometryAllocation& allocation) {
+        if (!allocation.IsValid()) return;
+        auto& block = blocks[allocation.block];
+        assert(block.allocationCount != 0);
+        block.ranges.Free(allocation.offset, allocation.size);
+        block.allocationCount--;
+        // The first block stays, so churning a single model does not create and destroy buffers
+        if (block.allocationCount == 0 && allocation.block != 0) {
+            Device::Get().Destroy(block.buffer, block.memory);
+            block.buffer = VK_NULL_HANDLE;
+            block.memory = VK_NULL_HANDLE;
+            block.ranges.Initialize(0);
+        }
+    }
+
+    GeometryArena::BlockStats GeometryArena::GetBlockStats(uint32_t index) const {
+        const auto& block = blocks[index];
+        BlockStats stats;
+        stats.size = block.ranges.GetSize();
+        stats.usedSize = block.ranges.GetUsedSize();
+        stats.largestFreeRange = block.ranges.GetLargestFreeRange();
+        stats.freeRangeCount = block.ranges.GetFreeRangeCount();
+        stats.allocationCount = block.allocationCount;
+        return stats;
+    }
+
+    VkDeviceSize GeometryArena::GetAllocatedSize() const {
+        VkDeviceSize size = 0;
+        for (const auto& block : blocks) {
+            size += block.ranges.GetSize();
+        }
+        return size;
+    }
+
+    VkDeviceSize GeometryArena::GetUsedSize() const {
+        VkDeviceSize size = 0;
+        for (const auto& block : blocks) {
+            size += block.ranges.GetUsedSize();
+        }
+        return size;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <SGF.hpp>
+#include <map>
+
+namespace SGF {
+    // Free list over [0, size), neighbouring free ranges are merged when a range is freed
+    class RangeAllocator {
+    public:
+        static constexpr VkDeviceSize INVALID_OFFSET = UINT64_MAX;
+
+        void Initialize(VkDeviceSize size);
+        // Smallest free range the aligned size fits in, INVALID_OFFSET if there is none
+        VkDeviceSize Allocate(VkDeviceSize size, VkDeviceSize alignment = 1);
+        void Free(VkDeviceSize offset, VkDeviceSize size);
+
+        inline VkDeviceSize GetSize() const { return size; }
+        inline VkDeviceSize GetUsedSize() const { return usedSize; }
+        inline size_t GetFreeRangeCount() const { return freeRanges.size(); }
+        VkDeviceSize GetLargestFreeRange() const;
+    private:
+        // Offset to size
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+        VkDeviceSize size = 0;
+        VkDeviceSize usedSize = 0;
+    };
+
+    struct GeometryAllocation {
+        uint32_t block = UINT32_MAX;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        inline bool IsValid() const { return block != UINT32_MAX; }
+    };
+
+    // Device local buffers for vertices, indices and instances, split into blocks that are sub-allocated by a free list.
+    // A new block is created when no block has room, ranges larger than the block size get a block of their own.
+    class GeometryArena {
+    public:
+        struct BlockStats {
+            VkDeviceSize size;
+            VkDeviceSize usedSize;
+            VkDeviceSize largestFreeRange;
+            size_t freeRangeCount;
+            uint32_t allocationCount;
+        };
+
+        inline GeometryArena() {}
+        GeometryArena(const GeometryArena&) = delete;
+        GeometryArena& operator=(const GeometryArena&) = delete;
+        inline ~GeometryArena() { Destroy(); }
+        void Initialize(VkDeviceSize blockSize, VkBufferUsageFlags usage);
+        void Destroy();
+        inline void Swap(GeometryArena& other) { std::swap(blocks, other.blocks); std::swap(blockSize, other.blockSize); std::swap(usage, other.usage); }
+
+        // A size of 0 returns an invalid allocation
+        GeometryAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+        // The range has to be unused by the GPU, empty blocks other than the first are destroyed
+        void Free(const GeometryAllocation& allocation);
+
+        inline VkBuffer GetBuffer(uint32_t block) const { return blocks[block].buffer; }
+        inline VkBuffer GetBuffer(const GeometryAllocation& allocation) const { return allocation.IsValid() ? blocks[allocation.block].buffer : VK_NULL_HANDLE; }
+        inline uint32_t GetBlockCount() const { return (uint32_t)blocks.size(); }
+        // Destroyed blocks keep their index, they have a size of 0
+        BlockStats GetBlockStats(uint32_t block) const;
+        VkDeviceSize GetAllocatedSize() const;
+        VkDeviceSize GetUsedSize() const;
+    private:
+        struct Block {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            RangeAllocator ranges;
+            uint32_t allocationCount = 0;
+        };
+        std::vector<Block> blocks;
+        VkDeviceSize blockSize = 0;
+        VkBufferUsageFlags usage = 0;
+
+        uint32_t CreateBlock(VkDeviceSize size);
+    };
+}
@@ -1,25 +1,34 @@
 #include "ModelRenderer.hpp"
+#include "Model/Meshlets.hpp"
+#include <algorithm>
 
 namespace SGF {
-    constexpr size_t PAGE_SIZE = 2 << 27;
     constexpr uint32_t MAX_TEXTURE_COUNT = 128;
-    constexpr uint32_t MAX_INSTANCE_COUNT = 2048;
-    constexpr uint32_t MAX_INDEX_COUNT = 2 << 22;
-
-    constexpr size_t INDEX_BUFFER_SIZE = MAX_INDEX_COUNT * sizeof(uint32_t);
-    constexpr size_t INSTANCE_BUFFER_SIZE = MAX_INSTANCE_COUNT * sizeof(glm::mat4);
-    constexpr size_t VERTEX_BUFFER_SIZE = PAGE_SIZE - INDEX_BUFFER_SIZE - INSTANCE_BUFFER_SIZE;
-
-    constexpr uint32_t MAX_VERTEX_COUNT = VERTEX_BUFFER_SIZE / sizeof(ModelRenderer::Vertex);
-
-    constexpr size_t INSTANCE_BYTE_OFFSET = 0;
-    constexpr size_t VERTEX_BYTE_OFFSET = INSTANCE_BYTE_OFFSET + INSTANCE_BUFFER_SIZE;
-    constexpr size_t INDEX_BUFFER_BYTE_OFFSET = VERTEX_BYTE_OFFSET + VERTEX_BUFFER_SIZE;
-
-    constexpr size_t VERTEX_BUFFER_OFFSETS[]{
-        VERTEX_BYTE_OFFSET,
-        INSTANCE_BYTE_OFFSET,
+    // Models larger than a block get a block of their own
+    constexpr size_t GEOMETRY_BLOCK_SIZE = MemorySize::MB_64;
+    constexpr VkBufferUsageFlags GEOMETRY_BUFFER_USAGE = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    // Initial size of the indirect buffers of a frame, they grow with the uploaded models
+    constexpr uint32_t MIN_INDIRECT_NODE_COUNT = 1024;
+    constexpr uint32_t MIN_INDIRECT_DRAW_COUNT = 4096;
+    // Lowest maxDrawIndirectCount a device with multiDrawIndirect may report
+    constexpr uint32_t MAX_DRAWS_PER_INDIRECT_CALL = 65535;
+    // Initial size of the culling buffers of a frame, counters are per model
+    constexpr uint32_t MIN_CULL_CANDIDATE_COUNT = 4096;
+    constexpr uint32_t MIN_CULL_COUNTER_COUNT = 64;
+    // local_size_x of shaders/cull_draws.comp
+    constexpr uint32_t CULL_GROUP_SIZE = 64;
+    constexpr char CULL_SHADER_FILE[] = "shaders/cull_draws.comp";
+    // Size of the fixed input of RunCullSelfTest, the candidates of a model are not a multiple of CULL_GROUP_SIZE
+    constexpr uint32_t CULL_TEST_MODEL_COUNT = 3;
+    constexpr uint32_t CULL_TEST_CANDIDATES_PER_MODEL = 1000;
+    struct CullPushConstants {
+        glm::vec4 planes[Frustum::PLANE_COUNT];
+        uint32_t candidateCount;
     };
+    // Uploads larger than a slot get a slot of their own size
+    constexpr size_t TRANSFER_SLOT_SIZE = MemorySize::MB_16;
+    constexpr size_t UPDATE_SLOT_SIZE = MemorySize::MB_1;
 
     constexpr VkVertexInputBindingDescription MODEL_VERTEX_BINDINGS[] = {
 		{0, sizeof(ModelRenderer::Vertex), VK_VERTEX_INPUT_RATE_VERTEX},
@@ -106,8 +115,7 @@ namespace SGF {
         return model.vertices.size() * sizeof(ModelRenderer::Vertex);
     }
     size_t GetRequiredTextureMemorySize(const GenericModel& model, ModelRenderer& modelRenderer) {
-        if (model.textures.size() == 0 && modelRenderer.GetTextureCount() == 0) return 4; // the size of the buffer texture
-        size_t size = 0;
+        size_t size = modelRenderer.GetTextureCount() == 0 ? 4 : 0; // the size of the default texture
         for (const auto& texture : model.textures) {
             size += texture.GetMemorySize();
         }
@@ -128,22 +136,21 @@ namespace SGF {
         color.a = static_cast<uint32_t>(glm::clamp(c.a, 0.0f, 1.0f) * 255.0f) & 0xFF;
     }
 
-    static_assert((INDEX_BUFFER_BYTE_OFFSET + INDEX_BUFFER_SIZE) <= PAGE_SIZE);
-
     constexpr char MODEL_VERTEX_SHADER_FILE[] = "shaders/model.vert";
     constexpr char MODEL_FRAGMENT_SHADER_FILE[] = "shaders/model.frag";
     const uint32_t DEFAULT_COLOR = 0xFFFFFFFF; // White
 
     void ModelRenderer::Initialize(VkRenderPass renderPass, uint32_t subpass, VkDescriptorPool descriptorPool, VkDescriptorSetLayout uniformLayout) {
         auto& device = Device::Get();
-        //totalInstanceCount = 0;
         totalVertexCount = 0;
         totalIndexCount = 0;
-        totalInstanceCount = 0;
 
         // Vertex and Index Buffers:
-        vertexBuffer = device.CreateBuffer(PAGE_SIZE, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-        vertexDeviceMemory = device.AllocateMemory(vertexBuffer);
+        geometryArena.Initialize(GEOMETRY_BLOCK_SIZE, GEOMETRY_BUFFER_USAGE);
+        boneRanges.Initialize(boneTransformsRingBuffer.GetPageSize() / sizeof(glm::mat4));
+        // Slot 0 holds the default texture of meshes without one, it is uploaded with the first model
+        textureRanges.Initialize(MAX_TEXTURE_COUNT);
+        textureRanges.Allocate(1);
 
         // Sampler:
         sampler = device.CreateImageSampler(VK_FILTER_NEAREST, VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER, 0.f, VK_FALSE, 0.f, 0, VK_COMPARE_OP_ALWAYS, 0.f, 0.f, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE);
@@ -160,6 +167,36 @@ namespace SGF {
 			    Vk::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT)
 		    };
 		    boneDescriptorLayout = device.CreateDescriptorSetLayout(layoutBindings);
+
+            VkDescriptorSetLayoutBinding nodeDataBindings[] = {
+                Vk::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT)
+            };
+            nodeDataDescriptorLayout = device.CreateDescriptorSetLayout(nodeDataBindings);
+
+            VkDescriptorSetLayoutBinding cullBindings[] = {
+                Vk::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT), // Candidates
+                Vk::CreateDescriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT), // Culled draws
+                Vk::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT) // Counters
+            };
+            cullDescriptorLayout = device.CreateDescriptorSetLayout(cullBindings);
+        }
+
+        // Culling Pipeline:
+        {
+            VkDescriptorSetLayout cullLayouts[] = { cullDescriptorLayout };
+            VkPushConstantRange cullPushConstantRanges[] = {
+                { VK_SHADER_STAGE_COMPUTE_BIT, 0, offsetof(CullPushConstants, candidateCount) + sizeof(uint32_t) }
+            };
+            cullPipelineLayout = device.CreatePipelineLayout(cullLayouts, cullPushConstantRanges);
+            VkComputePipelineCreateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            info.stage.module = device.CreateShaderModule(CULL_SHADER_FILE);
+            info.stage.pName = "main";
+            info.layout = cullPipelineLayout;
+            cullPipeline = device.CreatePipeline(info);
+            device.Destroy(info.stage.module);
         }
 
         // DescriptorSets:
@@ -201,25 +238,49 @@ namespace SGF {
 				);
 				device.UpdateDescriptors(&write, 1);
 			}
+
+            for (uint32_t i = 0; i < SGF_FRAMES_IN_FLIGHT; ++i) {
+                layouts[i] = nodeDataDescriptorLayout;
+            }
+            VkDescriptorSet nodeDataDescriptors[SGF_FRAMES_IN_FLIGHT];
+            device.AllocateDescriptorSets(descriptorPool, layouts, SGF_FRAMES_IN_FLIGHT, nodeDataDescriptors);
+            for (uint32_t i = 0; i < SGF_FRAMES_IN_FLIGHT; ++i) {
+                layouts[i] = cullDescriptorLayout;
+            }
+            VkDescriptorSet cullDescriptors[SGF_FRAMES_IN_FLIGHT];
+            device.AllocateDescriptorSets(descriptorPool, layouts, SGF_FRAMES_IN_FLIGHT, cullDescriptors);
+            for (uint32_t i = 0; i < SGF_FRAMES_IN_FLIGHT; ++i) {
+                frameDraws[i].descriptorSet = nodeDataDescriptors[i];
+                frameDraws[i].cullDescriptorSet = cullDescriptors[i];
+                ReserveFrameDraws(frameDraws[i], MIN_INDIRECT_NODE_COUNT, MIN_INDIRECT_DRAW_COUNT);
+                ReserveFrameCulling(frameDraws[i], MIN_CULL_CANDIDATE_COUNT, MIN_CULL_COUNTER_COUNT);
+            }
         }
+        // Without firstInstance the node index of a draw can not be passed, those devices only use direct draws
+        isIndirectDrawSupported = device.HasFeatureEnabled(DEVICE_FEATURE_DRAW_INDIRECT_FIRST_INSTANCE);
+        isMultiDrawIndirectSupported = device.HasFeatureEnabled(DEVICE_FEATURE_MULTI_DRAW_INDIRECT);
 
         // Transfer Objects:
-        commandPool = device.CreateGraphicsCommandPool(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
-        commandBuffer = device.AllocateCommandBuffer(commandPool);
-        fence = device.CreateFence();
+        if (device.GetTransferQueueCount() != 0) {
+            transferRing.Initialize(TRANSFER_SLOT_SIZE, device.GetTransferFamily(), device.GetTransferQueue(0), device.GetGraphicsFamily(), device.GetGraphicsQueue(0));
+        } else {
+            transferRing.Initialize(TRANSFER_SLOT_SIZE, device.GetGraphicsFamily(), device.GetGraphicsQueue(0));
+        }
+        updateRing.Initialize(UPDATE_SLOT_SIZE, device.GetGraphicsFamily(), device.GetGraphicsQueue(0));
     }
 
     ModelRenderer::~ModelRenderer() {
         auto& device = Device::Get();
-        if (stagingBuffer.GetSize() != 0) {
-            device.WaitFence(fence);
+        transferRing.Destroy();
+        updateRing.Destroy();
+        geometryArena.Destroy();
+        for (auto& frame : frameDraws) {
+            DestroyFrameDraws(frame);
         }
-        device.Destroy(fence, commandPool, textureDescriptorLayout, boneDescriptorLayout, sampler, vertexBuffer, vertexDeviceMemory, vertexWeightsMemory);
+        device.Destroy(textureDescriptorLayout, boneDescriptorLayout, nodeDataDescriptorLayout, cullDescriptorLayout, cullPipelineLayout, cullPipeline, sampler);
     }
 
     size_t ModelRenderer::UploadTexture(const TextureImage& image, const Texture& texture, size_t offset) {
-        auto& device = Device::Get();
-
         VkBufferImageCopy region{};
         region.bufferOffset = offset;
         region.imageSubresource = {};
@@ -228,101 +289,99 @@ namespace SGF {
         region.imageExtent = { texture.GetWidth(), texture.GetHeight(), 1 };
 
         size_t mem_size = texture.GetMemorySize();
-        offset = stagingBuffer.CopyData(texture.GetData(), mem_size, offset);
+        offset = staging.CopyData(texture.GetData(), mem_size, offset);
+        region.bufferOffset += staging.offset;
 
+        // The image is new, its previous contents are discarded
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
         barrier.image = image.image;
-        barrier.srcQueueFamilyIndex = device.GetGraphicsFamily();
-        barrier.dstQueueFamilyIndex = device.GetGraphicsFamily();
-        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.srcAccessMask = 0;
         barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
         barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 0, nullptr, 1, &barrier);
-        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-        barrier.srcAccessMask = barrier.dstAccessMask;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        barrier.oldLayout = barrier.newLayout;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 0, nullptr, 1, &barrier);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        transferRing.ReleaseImage(image.image, barrier.subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
         return offset;
     }
 
-    size_t ModelRenderer::UploadTextures(const GenericModel& model, size_t startOffset) {
-        auto& device = Device::Get();
+    size_t ModelRenderer::UploadTextures(const GenericModel& model, uint32_t textureOffset, size_t startOffset) {
         size_t offset = startOffset;
-        if (model.textures.size() == 0 && textures.size() == 0) {
+        if (textures.size() == 0) {
             // Create empty 1x1 default texture
             textures.push_back(textureAllocator.CreateImage(1, 1));
             Texture texture(1, 1, (uint8_t*)&DEFAULT_COLOR);
-            UploadTexture(textures.back(), texture, 0);
+            offset = UploadTexture(textures.back(), texture, offset);
             SGF::Log::Info("Uploading Dummy Texture!");
         }
-        // Copy image data:
+        if (model.textures.size() == 0) return offset;
+        if (textureOffset + model.textures.size() > textures.size()) {
+            textures.resize(textureOffset + model.textures.size(), textures[0]);
+        }
+        // Copy image data, the slots keep the default texture until the upload finished
         for (size_t i = 0; i < model.textures.size(); ++i) {
-            textures.push_back(textureAllocator.CreateImage(model.textures[i].GetWidth(), model.textures[i].GetHeight()));
-            auto& texture = textures.back();
-            offset = UploadTexture(texture, model.textures[i], offset);
+            TextureImage image = textureAllocator.CreateImage(model.textures[i].GetWidth(), model.textures[i].GetHeight());
+            offset = UploadTexture(image, model.textures[i], offset);
+            replacedTextures.push_back({ image, textureOffset + (uint32_t)i, transferRing.GetRecordingSubmission() });
         }
         return offset;
     }
 
 
-    void ModelRenderer::BeginTransfer(const GenericModel& model) {
-        size_t uploadMemorySize = GetTotalRequiredMemorySize(model, *this);
-        auto& device = Device::Get();
+    void ModelRenderer::BeginTransfer(TransferRing& ring, size_t uploadMemorySize) {
+        staging = ring.Allocate(uploadMemorySize);
+        commandBuffer = ring.GetCommandBuffer();
+    }
 
-        if (stagingBuffer.IsInitialized()) {
-            device.WaitFence(fence);
-            device.Reset(fence);
-            if (stagingBuffer.GetSize() < uploadMemorySize) 
-                stagingBuffer.Resize(uploadMemorySize);
-        } else {
-            stagingBuffer.Allocate(uploadMemorySize);
+    void ModelRenderer::CopyStagingToBuffer(VkBuffer dstBuffer, VkBufferCopy* pRegions, uint32_t regionCount) {
+        for (uint32_t i = 0; i < regionCount; ++i) {
+            pRegions[i].srcOffset += staging.offset;
         }
-        device.Reset(commandPool);
-        Vk::BeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        vkCmdCopyBuffer(commandBuffer, staging.buffer, dstBuffer, regionCount, pRegions);
     }
 
-    void ModelRenderer::FinalizeTransfer() {
-        vkEndCommandBuffer(commandBuffer);
-        Vk::SubmitCommands(Device::Get().GetGraphicsQueue(0), commandBuffer, fence);
+    void ModelRenderer::UploadGeometry(const GeometryAllocation& allocation, VkBufferCopy* pRegion, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkBuffer buffer = geometryArena.GetBuffer(allocation);
+        CopyStagingToBuffer(buffer, pRegion, 1);
+        transferRing.ReleaseBuffer(buffer, allocation.offset, allocation.size, dstStage, dstAccess);
     }
 
-    size_t ModelRenderer::PrepareIndexUpload(const GenericModel& model, size_t startOffset, VkBufferCopy* pRegion) {
+    size_t ModelRenderer::PrepareIndexUpload(const GenericModel& model, size_t startOffset, const ModelDrawData& drawData, VkBufferCopy* pRegion) {
         VkBufferCopy& indexRegion = *pRegion;
         indexRegion.size = model.indices.size() * sizeof(uint32_t);
         indexRegion.srcOffset = startOffset;
-        indexRegion.dstOffset = INDEX_BUFFER_BYTE_OFFSET + totalIndexCount * sizeof(uint32_t);
-        return stagingBuffer.CopyData(model.indices.data(), indexRegion);
+        indexRegion.dstOffset = drawData.indices.offset;
+        return staging.CopyData(model.indices.data(), indexRegion);
     }
 
-    size_t ModelRenderer::UploadVertexWeights(const GenericModel& model, size_t startOffset) {
+    size_t ModelRenderer::UploadVertexWeights(const GenericModel& model, size_t startOffset, const ModelDrawData& drawData) {
         if (model.vertexWeights.size() == 0) return startOffset;
         VkBufferCopy weightRegion;
         weightRegion.size = model.vertexWeights.size() * sizeof(model.vertexWeights[0]);
         weightRegion.srcOffset = startOffset;
-        weightRegion.dstOffset = totalWeightCount * sizeof(GenericModel::VertexWeight);
+        weightRegion.dstOffset = drawData.vertexWeights.offset;
         for (size_t i = 0; i < model.vertexWeights.size(); ++i) {
             auto weight = model.vertexWeights[i];
             // Increase indices by start positions of the bones in the Uniform Buffer
             for (size_t j = 0; j < ARRAY_SIZE(weight.boneIndices); ++j) {
-                weight.boneIndices[j] += totalBoneCount;
+                weight.boneIndices[j] += drawData.boneTransformsOffset;
             }
-            startOffset = stagingBuffer.CopyData(&weight, sizeof(weight), startOffset);
+            startOffset = staging.CopyData(&weight, sizeof(weight), startOffset);
         }
 
-        vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexWeightsBuffer, 1, &weightRegion);
+        UploadGeometry(drawData.vertexWeights, &weightRegion, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
         return startOffset;
     }
 
-    size_t ModelRenderer::PrepareVertexUpload(const GenericModel& model, size_t startOffset, VkBufferCopy* pRegion) {
-        uint32_t textureIndexOffset = textures.size();
+    size_t ModelRenderer::PrepareVertexUpload(const GenericModel& model, size_t startOffset, const ModelDrawData& drawData, VkBufferCopy* pRegion) {
+        uint32_t textureIndexOffset = drawData.textureOffset;
         VkBufferCopy& vertexRegion = *pRegion;
         vertexRegion.size = model.vertices.size() * sizeof(ModelRenderer::Vertex);
-        vertexRegion.dstOffset = VERTEX_BYTE_OFFSET + totalVertexCount * sizeof(ModelRenderer::Vertex);
+        vertexRegion.dstOffset = drawData.vertices.offset;
         vertexRegion.srcOffset = startOffset;
         size_t meshVertexCount = 0;
         for (size_t j = 0; j < model.meshes.size(); ++j) {
@@ -332,20 +391,20 @@ namespace SGF {
                 uint32_t renderTextureIndex = model.meshes[j].textureIndex == UINT32_MAX ? 0 : model.meshes[j].textureIndex + textureIndexOffset;
                 ModelRenderer::Vertex modelVertex(model.vertices[i].position, model.vertices[i].normal, model.vertices[i].uv, 
                     model.vertices[i].color, renderTextureIndex);
-                startOffset = stagingBuffer.CopyData(&modelVertex, sizeof(modelVertex), startOffset);
+                startOffset = staging.CopyData(&modelVertex, sizeof(modelVertex), startOffset);
             }
         }
         assert(meshVertexCount == model.vertices.size());
         return startOffset;
     }
 
-    size_t ModelRenderer::PrepareInstanceUpload(const GenericModel& model, size_t offset, VkBufferCopy* pRegion) {
+    size_t ModelRenderer::PrepareInstanceUpload(const GenericModel& model, size_t offset, const ModelDrawData& drawData, VkBufferCopy* pRegion) {
         auto& region = *pRegion;
         region.srcOffset = offset;
         region.size = model.nodes.size() * sizeof(glm::mat4);
-        region.dstOffset = totalInstanceCount * sizeof(glm::mat4);
+        region.dstOffset = drawData.instances.offset;
         for (size_t i = 0; i < model.nodes.size(); ++i) {
-            offset = stagingBuffer.CopyData(&model.nodes[i].globalTransform, sizeof(glm::mat4), offset);
+            offset = staging.CopyData(&model.nodes[i].globalTransform, sizeof(glm::mat4), offset);
         }
         return offset;
     }
@@ -355,62 +414,106 @@ namespace SGF {
             SGF::Log::Warn("Attempted to upload empty or null model!");
             return;
 		}
-        size_t uploadMemorySize = GetTotalRequiredMemorySize(model, *this);
+        ModelDrawData drawData;
+        drawData.textureCount = (uint32_t)model.textures.size();
+        drawData.textureOffset = 0;
+        if (drawData.textureCount != 0) {
+            VkDeviceSize textureOffset = textureRanges.Allocate(drawData.textureCount);
+            if (textureOffset == RangeAllocator::INVALID_OFFSET) {
+                SGF::Log::Error("No room for {} more textures in the texture array, model is not uploaded!", drawData.textureCount);
+                return;
+            }
+            drawData.textureOffset = (uint32_t)textureOffset;
+        }
+        drawData.boneCount = (uint32_t)model.bones.size();
+        drawData.boneTransformsOffset = 0;
+        if (drawData.boneCount != 0) {
+            VkDeviceSize boneOffset = boneRanges.Allocate(drawData.boneCount);
+            if (boneOffset == RangeAllocator::INVALID_OFFSET) {
+                SGF::Log::Warn("No room for {} more bones in the bone buffer, model is not uploaded!", drawData.boneCount);
+                if (drawData.textureCount != 0) {
+                    textureRanges.Free(drawData.textureOffset, drawData.textureCount);
+                }
+                return;
+            }
+            drawData.boneTransformsOffset = (uint32_t)boneOffset;
+        }
+        drawData.indices = geometryArena.Allocate(GetRequiredIndexMemorySize(model));
+        drawData.vertices = geometryArena.Allocate(GetRequiredVertexMemorySize(model));
+        drawData.instances = geometryArena.Allocate(GetRequiredInstanceMemorySize(model));
+        drawData.vertexWeights = geometryArena.Allocate(GetRequiredVertexWeightsMemorySize(model));
+        drawData.isInstanceUpdatePending = false;
+        drawData.cullDrawOffset = 0;
+        drawData.cullDrawCount = 0;
+        drawData.cullFrame = 0;
+        drawData.maxIndirectDrawCount = 0;
+        for (const auto& node : model.nodes) {
+            for (size_t i = 0; i < node.meshes.size(); ++i) {
+                drawData.maxIndirectDrawCount += std::max(model.GetMesh(node, i).meshletCount, 1U);
+            }
+        }
 
-        auto& device = Device::Get();
-        BeginTransfer(model);
+        size_t uploadMemorySize = GetTotalRequiredMemorySize(model, *this);
+        BeginTransfer(transferRing, uploadMemorySize);
+        // BeginTransfer may flush the ring, the copies go into the submission recorded after it
+        drawData.uploadSubmission = transferRing.GetRecordingSubmission();
 
         VkBufferCopy indexRegion;
-        size_t offset = PrepareIndexUpload(model, 0, &indexRegion);
+        size_t offset = PrepareIndexUpload(model, 0, drawData, &indexRegion);
+        UploadGeometry(drawData.indices, &indexRegion, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 
         // Copy mesh data:
         VkBufferCopy vertexRegion;
-        offset = PrepareVertexUpload(model, offset, &vertexRegion);
+        offset = PrepareVertexUpload(model, offset, drawData, &vertexRegion);
+        UploadGeometry(drawData.vertices, &vertexRegion, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
         
         VkBufferCopy instanceRegion;
-        offset = PrepareInstanceUpload(model, offset, &instanceRegion);
-        
-        VkBufferCopy regions[] = {
-            indexRegion, vertexRegion, instanceRegion
-        };
+        offset = PrepareInstanceUpload(model, offset, drawData, &instanceRegion);
+        UploadGeometry(drawData.instances, &instanceRegion, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
-        vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, ARRAY_SIZE(regions), regions);
-
-        if (model.HasSkeletalAnimation()) {
-            // Allocate Device Memory if first model with skeletal animations
-            if (vertexWeightsBuffer == VK_NULL_HANDLE) {
-                assert(vertexWeightsMemory == VK_NULL_HANDLE);
-                auto& device = Device::Get();
-                size_t requiredSize = GetRequiredVertexWeightsMemorySize(model);
-                allocatedVertexWeightsSize = MemorySize::MB_64 * (1 + (requiredSize/MemorySize::MB_64)); // Allocate enough memory
-                vertexWeightsBuffer = device.CreateBuffer(allocatedVertexWeightsSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-                vertexWeightsMemory = device.AllocateMemory(vertexWeightsBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-            }
-            offset = UploadVertexWeights(model, offset);
-        }
+        // Weights are uploaded even without animations, a progressive import delivers the animations later
+        offset = UploadVertexWeights(model, offset, drawData);
 
-        offset = UploadTextures(model, offset);
+        offset = UploadTextures(model, drawData.textureOffset, offset);
         assert(offset == uploadMemorySize);
 
-        // Submitting Commands:
-        FinalizeTransfer();
-
-        ModelDrawData drawData;
-        drawData.indexOffset = totalIndexCount;
-        drawData.vertexOffset = totalVertexCount;
-        drawData.instanceOffset = totalInstanceCount;
-        drawData.boneTransformsOffset = totalBoneCount;
-        drawData.vertexWeightOffset = totalWeightCount;
         totalIndexCount += model.indices.size();
         totalVertexCount += model.vertices.size();
-        totalInstanceCount += model.nodes.size();
-        totalBoneCount += model.bones.size();
-        totalWeightCount += model.vertexWeights.size();
+        totalNodeCount += model.nodes.size();
+        totalIndirectDrawCount += drawData.maxIndirectDrawCount;
         modelDrawData.insert({&model, drawData});
-        uploadingModel = &model;
+        UpdateCullCandidates(model);
         return;
     }
 
+    void ModelRenderer::UpdateModelTextures(const GenericModel& model) {
+        auto it = modelDrawData.find(&model);
+        if (it == modelDrawData.end()) {
+            SGF::Log::Warn("Attempted to update textures for a model that hasn't been uploaded!");
+            return;
+        }
+        const auto& drawData = it->second;
+        if (model.textures.size() != drawData.textureCount) {
+            SGF::Log::Warn("Texture count of model changed from {} to {}, textures can not be updated!", drawData.textureCount, model.textures.size());
+            return;
+        }
+        if (drawData.textureCount == 0) return;
+
+        size_t uploadMemorySize = 0;
+        for (const auto& texture : model.textures) {
+            uploadMemorySize += texture.GetMemorySize();
+        }
+        BeginTransfer(transferRing, uploadMemorySize);
+        size_t offset = 0;
+        for (uint32_t i = 0; i < drawData.textureCount; ++i) {
+            // Frames keep using the old image until the new one is handed over
+            TextureImage image = textureAllocator.CreateImage(model.textures[i].GetWidth(), model.textures[i].GetHeight());
+            offset = UploadTexture(image, model.textures[i], offset);
+            replacedTextures.push_back({ image, drawData.textureOffset + i, transferRing.GetRecordingSubmission() });
+        }
+        assert(offset == uploadMemorySize);
+    }
+
     void ModelRenderer::UpdateInstanceTransforms(const GenericModel& model) {
 		auto it = modelDrawData.find(&model);
         if (it == modelDrawData.end()) {
@@ -418,64 +521,38 @@ namespace SGF {
             return;
 		}
 		auto& drawData = it->second;
+        UpdateCullCandidates(model);
+        // The upload still owns the instance region, CheckTransferStatus updates it afterwards
+        if (drawData.uploadSubmission > transferRing.GetCompletedSubmission()) {
+            drawData.isInstanceUpdatePending = true;
+            return;
+        }
 
-        auto& device = Device::Get();
         const size_t transformCount = model.nodes.size();
         if (transformCount == 0) return;
         const size_t uploadSize = transformCount * sizeof(glm::mat4);
+        BeginTransfer(updateRing, uploadSize);
 
-        // Ensure staging buffer is ready and large enough
-        if (stagingBuffer.IsInitialized()) {
-            device.WaitFence(fence);
-            device.Reset(fence);
-            uploadingModel = nullptr;
-            if (stagingBuffer.GetSize() < uploadSize) {
-                stagingBuffer.Resize(uploadSize);
-            }
-        } else {
-            stagingBuffer.Allocate(uploadSize);
-        }
-
-        // Reset command pool and begin one-time command buffer
-        device.Reset(commandPool);
-        Vk::BeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-        // Copy transforms into staging buffer
+        // Copy transforms into staging memory
         size_t offset = 0;
         for (size_t i = 0; i < transformCount; ++i) {
-            offset = stagingBuffer.CopyData(&model.nodes[i].globalTransform, sizeof(glm::mat4), offset);
+            offset = staging.CopyData(&model.nodes[i].globalTransform, sizeof(glm::mat4), offset);
         }
 
+        // Frames submitted before may still read the old transforms
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
         // Prepare buffer copy from staging -> device-local instance region
         VkBufferCopy region{};
         region.srcOffset = 0;
-        region.dstOffset = INSTANCE_BYTE_OFFSET + drawData.instanceOffset * sizeof(glm::mat4);
+        region.dstOffset = drawData.instances.offset;
         region.size = uploadSize;
+        VkBuffer instanceBuffer = geometryArena.GetBuffer(drawData.instances);
+        CopyStagingToBuffer(instanceBuffer, &region, 1);
 
-        vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, 1, &region);
-
-        VkBufferMemoryBarrier bufferBarrier{};
-        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
-        bufferBarrier.srcQueueFamilyIndex = Device::Get().GetGraphicsFamily();
-        bufferBarrier.dstQueueFamilyIndex = Device::Get().GetGraphicsFamily();
-        bufferBarrier.buffer = vertexBuffer;
-        bufferBarrier.offset = 0; // or restrict to the dstOffset/size for tighter scope
-        bufferBarrier.size = VK_WHOLE_SIZE;
-
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-            0,
-            0, nullptr,
-            1, &bufferBarrier,
-            0, nullptr
-        );
-
-        // Submit and signal fence
-        FinalizeTransfer();
+        // Later updates of the same submission write the region again
+        updateRing.ReleaseBuffer(instanceBuffer, region.dstOffset, region.size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
     }
 
     void ModelRenderer::UpdateBoneTransforms(const GenericModel& model, const glm::mat4* pBoneTransforms, size_t count) {
@@ -488,18 +565,177 @@ namespace SGF {
         boneTransformsRingBuffer.Write(pBoneTransforms, sizeof(pBoneTransforms[0]) * count, indexOffset * sizeof(pBoneTransforms[0]));
     }
 
+    glm::mat4* ModelRenderer::GetBoneTransformsPointer(const GenericModel& model) {
+        if (!model.HasSkeletalAnimation()) return nullptr;
+        size_t indexOffset = GetBoneTransformsOffset(model);
+        if (indexOffset == SIZE_MAX) return nullptr;
+        assert((indexOffset + model.bones.size()) * sizeof(glm::mat4) <= boneTransformsRingBuffer.GetPageSize());
+        return (glm::mat4*)boneTransformsRingBuffer.GetCurrentPagePointer() + indexOffset;
+    }
+
     void ModelRenderer::PrepareDrawing(uint32_t frameIndex) {
         CheckTransferStatus();
+        // Uploads recorded since the last frame are submitted before the frame that draws them
+        updateRing.Flush();
+        transferRing.Flush();
         UpdateTextureDescriptors(frameIndex);
+        ReleaseRetiredTextures();
+        ReleaseRetiredGeometry();
         boneTransformsRingBuffer.NextPage();
+        // CommandList::Begin waited for the previous use of this frame, so its indirect buffers can be replaced
+        currentFrame = frameIndex;
+        auto& frame = frameDraws[frameIndex];
+        frame.nodeCount = 0;
+        frame.commandCount = 0;
+        ReserveFrameDraws(frame, totalNodeCount, totalIndirectDrawCount);
+        ReadCullStats(frame);
+        ReserveFrameCulling(frame, totalCullCandidateCount, (uint32_t)cullCandidates.size());
+    }
+
+    void ModelRenderer::RemoveModel(const GenericModel& model) {
+        auto it = modelDrawData.find(&model);
+        if (it == modelDrawData.end()) {
+            SGF::Log::Warn("Attempted to remove a model that hasn't been uploaded!");
+            return;
+        }
+        const auto& drawData = it->second;
+        // Palettes are written to the page of the current frame, which no frame in flight reads
+        if (drawData.boneCount != 0) {
+            boneRanges.Free(drawData.boneTransformsOffset, drawData.boneCount);
+        }
+        totalIndexCount -= model.indices.size();
+        totalVertexCount -= model.vertices.size();
+        totalNodeCount -= model.nodes.size();
+        totalIndirectDrawCount -= drawData.maxIndirectDrawCount;
+        // Replacements still uploading are discarded, the slots are freed after their upload finished
+        uint64_t lastSubmission = drawData.uploadSubmission;
+        for (auto& replaced : replacedTextures) {
+            if (replaced.index >= drawData.textureOffset && replaced.index < drawData.textureOffset + drawData.textureCount) {
+                replaced.index = UINT32_MAX;
+                lastSubmission = std::max(lastSubmission, replaced.submission);
+            }
+        }
+        auto candidates = cullCandidates.find(&model);
+        if (candidates != cullCandidates.end()) {
+            totalCullCandidateCount -= (uint32_t)candidates->second.size();
+            cullCandidates.erase(candidates);
+        }
+        retiredGeometry.push_back({ drawData, SGF_FRAMES_IN_FLIGHT + 1 });
+        retiredGeometry.back().drawData.uploadSubmission = lastSubmission;
+        modelDrawData.erase(it);
+    }
+
+    void ModelRenderer::FreeGeometry(const ModelDrawData& drawData) {
+        geometryArena.Free(drawData.indices);
+        geometryArena.Free(drawData.vertices);
+        geometryArena.Free(drawData.instances);
+        geometryArena.Free(drawData.vertexWeights);
+    }
+
+    void ModelRenderer::FreeTextures(const ModelDrawData& drawData) {
+        if (drawData.textureCount == 0) return;
+        // The descriptors of the frames still reference the images until they are rewritten
+        for (uint32_t i = drawData.textureOffset; i < drawData.textureOffset + drawData.textureCount; ++i) {
+            if (textures[i].image != textures[0].image) {
+                RetireTexture(textures[i], true);
+                textures[i] = textures[0];
+            }
+        }
+        textureRanges.Free(drawData.textureOffset, drawData.textureCount);
+        InvalidateDescriptors();
+    }
+
+    void ModelRenderer::ReleaseRetiredGeometry() {
+        // The copies of an upload that has not finished still write the ranges
+        const uint64_t completed = transferRing.GetCompletedSubmission();
+        for (size_t i = 0; i < retiredGeometry.size();) {
+            auto& retired = retiredGeometry[i];
+            if (retired.framesLeft != 0) {
+                --retired.framesLeft;
+            }
+            if (retired.framesLeft == 0 && retired.drawData.uploadSubmission <= completed) {
+                FreeGeometry(retired.drawData);
+                FreeTextures(retired.drawData);
+                retiredGeometry[i] = retiredGeometry.back();
+                retiredGeometry.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    void ModelRenderer::CompactGeometry() {
+        auto& device = Device::Get();
+        transferRing.WaitIdle();
+        updateRing.WaitIdle();
+        device.WaitIdle();
+        for (const auto& retired : retiredGeometry) {
+            FreeGeometry(retired.drawData);
+            FreeTextures(retired.drawData);
+        }
+        retiredGeometry.clear();
+
+        // Largest ranges first, so the small ones fill the gaps behind them
+        std::vector<GeometryAllocation*> allocations;
+        for (auto& [pModel, drawData] : modelDrawData) {
+            for (GeometryAllocation* pAllocation : { &drawData.indices, &drawData.vertices, &drawData.instances, &drawData.vertexWeights }) {
+                if (pAllocation->IsValid()) {
+                    allocations.push_back(pAllocation);
+                }
+            }
+        }
+        std::sort(allocations.begin(), allocations.end(), [](const GeometryAllocation* a, const GeometryAllocation* b) { return a->size > b->size; });
+
+        GeometryArena compacted;
+        compacted.Initialize(GEOMETRY_BLOCK_SIZE, GEOMETRY_BUFFER_USAGE);
+        VkCommandPool commandPool = device.CreateCommandPool(device.GetGraphicsFamily(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        VkCommandBuffer commands = device.AllocateCommandBuffer(commandPool);
+        Vk::BeginCommandBuffer(commands, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        for (GeometryAllocation* pAllocation : allocations) {
+            GeometryAllocation moved = compacted.Allocate(pAllocation->size);
+            VkBufferCopy region = { pAllocation->offset, moved.offset, pAllocation->size };
+            vkCmdCopyBuffer(commands, geometryArena.GetBuffer(*pAllocation), compacted.GetBuffer(moved), 1, &region);
+            *pAllocation = moved;
+        }
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        vkEndCommandBuffer(commands);
+        VkFence fence = device.CreateFence();
+        Vk::SubmitCommands(device.GetGraphicsQueue(0), commands, fence);
+        device.WaitFence(fence);
+        device.Destroy(fence, commandPool);
+
+        const VkDeviceSize previousSize = geometryArena.GetAllocatedSize();
+        geometryArena.Swap(compacted);
+        SGF::Log::Info("Compacted geometry from {} to {} bytes in {} blocks", previousSize, geometryArena.GetAllocatedSize(), geometryArena.GetBlockCount());
+    }
+
+    void ModelRenderer::ReleaseRetiredTextures() {
+        for (size_t i = 0; i < retiredTextures.size();) {
+            if (retiredTextures[i].unwrittenFrames == 0 && --retiredTextures[i].framesLeft == 0) {
+                textureAllocator.DestroyImage(retiredTextures[i].image);
+                retiredTextures[i] = retiredTextures.back();
+                retiredTextures.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    void ModelRenderer::RetireTexture(const TextureImage& image, bool isInDescriptors) {
+        const uint32_t unwrittenFrames = isInDescriptors ? (1u << SGF_FRAMES_IN_FLIGHT) - 1 : 0;
+        retiredTextures.push_back({ image, unwrittenFrames, SGF_FRAMES_IN_FLIGHT + 1 });
     }
 
     size_t ModelRenderer::GetTotalDeviceMemoryUsed() const {
-        return totalIndexCount * sizeof(uint32_t) + totalVertexCount * sizeof(Vertex) + /*totalInstanceCount * sizeof(glm::mat4) +*/ textureAllocator.GetUsedMemorySize();
+        return geometryArena.GetUsedSize() + textureAllocator.GetUsedMemorySize();
     }
 
     size_t ModelRenderer::GetTotalDeviceMemoryAllocated() const {
-        return PAGE_SIZE + textureAllocator.GetAllocatedSize();
+        return geometryArena.GetAllocatedSize() + textureAllocator.GetAllocatedSize();
     }
 
     size_t ModelRenderer::GetBoneTransformsOffset(const GenericModel& model) const {
@@ -519,7 +755,7 @@ namespace SGF {
             return SIZE_MAX;
         }
 		auto drawData = it->second;
-        return drawData.vertexWeightOffset;
+        return drawData.vertexWeights.offset / sizeof(GenericModel::VertexWeight);
     }
     const ModelRenderer::ModelDrawData& ModelRenderer::GetDrawData(const GenericModel& model) const {
         auto it = modelDrawData.find(&model);
@@ -542,34 +778,408 @@ namespace SGF {
         
     bool ModelRenderer::BindBuffersToModel(VkCommandBuffer commands, const GenericModel& model) const {
 		auto it = modelDrawData.find(&model);
-        if (it == modelDrawData.end() || (&model == uploadingModel)) {
+        if (it == modelDrawData.end()) {
             SGF::Log::Warn("Attempted to bind buffers for a model that hasn't been uploaded!");
 			return false;
         }
+        // Still uploading
+        if (it->second.uploadSubmission > transferRing.GetCompletedSubmission()) return false;
 		auto drawData = it->second;
         VkDeviceSize offsets[] = {
-            drawData.vertexOffset * sizeof(ModelRenderer::Vertex) + VERTEX_BYTE_OFFSET,
-            drawData.instanceOffset * sizeof(glm::mat4) + INSTANCE_BYTE_OFFSET,
-            drawData.vertexWeightOffset * sizeof(GenericModel::VertexWeight)
+            drawData.vertices.offset,
+            drawData.instances.offset,
+            drawData.vertexWeights.offset
         };
         VkBuffer buffers[] = {
-            vertexBuffer, vertexBuffer, vertexWeightsBuffer
+            geometryArena.GetBuffer(drawData.vertices), geometryArena.GetBuffer(drawData.instances), geometryArena.GetBuffer(drawData.vertexWeights)
         };
-        uint32_t bindCount = model.HasSkeletalAnimation() ? ARRAY_SIZE(buffers) : (ARRAY_SIZE(buffers) - 1);
+        uint32_t bindCount = model.HasSkeletalAnimation() && drawData.vertexWeights.IsValid() ? ARRAY_SIZE(buffers) : (ARRAY_SIZE(buffers) - 1);
         vkCmdBindVertexBuffers(commands, 0, bindCount, buffers, offsets);
-        vkCmdBindIndexBuffer(commands, vertexBuffer, INDEX_BUFFER_BYTE_OFFSET + drawData.indexOffset * sizeof(uint32_t), VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(commands, geometryArena.GetBuffer(drawData.indices), drawData.indices.offset, VK_INDEX_TYPE_UINT32);
         return true;
     }
     void ModelRenderer::DrawModel(VkCommandBuffer commands, const GenericModel& model) const {
         DrawNodeRecursive(commands, model, model.GetRoot());
     }
-    void ModelRenderer::DrawNode(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node) const {
+    void ModelRenderer::SetView(const glm::mat4& newViewProj, float viewportHeight, float lodPixelError) {
+        viewProj = newViewProj;
+        viewFrustum.SetViewProj(viewProj);
+        // Perspective projections have a w row, the camera is the point where the x, y and w planes meet
+        glm::vec4 rowX(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+        glm::vec4 rowY(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+        glm::vec4 rowW(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+        isPerspective = rowW.x != 0.0f || rowW.y != 0.0f || rowW.z != 0.0f;
+        if (isPerspective) {
+            glm::mat3 planes = glm::transpose(glm::mat3(glm::vec3(rowX), glm::vec3(rowY), glm::vec3(rowW)));
+            cameraPosition = glm::inverse(planes) * -glm::vec3(rowX.w, rowY.w, rowW.w);
+        }
+        // The y row of the projection maps view space units at w = 1 to [-1, 1]
+        lodPixelScale = glm::length(glm::vec3(rowY)) * viewportHeight * 0.5f;
+        lodPixelErrorThreshold = lodPixelError;
+    }
+    uint32_t ModelRenderer::SelectMeshLod(const GenericModel& model, const GenericModel::Node& node, const GenericModel::Mesh& mesh) const {
+        if (mesh.lodCount == 0 || lodPixelErrorThreshold <= 0.0f) return UINT32_MAX;
+        const glm::mat4& transform = node.globalTransform;
+        glm::vec4 center = transform * glm::vec4((mesh.boundingBox.min + mesh.boundingBox.max) * 0.5f, 1.0f);
+        float radius = glm::length(mesh.boundingBox.max - mesh.boundingBox.min) * 0.5f;
+        float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        float w = (viewProj * center).w;
+        // Perspective projections use the closest point of the bounding sphere, the full mesh is drawn when the camera is inside of it
+        if (isPerspective) {
+            w -= radius * scale;
+        }
+        if (w <= 0.0f) return UINT32_MAX;
+        float pixelsPerUnit = scale * lodPixelScale / w;
+        uint32_t selected = UINT32_MAX;
+        for (uint32_t i = 0; i < mesh.lodCount; ++i) {
+            if (model.meshLods[mesh.firstLod + i].error * pixelsPerUnit > lodPixelErrorThreshold) break;
+            selected = mesh.firstLod + i;
+        }
+        return selected;
+    }
+    template<typename DrawFunction>
+    void ModelRenderer::VisitNodeDraws(const GenericModel& model, const GenericModel::Node& node, DrawFunction&& draw) const {
         if (node.meshes.size() == 0) return;
+        // Meshlet bounds are in bind pose, skinned meshes are always drawn completely
+        const bool cullMeshlets = meshletCullFlags != 0 && model.vertexWeights.empty() && model.meshlets.GetCount() != 0;
+        glm::mat3 normalMatrix(1.0f);
+        if (cullMeshlets) {
+            const glm::mat3 transform(node.globalTransform);
+            normalMatrix = glm::transpose(glm::inverse(transform));
+            // The cones follow the winding, which mirroring transforms flip like the cross product of transformed edges
+            if (glm::determinant(transform) < 0.f) normalMatrix = -normalMatrix;
+        }
         for (size_t i = 0; i < node.meshes.size(); ++i) {
             auto& m = model.GetMesh(node, i);
-            vkCmdDrawIndexed(commands, m.indexCount, 1, m.indexOffset, m.vertexOffset, node.index);
+            uint32_t lod = SelectMeshLod(model, node, m);
+            if (lod != UINT32_MAX) {
+                auto& l = model.meshLods[lod];
+                draw(l.indexCount, l.indexOffset, m.vertexOffset, node.index);
+            } else if (cullMeshlets && m.meshletCount != 0) {
+                VisitMeshletDraws(model, node, m, normalMatrix, draw);
+            } else {
+                draw(m.indexCount, m.indexOffset, m.vertexOffset, node.index);
+            }
+        }
+    }
+    template<typename DrawFunction>
+    void ModelRenderer::VisitMeshletDraws(const GenericModel& model, const GenericModel::Node& node, const GenericModel::Mesh& mesh, const glm::mat3& normalMatrix, DrawFunction&& draw) const {
+        const auto& meshlets = model.meshlets;
+        const bool cullBackfaces = (meshletCullFlags & MESHLET_CULL_BACKFACE) && isPerspective;
+        uint32_t drawOffset = 0;
+        uint32_t drawCount = 0;
+        for (uint32_t i = mesh.firstMeshlet; i < mesh.firstMeshlet + mesh.meshletCount; ++i) {
+            glm::vec4 sphere = TransformBoundingSphere(node.globalTransform, meshlets.boundingSpheres[i]);
+            bool isVisible = true;
+            if (meshletCullFlags & MESHLET_CULL_FRUSTUM) {
+                isVisible = viewFrustum.IsSphereVisible(glm::vec3(sphere), sphere.w);
+            }
+            if (isVisible && cullBackfaces && meshlets.normalCones[i].w < 1.0f) {
+                glm::vec3 axis = glm::normalize(normalMatrix * glm::vec3(meshlets.normalCones[i]));
+                isVisible = !IsMeshletBackfacing(sphere, axis, meshlets.normalCones[i].w, cameraPosition);
+            }
+            if (!isVisible) continue;
+            uint32_t indexCount = meshlets.triangleCounts[i] * 3;
+            if (drawCount != 0 && drawOffset + drawCount == meshlets.indexOffsets[i]) {
+                drawCount += indexCount;
+                continue;
+            }
+            if (drawCount != 0) {
+                draw(drawCount, drawOffset, mesh.vertexOffset, node.index);
+            }
+            drawOffset = meshlets.indexOffsets[i];
+            drawCount = indexCount;
+        }
+        if (drawCount != 0) {
+            draw(drawCount, drawOffset, mesh.vertexOffset, node.index);
+        }
+    }
+    void ModelRenderer::DrawNode(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node) const {
+        VisitNodeDraws(model, node, [commands](uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+            vkCmdDrawIndexed(commands, indexCount, 1, firstIndex, vertexOffset, firstInstance);
+        });
+    }
+    void ModelRenderer::DrawMeshlets(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node, const GenericModel::Mesh& mesh, const glm::mat3& normalMatrix) const {
+        VisitMeshletDraws(model, node, mesh, normalMatrix, [commands](uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+            vkCmdDrawIndexed(commands, indexCount, 1, firstIndex, vertexOffset, firstInstance);
+        });
+    }
+    ModelRenderer::NodeDrawData* ModelRenderer::AllocateNodeDrawData(const GenericModel& model, uint32_t* pFirstNode) {
+        auto it = modelDrawData.find(&model);
+        if (it == modelDrawData.end()) return nullptr;
+        auto& frame = frameDraws[currentFrame];
+        // Reserved for every model once, a second draw of a model in the same frame uses the direct path
+        if (frame.nodeCount + model.nodes.size() > frame.nodeCapacity || frame.commandCount + it->second.maxIndirectDrawCount > frame.commandCapacity) {
+            return nullptr;
+        }
+        *pFirstNode = frame.nodeCount;
+        NodeDrawData* pNodes = frame.pNodes + frame.nodeCount;
+        frame.nodeCount += (uint32_t)model.nodes.size();
+        return pNodes;
+    }
+    void ModelRenderer::DrawModelIndirect(VkCommandBuffer commands, const GenericModel& model) {
+        auto& frame = frameDraws[currentFrame];
+        auto it = modelDrawData.find(&model);
+        if (isGpuCullingEnabled && it != modelDrawData.end() && it->second.cullFrame == cullFrameNumber) {
+            // Culled draws of the model are in front of its range, the rest is zero and draws nothing
+            SubmitIndirectDraws(commands, frame.culledBuffer, it->second.cullDrawOffset, it->second.cullDrawCount);
+            return;
+        }
+        const uint32_t firstCommand = frame.commandCount;
+        VkDrawIndexedIndirectCommand* pCommands = frame.pCommands;
+        uint32_t commandCount = firstCommand;
+        for (const auto& node : model.nodes) {
+            VisitNodeDraws(model, node, [pCommands, &commandCount](uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+                pCommands[commandCount++] = { indexCount, 1, firstIndex, vertexOffset, firstInstance };
+            });
+        }
+        assert(commandCount <= frame.commandCapacity);
+        frame.commandCount = commandCount;
+        SubmitIndirectDraws(commands, frame.commandBuffer, firstCommand, commandCount - firstCommand);
+    }
+    void ModelRenderer::SubmitIndirectDraws(VkCommandBuffer commands, VkBuffer buffer, uint32_t firstCommand, uint32_t commandCount) const {
+        constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        const uint32_t endCommand = firstCommand + commandCount;
+        if (isMultiDrawIndirectSupported) {
+            for (uint32_t first = firstCommand; first < endCommand; first += MAX_DRAWS_PER_INDIRECT_CALL) {
+                uint32_t drawCount = std::min(endCommand - first, MAX_DRAWS_PER_INDIRECT_CALL);
+                vkCmdDrawIndexedIndirect(commands, buffer, first * stride, drawCount, stride);
+            }
+        } else {
+            for (uint32_t i = firstCommand; i < endCommand; ++i) {
+                vkCmdDrawIndexedIndirect(commands, buffer, i * stride, 1, stride);
+            }
+        }
+    }
+    void ModelRenderer::UpdateCullCandidates(const GenericModel& model) {
+        auto& candidates = cullCandidates[&model];
+        totalCullCandidateCount -= (uint32_t)candidates.size();
+        candidates.clear();
+        AppendCullCandidates(model, candidates);
+        totalCullCandidateCount += (uint32_t)candidates.size();
+    }
+    void ModelRenderer::CullDraws(VkCommandBuffer commands) {
+        auto& frame = frameDraws[currentFrame];
+        frame.candidateCount = 0;
+        frame.counterCount = 0;
+        frame.cpuVisibleCount = UINT32_MAX;
+        ++cullFrameNumber;
+        if (!isGpuCullingEnabled) return;
+
+        // Every model gets its own range and counter, its draws stay in one contiguous indirect call
+        const uint64_t completed = transferRing.GetCompletedSubmission();
+        for (const auto& [pModel, candidates] : cullCandidates) {
+            auto it = modelDrawData.find(pModel);
+            assert(it != modelDrawData.end());
+            auto& drawData = it->second;
+            // Skinned vertices leave the bind pose bounds, those models are drawn by the skeletal pipelines anyway
+            if (candidates.empty() || pModel->HasSkeletalAnimation() || drawData.uploadSubmission > completed) continue;
+            // Models uploaded since PrepareDrawing keep the CPU path for this frame
+            if (frame.candidateCount + candidates.size() > frame.candidateCapacity || frame.counterCount == frame.counterCapacity) continue;
+            drawData.cullDrawOffset = frame.candidateCount;
+            drawData.cullDrawCount = (uint32_t)candidates.size();
+            drawData.cullFrame = cullFrameNumber;
+            for (const auto& candidate : candidates) {
+                CullCandidate& written = frame.pCandidates[frame.candidateCount++];
+                written = candidate;
+                written.outputOffset = drawData.cullDrawOffset;
+                written.counterIndex = frame.counterCount;
+            }
+            frame.pCounters[frame.counterCount++] = 0;
+        }
+        if (frame.candidateCount == 0) return;
+
+        constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        // Draws behind the visible ones of a model keep an index count of 0
+        vkCmdFillBuffer(commands, frame.culledBuffer, 0, (VkDeviceSize)frame.candidateCount * stride, 0);
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        CullPushConstants pushConstants;
+        for (uint32_t i = 0; i < Frustum::PLANE_COUNT; ++i) {
+            pushConstants.planes[i] = viewFrustum.planes[i];
+        }
+        pushConstants.candidateCount = frame.candidateCount;
+        vkCmdBindPipeline(commands, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commands, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+        vkCmdPushConstants(commands, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, offsetof(CullPushConstants, candidateCount) + sizeof(uint32_t), &pushConstants);
+        vkCmdDispatch(commands, (frame.candidateCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        // The counters are read by ReadCullStats once the fence of the frame is signaled
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        if (isCullValidationEnabled) {
+            validationDraws.resize(frame.candidateCount);
+            validationCounters.assign(frame.counterCount, 0);
+            frame.cpuVisibleCount = CullCandidatesCPU(frame.pCandidates, frame.candidateCount, viewFrustum, validationDraws.data(), validationCounters.data());
+        }
+    }
+    void ModelRenderer::ReadCullStats(FrameDraws& frame) {
+        if (frame.candidateCount == 0) return;
+        uint32_t visibleCount = 0;
+        for (uint32_t i = 0; i < frame.counterCount; ++i) {
+            visibleCount += frame.pCounters[i];
+        }
+        cullStats = { frame.candidateCount, visibleCount, frame.cpuVisibleCount };
+        // Spheres touching a plane may end up on different sides with the precision of the GPU
+        if (frame.cpuVisibleCount != UINT32_MAX && frame.cpuVisibleCount != visibleCount) {
+            SGF::Log::Warn("GPU culling found {} visible draws, the CPU reference {}", visibleCount, frame.cpuVisibleCount);
         }
     }
+    bool ModelRenderer::RunCullSelfTest() {
+        auto& device = Device::Get();
+        const glm::mat4 viewProj = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 40.f) * glm::lookAt(glm::vec3(0.f, 5.f, 20.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+        const Frustum frustum(viewProj);
+        std::vector<CullCandidate> candidates;
+        CreateCullTestCandidates(frustum, CULL_TEST_MODEL_COUNT, CULL_TEST_CANDIDATES_PER_MODEL, candidates);
+        const uint32_t candidateCount = (uint32_t)candidates.size();
+
+        // Buffers and descriptor set of its own, the ones of the frames may be in use
+        VkBuffer candidateBuffer = device.CreateBuffer(candidateCount * sizeof(CullCandidate), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        VkDeviceMemory candidateMemory = device.AllocateMemory(candidateBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        VkBuffer drawBuffer = device.CreateBuffer(candidateCount * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        VkDeviceMemory drawMemory = device.AllocateMemory(drawBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        VkBuffer counterBuffer = device.CreateBuffer(CULL_TEST_MODEL_COUNT * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        VkDeviceMemory counterMemory = device.AllocateMemory(counterBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        auto pCandidates = (CullCandidate*)device.MapMemory(candidateMemory);
+        auto pDraws = (VkDrawIndexedIndirectCommand*)device.MapMemory(drawMemory);
+        auto pCounters = (uint32_t*)device.MapMemory(counterMemory);
+        std::copy(candidates.begin(), candidates.end(), pCandidates);
+        std::fill(pDraws, pDraws + candidateCount, VkDrawIndexedIndirectCommand{});
+        std::fill(pCounters, pCounters + CULL_TEST_MODEL_COUNT, 0u);
+
+        VkDescriptorPoolSize poolSizes[] = {
+            Vk::CreateDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3)
+        };
+        VkDescriptorPool descriptorPool = device.CreateDescriptorPool(1, poolSizes);
+        VkDescriptorSet descriptorSet = device.AllocateDescriptorSet(descriptorPool, cullDescriptorLayout);
+        VkDescriptorBufferInfo bufferInfos[] = {
+            { candidateBuffer, 0, VK_WHOLE_SIZE },
+            { drawBuffer, 0, VK_WHOLE_SIZE },
+            { counterBuffer, 0, VK_WHOLE_SIZE }
+        };
+        for (uint32_t i = 0; i < ARRAY_SIZE(bufferInfos); ++i) {
+            device.UpdateDescriptor(descriptorSet, i, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfos[i], 1);
+        }
+
+        CullPushConstants pushConstants;
+        for (uint32_t i = 0; i < Frustum::PLANE_COUNT; ++i) {
+            pushConstants.planes[i] = frustum.planes[i];
+        }
+        pushConstants.candidateCount = candidateCount;
+        VkCommandPool commandPool = device.CreateCommandPool(device.GetGraphicsFamily(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        VkCommandBuffer commands = device.AllocateCommandBuffer(commandPool);
+        Vk::BeginCommandBuffer(commands, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        vkCmdBindPipeline(commands, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commands, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commands, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, offsetof(CullPushConstants, candidateCount) + sizeof(uint32_t), &pushConstants);
+        vkCmdDispatch(commands, (candidateCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        vkEndCommandBuffer(commands);
+        VkFence fence = device.CreateFence();
+        Vk::SubmitCommands(device.GetGraphicsQueue(0), commands, fence);
+        device.WaitFence(fence);
+
+        const bool isMatching = CompareCulledDraws(pCandidates, candidateCount, frustum, pDraws, pCounters, CULL_TEST_MODEL_COUNT);
+        uint32_t visibleCount = 0;
+        for (uint32_t i = 0; i < CULL_TEST_MODEL_COUNT; ++i) {
+            visibleCount += pCounters[i];
+        }
+        device.Destroy(fence, commandPool, descriptorPool, candidateBuffer, candidateMemory, drawBuffer, drawMemory, counterBuffer, counterMemory);
+        if (isMatching) {
+            SGF::Log::Info("Culling self test passed: {}/{} candidates visible on the GPU and the CPU", visibleCount, candidateCount);
+        } else {
+            SGF::Log::Warn("Culling self test failed: the GPU culled {} candidates differently from the CPU reference", candidateCount);
+        }
+        return isMatching;
+    }
+    void ModelRenderer::ReserveFrameDraws(FrameDraws& frame, uint32_t nodeCount, uint32_t commandCount) {
+        auto& device = Device::Get();
+        if (nodeCount > frame.nodeCapacity) {
+            if (frame.nodeBuffer != VK_NULL_HANDLE) {
+                device.Destroy(frame.nodeBuffer, frame.nodeMemory);
+            }
+            frame.nodeCapacity = std::max(nodeCount, frame.nodeCapacity * 2);
+            frame.nodeBuffer = device.CreateBuffer(frame.nodeCapacity * sizeof(NodeDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            frame.nodeMemory = device.AllocateMemory(frame.nodeBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.pNodes = (NodeDrawData*)device.MapMemory(frame.nodeMemory);
+            VkDescriptorBufferInfo bufferInfo = { frame.nodeBuffer, 0, VK_WHOLE_SIZE };
+            device.UpdateDescriptor(frame.descriptorSet, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfo, 1);
+        }
+        if (commandCount > frame.commandCapacity) {
+            if (frame.commandBuffer != VK_NULL_HANDLE) {
+                device.Destroy(frame.commandBuffer, frame.commandMemory);
+            }
+            frame.commandCapacity = std::max(commandCount, frame.commandCapacity * 2);
+            frame.commandBuffer = device.CreateBuffer(frame.commandCapacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+            frame.commandMemory = device.AllocateMemory(frame.commandBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.pCommands = (VkDrawIndexedIndirectCommand*)device.MapMemory(frame.commandMemory);
+        }
+    }
+    void ModelRenderer::ReserveFrameCulling(FrameDraws& frame, uint32_t candidateCount, uint32_t counterCount) {
+        auto& device = Device::Get();
+        bool isReplaced = false;
+        if (candidateCount > frame.candidateCapacity) {
+            if (frame.candidateBuffer != VK_NULL_HANDLE) {
+                device.Destroy(frame.candidateBuffer, frame.candidateMemory, frame.culledBuffer, frame.culledMemory);
+            }
+            frame.candidateCapacity = std::max(candidateCount, frame.candidateCapacity * 2);
+            frame.candidateBuffer = device.CreateBuffer(frame.candidateCapacity * sizeof(CullCandidate), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            frame.candidateMemory = device.AllocateMemory(frame.candidateBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.pCandidates = (CullCandidate*)device.MapMemory(frame.candidateMemory);
+            frame.culledBuffer = device.CreateBuffer(frame.candidateCapacity * sizeof(VkDrawIndexedIndirectCommand),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+            frame.culledMemory = device.AllocateMemory(frame.culledBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.candidateCount = 0;
+            isReplaced = true;
+        }
+        if (counterCount > frame.counterCapacity) {
+            if (frame.counterBuffer != VK_NULL_HANDLE) {
+                device.Destroy(frame.counterBuffer, frame.counterMemory);
+            }
+            frame.counterCapacity = std::max(counterCount, frame.counterCapacity * 2);
+            frame.counterBuffer = device.CreateBuffer(frame.counterCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            frame.counterMemory = device.AllocateMemory(frame.counterBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.pCounters = (uint32_t*)device.MapMemory(frame.counterMemory);
+            frame.counterCount = 0;
+            isReplaced = true;
+        }
+        if (isReplaced) {
+            VkDescriptorBufferInfo bufferInfos[] = {
+                { frame.candidateBuffer, 0, VK_WHOLE_SIZE },
+                { frame.culledBuffer, 0, VK_WHOLE_SIZE },
+                { frame.counterBuffer, 0, VK_WHOLE_SIZE }
+            };
+            for (uint32_t i = 0; i < ARRAY_SIZE(bufferInfos); ++i) {
+                device.UpdateDescriptor(frame.cullDescriptorSet, i, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfos[i], 1);
+            }
+        }
+    }
+    void ModelRenderer::DestroyFrameDraws(FrameDraws& frame) {
+        auto& device = Device::Get();
+        if (frame.nodeBuffer != VK_NULL_HANDLE) {
+            device.Destroy(frame.nodeBuffer, frame.nodeMemory);
+        }
+        if (frame.commandBuffer != VK_NULL_HANDLE) {
+            device.Destroy(frame.commandBuffer, frame.commandMemory);
+        }
+        if (frame.candidateBuffer != VK_NULL_HANDLE) {
+            device.Destroy(frame.candidateBuffer, frame.candidateMemory, frame.culledBuffer, frame.culledMemory);
+        }
+        if (frame.counterBuffer != VK_NULL_HANDLE) {
+            device.Destroy(frame.counterBuffer, frame.counterMemory);
+        }
+        frame = FrameDraws();
+    }
     void ModelRenderer::DrawNodeRecursive(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node) const {
         DrawNode(commands, model, node);
         for (size_t i = 0; i < node.children.size(); ++i) {
@@ -587,26 +1197,48 @@ namespace SGF {
     }
 
     void ModelRenderer::CheckTransferStatus() {
-        if (stagingBuffer.IsInitialized()) {
-            auto& device = Device::Get();
-            if (device.IsFenceSignaled(fence)) {
-                InvalidateDescriptors();
-                device.Reset(fence);
-                stagingBuffer.Clear();
-                uploadingModel = nullptr;
+        updateRing.Retire();
+        if (!transferRing.Retire()) return;
+        InvalidateDescriptors();
+        // The descriptors of every frame get rewritten now, the replaced images are destroyed after that
+        const uint64_t completed = transferRing.GetCompletedSubmission();
+        // In submission order, so the newest replacement of a texture stays
+        size_t keptCount = 0;
+        for (const auto& replaced : replacedTextures) {
+            if (replaced.submission <= completed && replaced.index == UINT32_MAX) {
+                RetireTexture(replaced.image, false);
+            } else if (replaced.submission <= completed) {
+                if (textures[replaced.index].image != textures[0].image) {
+                    RetireTexture(textures[replaced.index], true);
+                }
+                textures[replaced.index] = replaced.image;
+            } else {
+                replacedTextures[keptCount++] = replaced;
+            }
+        }
+        replacedTextures.erase(replacedTextures.begin() + keptCount, replacedTextures.end());
+        for (auto& [pModel, drawData] : modelDrawData) {
+            if (drawData.uploadSubmission <= completed && drawData.isInstanceUpdatePending) {
+                drawData.isInstanceUpdatePending = false;
+                UpdateInstanceTransforms(*pModel);
             }
         }
     }
 
     void ModelRenderer::UpdateTextureDescriptors(uint32_t frameIndex) {
         auto& device = Device::Get();
-        if (descriptorInvalidated[frameIndex]) {
+        // Every slot is written, the ones still uploading with the default texture
+        if (descriptorInvalidated[frameIndex] && !textures.empty()) {
             std::vector<VkDescriptorImageInfo> texture_info(textures.size());
             for (size_t i = 0; i < texture_info.size(); ++i) {
                 texture_info[i] = { VK_NULL_HANDLE, textures[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
             }
             device.UpdateDescriptor(descriptorSets[frameIndex], 1, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, texture_info.data(), (uint32_t)texture_info.size());
             descriptorInvalidated[frameIndex] = false;
+            // The descriptor set of this frame no longer references retired images
+            for (auto& retired : retiredTextures) {
+                retired.unwrittenFrames &= ~(1u << frameIndex);
+            }
         }
     }
 }
\ No newline at end of file
@@ -2,9 +2,18 @@
 
 #include <SGF.hpp>
 #include "Model/Model.hpp"
+#include "TransferRing.hpp"
+#include "GeometryArena.hpp"
+#include "DrawCulling.hpp"
 
 
 namespace SGF {
+    enum MeshletCullFlagBits : uint32_t {
+        MESHLET_CULL_FRUSTUM = BIT(0),
+        // Only valid for pipelines that cull back faces
+        MESHLET_CULL_BACKFACE = BIT(1),
+    };
+
     class ModelRenderer {
     public:
         struct Vertex {
@@ -16,11 +25,40 @@ namespace SGF {
             uint32_t textureIndex;
         };
         struct ModelDrawData {
-            uint32_t indexOffset;
-            uint32_t vertexOffset;
-            uint32_t instanceOffset;
-            uint32_t vertexWeightOffset;
+            // Ranges of the geometry arena, the buffers are bound at their offsets
+            GeometryAllocation indices;
+            GeometryAllocation vertices;
+            GeometryAllocation instances;
+            GeometryAllocation vertexWeights;
             uint32_t boneTransformsOffset;
+            uint32_t boneCount;
+            uint32_t textureOffset;
+            uint32_t textureCount;
+            // Transfer ring submission that uploads the model, it is not drawn before it finished
+            uint64_t uploadSubmission;
+            // Upper bound of the indirect draws of all nodes, every meshlet may become a draw
+            uint32_t maxIndirectDrawCount;
+            // Range of the model in the culled draws of the frame, only valid if cullFrame is the current one
+            uint32_t cullDrawOffset;
+            uint32_t cullDrawCount;
+            uint64_t cullFrame;
+            // Instance transforms changed during the upload, they are updated once it finished
+            bool isInstanceUpdatePending;
+        };
+        // Read by the indirect pipelines with gl_InstanceIndex, which is the node index of the draw
+        struct NodeDrawData {
+            glm::vec4 colorModifier;
+            uint32_t pickID;
+            float transparency;
+            uint32_t padding[2];
+        };
+        static_assert(sizeof(NodeDrawData) == 32, "Has to match the std430 layout of the shaders");
+        // Counts of the last culling pass the GPU finished
+        struct CullStats {
+            uint32_t candidateCount;
+            uint32_t gpuVisibleCount;
+            // UINT32_MAX if the pass was not validated
+            uint32_t cpuVisibleCount;
         };
     public:
         void Initialize(VkRenderPass renderPass, uint32_t subpass, VkDescriptorPool descriptorPool, VkDescriptorSetLayout uniformLayout);
@@ -30,11 +68,28 @@ namespace SGF {
         ~ModelRenderer();
 
         void UploadModel(const GenericModel& model);
+        // The geometry and texture slots of the model are reused once no frame in flight draws it anymore
+        void RemoveModel(const GenericModel& model);
+        // Moves the geometry of all models into as few blocks as possible, waits for the device to be idle
+        void CompactGeometry();
+        // Replaces the textures of an uploaded model, the texture count has to be the same as on upload
+        void UpdateModelTextures(const GenericModel& model);
         void UpdateInstanceTransforms(const GenericModel& model);
         void UpdateBoneTransforms(const GenericModel& model, const glm::mat4* pBoneTransforms, size_t count);
         inline void UpdateBoneTransforms(const GenericModel& model, const std::vector<glm::mat4>& boneTransforms) { UpdateBoneTransforms(model, boneTransforms.data(), boneTransforms.size()); }
+        // Bone transforms of the model in the mapped page of the current frame, so palettes can be written without a copy.
+        // Returns nullptr if the model has no skeleton or is not uploaded yet.
+        glm::mat4* GetBoneTransformsPointer(const GenericModel& model);
 
         void PrepareDrawing(uint32_t frameIndex);
+        // Camera used for LOD selection and meshlet culling in the following draws.
+        // Meshes with LODs are drawn with the coarsest LOD whose error projects to at most lodPixelError pixels,
+        // an error of 0 always draws the full meshes.
+        void SetView(const glm::mat4& viewProj, float viewportHeight, float lodPixelError);
+        // Combination of MeshletCullFlagBits, only used for the full meshes of models without skinning
+        inline void SetMeshletCullFlags(uint32_t flags) { meshletCullFlags = flags; }
+        inline uint32_t GetMeshletCullFlags() const { return meshletCullFlags; }
+        uint32_t SelectMeshLod(const GenericModel& model, const GenericModel::Node& node, const GenericModel::Mesh& mesh) const;
         bool BindBuffersToModel(VkCommandBuffer commands, const GenericModel& model) const;
         void BindPipeline(VkCommandBuffer commands, VkPipeline pipeline) const;
 
@@ -42,10 +97,36 @@ namespace SGF {
         void DrawNodeRecursive(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node) const;
         void DrawNode(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node) const;
         void DrawMesh(VkCommandBuffer commands, const GenericModel::Node& node, const GenericModel::Mesh& mesh) const;
+        // Draws the visible meshlets of the mesh, neighbouring meshlets are merged into one draw.
+        // normalMatrix transforms the cone axes, it has to be negated for nodes with a mirroring transform.
+        void DrawMeshlets(VkCommandBuffer commands, const GenericModel& model, const GenericModel::Node& node, const GenericModel::Mesh& mesh, const glm::mat3& normalMatrix) const;
+
+        // Indirect drawing needs firstInstance in indirect commands, multi draw indirect only reduces the number of calls
+        inline bool IsIndirectDrawSupported() const { return isIndirectDrawSupported; }
+        // One entry per node of the model in the node buffer of the frame, the index of the first is pushed to the indirect pipelines.
+        // Returns nullptr if the model is not ready to be drawn.
+        NodeDrawData* AllocateNodeDrawData(const GenericModel& model, uint32_t* pFirstNode);
+        // Writes the draws of all nodes into the indirect buffer of the frame and submits them with as few calls as possible.
+        // The buffers of the model have to be bound.
+        void DrawModelIndirect(VkCommandBuffer commands, const GenericModel& model);
+        // Tests the meshes of all static models against the view frustum in a compute pass and compacts the visible ones
+        // into the culled draws of the frame, which DrawModelIndirect uses instead of LOD selection and meshlet culling.
+        // Has to be recorded after SetView and outside of a render pass.
+        void CullDraws(VkCommandBuffer commands);
+        inline void SetGpuCulling(bool enable) { isGpuCullingEnabled = enable; }
+        inline bool IsGpuCullingEnabled() const { return isGpuCullingEnabled; }
+        // Runs CullCandidatesCPU on the same candidates and warns if it finds a different number of visible draws
+        inline void SetCullValidation(bool enable) { isCullValidationEnabled = enable; }
+        inline bool IsCullValidationEnabled() const { return isCullValidationEnabled; }
+        inline const CullStats& GetCullStats() const { return cullStats; }
+        // Culls fixed candidates with shaders/cull_draws.comp and compares the result with CullCandidatesCPU.
+        // Waits for the dispatch, returns false and logs the difference if the draws of a model do not match.
+        bool RunCullSelfTest();
 
         //void SetColorModifier(VkCommandBuffer commands, const glm::vec4& color = { 1.f, 1.f, 1.f, 1.f}) const;
         //void SetMeshTransform(VkCommandBuffer commands, const glm::mat4& transform) const;
 
+        inline const GeometryArena& GetGeometryArena() const { return geometryArena; }
         size_t GetTotalDeviceMemoryUsed() const;
         size_t GetTotalDeviceMemoryAllocated() const;
         inline size_t GetTextureCount() const { return textures.size(); }
@@ -64,56 +145,169 @@ namespace SGF {
         }
         inline VkDescriptorSetLayout GetTextureDescriptorSetLayout() const { return textureDescriptorLayout; }
         inline VkDescriptorSetLayout GetBoneDescriptorSetLayout() const { return boneDescriptorLayout; }
+        inline VkDescriptorSet GetNodeDataDescriptorSet(size_t index) const {
+            assert(index < SGF_FRAMES_IN_FLIGHT);
+            return frameDraws[index].descriptorSet;
+        }
+        inline VkDescriptorSetLayout GetNodeDataDescriptorSetLayout() const { return nodeDataDescriptorLayout; }
         static const VkPipelineVertexInputStateCreateInfo GetStaticModelVertexInput();
         static const VkPipelineVertexInputStateCreateInfo GetSkeletalModelVertexInput();
 
         const ModelDrawData& GetDrawData(const GenericModel& model) const;
     private:
         // Images:
+        // Indexed by the texture slot, only images whose upload finished. Free slots and slots still uploading hold the default texture of slot 0.
         std::vector<TextureImage> textures;
+        // Slots of the texture descriptor array
+        RangeAllocator textureRanges;
+        // Replaced images are destroyed once no frame in flight can reference them anymore
+        struct RetiredTexture {
+            TextureImage image;
+            // One bit per frame whose descriptor set may still reference the image, cleared when it is rewritten
+            uint32_t unwrittenFrames;
+            // Counted down once unwrittenFrames is 0
+            uint32_t framesLeft;
+        };
+        // Takes the place of textures[index] once its transfer submission finished, an index of UINT32_MAX discards it.
+        // Used for the textures of new models as well as for updated ones.
+        struct ReplacedTexture {
+            TextureImage image;
+            uint32_t index;
+            uint64_t submission;
+        };
+        std::vector<ReplacedTexture> replacedTextures;
+        std::vector<RetiredTexture> retiredTextures;
+        // Geometry of removed models, freed after the frames in flight and its upload finished
+        struct RetiredGeometry {
+            ModelDrawData drawData;
+            uint32_t framesLeft;
+        };
+        std::vector<RetiredGeometry> retiredGeometry;
         //std::vector<ModelDrawData> modelDrawData;
 		std::unordered_map<const GenericModel*, ModelDrawData> modelDrawData;
 		HostCoherentRingBuffer<SGF_FRAMES_IN_FLIGHT> boneTransformsRingBuffer;
         // Vertex buffers:
-        VkBuffer vertexBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory vertexDeviceMemory = VK_NULL_HANDLE;
-        VkBuffer vertexWeightsBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory vertexWeightsMemory = VK_NULL_HANDLE;
-        size_t allocatedVertexWeightsSize = 0;
+        GeometryArena geometryArena;
+        // Matrices of the bone buffer page
+        RangeAllocator boneRanges;
         VkSampler sampler = VK_NULL_HANDLE;
         ImageMemoryAllocator textureAllocator;
         // TransferResources:
-        VkFence fence = VK_NULL_HANDLE;
-        VkCommandPool commandPool = VK_NULL_HANDLE;
+        // Models and textures, on the transfer queue if the device has one
+        TransferRing transferRing;
+        // Small updates of data the frames in flight use, always on the graphics queue
+        TransferRing updateRing;
+        // Staging memory and commands of the upload being recorded
+        TransferRing::Allocation staging;
         VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-        StagingBuffer stagingBuffer;
-        const GenericModel* uploadingModel = nullptr;
         // Descriptors:
         VkDescriptorSet descriptorSets[SGF_FRAMES_IN_FLIGHT];
         VkDescriptorSet boneTransformsDescriptors[SGF_FRAMES_IN_FLIGHT];
         VkDescriptorSetLayout textureDescriptorLayout = VK_NULL_HANDLE;
         VkDescriptorSetLayout boneDescriptorLayout = VK_NULL_HANDLE;
+        VkDescriptorSetLayout nodeDataDescriptorLayout = VK_NULL_HANDLE;
+        VkDescriptorSetLayout cullDescriptorLayout = VK_NULL_HANDLE;
+        VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline cullPipeline = VK_NULL_HANDLE;
+        // Indirect draws, host visible and rewritten every frame. They only grow in PrepareDrawing, when the frame is not in flight.
+        struct FrameDraws {
+            VkBuffer commandBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory commandMemory = VK_NULL_HANDLE;
+            VkDrawIndexedIndirectCommand* pCommands = nullptr;
+            uint32_t commandCapacity = 0;
+            uint32_t commandCount = 0;
+            VkBuffer nodeBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory nodeMemory = VK_NULL_HANDLE;
+            NodeDrawData* pNodes = nullptr;
+            uint32_t nodeCapacity = 0;
+            uint32_t nodeCount = 0;
+            VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+            // Culling: candidates are written by the host, the culled draws and counters by shaders/cull_draws.comp
+            VkBuffer candidateBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory candidateMemory = VK_NULL_HANDLE;
+            CullCandidate* pCandidates = nullptr;
+            // Also the size of the culled draws, every candidate has a slot
+            uint32_t candidateCapacity = 0;
+            uint32_t candidateCount = 0;
+            VkBuffer culledBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory culledMemory = VK_NULL_HANDLE;
+            VkBuffer counterBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory counterMemory = VK_NULL_HANDLE;
+            uint32_t* pCounters = nullptr;
+            uint32_t counterCapacity = 0;
+            uint32_t counterCount = 0;
+            uint32_t cpuVisibleCount = UINT32_MAX;
+            VkDescriptorSet cullDescriptorSet = VK_NULL_HANDLE;
+        };
+        FrameDraws frameDraws[SGF_FRAMES_IN_FLIGHT];
+        uint32_t currentFrame = 0;
+        // Sums over the uploaded models, every model can be drawn indirectly once per frame
+        uint32_t totalNodeCount = 0;
+        uint32_t totalIndirectDrawCount = 0;
+        bool isIndirectDrawSupported = false;
+        bool isMultiDrawIndirectSupported = false;
+        // Candidates of every uploaded model in its current node transforms
+        std::unordered_map<const GenericModel*, std::vector<CullCandidate>> cullCandidates;
+        uint32_t totalCullCandidateCount = 0;
+        // Incremented by every CullDraws
+        uint64_t cullFrameNumber = 0;
+        CullStats cullStats = { 0, 0, UINT32_MAX };
+        // Output of the CPU reference
+        std::vector<VkDrawIndexedIndirectCommand> validationDraws;
+        std::vector<uint32_t> validationCounters;
+        bool isGpuCullingEnabled = false;
+        bool isCullValidationEnabled = false;
         // Pipeline:
         //VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
         uint32_t totalVertexCount = 0;
         uint32_t totalIndexCount = 0;
-        uint32_t totalInstanceCount = 0;
-        uint32_t totalWeightCount = 0;
-        uint32_t totalBoneCount = 0;
         bool descriptorInvalidated[SGF_FRAMES_IN_FLIGHT] = {};
+        // View:
+        glm::mat4 viewProj = glm::mat4(1.0f);
+        Frustum viewFrustum;
+        glm::vec3 cameraPosition = glm::vec3(0.0f);
+        bool isPerspective = false;
+        // Pixels covered by one unit at a clip space w of 1
+        float lodPixelScale = 0.0f;
+        float lodPixelErrorThreshold = 0.0f;
+        uint32_t meshletCullFlags = 0;
     private:
         void InvalidateDescriptors();
         void CheckTransferStatus();
 
         void UpdateTextureDescriptors(uint32_t imageCount);
-        void BeginTransfer(const GenericModel& model);
-        void FinalizeTransfer();
+        void ReleaseRetiredTextures();
+        // isInDescriptors is false for images that never took the place of a slot
+        void RetireTexture(const TextureImage& image, bool isInDescriptors);
+        void ReleaseRetiredGeometry();
+        void ReserveFrameDraws(FrameDraws& frame, uint32_t nodeCount, uint32_t commandCount);
+        void DestroyFrameDraws(FrameDraws& frame);
+        void ReserveFrameCulling(FrameDraws& frame, uint32_t candidateCount, uint32_t counterCount);
+        // Reads the counters of the last culling of the frame, its fence has to be signaled
+        void ReadCullStats(FrameDraws& frame);
+        // Multi draw indirect calls of at most MAX_DRAWS_PER_INDIRECT_CALL, one call per draw without it
+        void SubmitIndirectDraws(VkCommandBuffer commands, VkBuffer buffer, uint32_t firstCommand, uint32_t commandCount) const;
+        void UpdateCullCandidates(const GenericModel& model);
+        // Calls draw(indexCount, firstIndex, vertexOffset, firstInstance) for every draw of the node, after LOD selection and meshlet culling
+        template<typename DrawFunction>
+        void VisitNodeDraws(const GenericModel& model, const GenericModel::Node& node, DrawFunction&& draw) const;
+        template<typename DrawFunction>
+        void VisitMeshletDraws(const GenericModel& model, const GenericModel::Node& node, const GenericModel::Mesh& mesh, const glm::mat3& normalMatrix, DrawFunction&& draw) const;
+        void FreeGeometry(const ModelDrawData& drawData);
+        // Points the slots of the model at the default texture and retires its images
+        void FreeTextures(const ModelDrawData& drawData);
+        // Allocates staging memory from the ring, the upload is submitted with the next PrepareDrawing
+        void BeginTransfer(TransferRing& ring, size_t uploadMemorySize);
+        // Records a copy of regions relative to the staging allocation
+        void CopyStagingToBuffer(VkBuffer dstBuffer, VkBufferCopy* pRegions, uint32_t regionCount);
 
-        size_t UploadTextures(const GenericModel& model, size_t startOffset);
-        size_t PrepareVertexUpload(const GenericModel& model, size_t startOffset, VkBufferCopy* pRegion);
-        size_t PrepareIndexUpload(const GenericModel& model, size_t startOffset, VkBufferCopy* pRegion);
-        size_t PrepareInstanceUpload(const GenericModel& model, size_t offset, VkBufferCopy* pRegion);
-        size_t UploadVertexWeights(const GenericModel& model, size_t startOffset);
+        size_t UploadTextures(const GenericModel& model, uint32_t textureOffset, size_t startOffset);
+        size_t PrepareVertexUpload(const GenericModel& model, size_t startOffset, const ModelDrawData& drawData, VkBufferCopy* pRegion);
+        size_t PrepareIndexUpload(const GenericModel& model, size_t startOffset, const ModelDrawData& drawData, VkBufferCopy* pRegion);
+        size_t PrepareInstanceUpload(const GenericModel& model, size_t offset, const ModelDrawData& drawData, VkBufferCopy* pRegion);
+        size_t UploadVertexWeights(const GenericModel& model, size_t startOffset, const ModelDrawData& drawData);
+        // Copies the regions to the buffer of the allocation and hands it to the graphics queue
+        void UploadGeometry(const GeometryAllocation& allocation, VkBufferCopy* pRegion, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
         size_t UploadTexture(const TextureImage& image, const Texture& texture, size_t offset);
     };
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "TransferRing.hpp"
+
+namespace SGF {
+    void TransferRing::Initialize(size_t size, uint32_t transferFamilyIndex, VkQueue copyQueue, uint32_t graphicsFamilyIndex, VkQueue renderQueue) {
+        auto& device = Device::Get();
+        slotSize = size;
+        transferQueue = copyQueue;
+        graphicsQueue = renderQueue;
+        transferFamily = transferFamilyIndex;
+        graphicsFamily = graphicsFamilyIndex;
+        for (auto& slot : slots) {
+            slot.commandPool = device.CreateCommandPool(transferFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            slot.commandBuffer = device.AllocateCommandBuffer(slot.commandPool);
+            slot.fence = device.CreateFence();
+            if (HasHandover()) {
+                slot.acquirePool = device.CreateCommandPool(graphicsFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+                slot.acquireCommands = device.AllocateCommandBuffer(slot.acquirePool);
+                slot.acquireFence = device.CreateFence();
+                slot.semaphore = device.CreateSemaphore();
+            }
+        }
+    }
+
+    void TransferRing::Destroy() {
+        if (transferQueue == VK_NULL_HANDLE) return;
+        WaitIdle();
+        auto& device = Device::Get();
+        for (auto& slot : slots) {
+            device.Destroy(slot.fence, slot.commandPool);
+            if (HasHandover()) {
+                device.Destroy(slot.acquireFence, slot.acquirePool, slot.semaphore);
+            }
+            if (slot.stagingBuffer.IsInitialized())
+                slot.stagingBuffer.Clear();
+        }
+        transferQueue = VK_NULL_HANDLE;
+        graphicsQueue = VK_NULL_HANDLE;
+    }
+
+    TransferRing::Allocation TransferRing::Allocate(size_t size, size_t alignment) {
+        assert(transferQueue != VK_NULL_HANDLE);
+        assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+        if (recordingSlot != UINT32_MAX) {
+            auto& slot = slots[recordingSlot];
+            size_t alignedOffset = (slot.usedSize + alignment - 1) & ~(alignment - 1);
+            if (alignedOffset + size > slot.stagingBuffer.GetSize()) {
+                Flush();
+            } else {
+                slot.usedSize = alignedOffset;
+            }
+        }
+        if (recordingSlot == UINT32_MAX) {
+            BeginSlot(size);
+        }
+        auto& slot = slots[recordingSlot];
+        Allocation allocation;
+        allocation.buffer = slot.stagingBuffer;
+        allocation.offset = slot.usedSize;
+        allocation.pData = slot.stagingBuffer.Data() + slot.usedSize;
+        allocation.size = size;
+        slot.usedSize += size;
+        return allocation;
+    }
+
+    void TransferRing::ReleaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        assert(recordingSlot != UINT32_MAX);
+        auto& slot = slots[recordingSlot];
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+        if (!HasHandover()) {
+            vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            return;
+        }
+        if (transferFamily != graphicsFamily) {
+            // Release half of the queue family ownership transfer, its destination scope is ignored
+            barrier.srcQueueFamilyIndex = transferFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            barrier.dstAccessMask = dstAccess;
+        }
+        // The acquire waits for the semaphore at all commands, its source scope chains with that wait
+        barrier.srcAccessMask = 0;
+        vkCmdPipelineBarrier(slot.acquireCommands, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    void TransferRing::ReleaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        assert(recordingSlot != UINT32_MAX);
+        auto& slot = slots[recordingSlot];
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = range;
+        if (!HasHandover()) {
+            vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            return;
+        }
+        if (transferFamily != graphicsFamily) {
+            // The layout transition is part of both halves and happens once
+            barrier.srcQueueFamilyIndex = transferFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            barrier.dstAccessMask = dstAccess;
+        }
+        barrier.srcAccessMask = 0;
+        vkCmdPipelineBarrier(slot.acquireCommands, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    void TransferRing::BeginSlot(size_t requiredSize) {
+        auto& device = Device::Get();
+        auto& slot = slots[nextSlot];
+        // Only blocks when every slot is in flight, the next one is the oldest
+        WaitSlot(slot);
+        // Slots grow for uploads larger than the slot size and shrink back afterwards
+        size_t size = std::max(requiredSize, slotSize);
+        if (slot.stagingBuffer.GetSize() != size) {
+            slot.stagingBuffer.Resize(size);
+        }
+        slot.usedSize = 0;
+        device.Reset(slot.commandPool);
+        Vk::BeginCommandBuffer(slot.commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        if (HasHandover()) {
+            device.Reset(slot.acquirePool);
+            Vk::BeginCommandBuffer(slot.acquireCommands, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        }
+        slot.state = SlotState::RECORDING;
+        recordingSlot = nextSlot;
+        nextSlot = (nextSlot + 1) % SLOT_COUNT;
+    }
+
+    void TransferRing::Flush() {
+        if (recordingSlot == UINT32_MAX) return;
+        auto& slot = slots[recordingSlot];
+        vkEndCommandBuffer(slot.commandBuffer);
+        if (HasHandover()) {
+            Vk::SubmitCommands(transferQueue, slot.commandBuffer, nullptr, nullptr, 0, &slot.semaphore, 1, slot.fence);
+        } else {
+            Vk::SubmitCommands(transferQueue, slot.commandBuffer, slot.fence);
+        }
+        slot.submission = nextSubmission++;
+        slot.state = SlotState::SUBMITTED;
+        recordingSlot = UINT32_MAX;
+    }
+
+    void TransferRing::SubmitAcquire(Slot& slot) {
+        // The copies are done, so the graphics queue does not stall on the semaphore
+        vkEndCommandBuffer(slot.acquireCommands);
+        const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        Vk::SubmitCommands(graphicsQueue, slot.acquireCommands, &slot.semaphore, &waitStage, 1, nullptr, 0, slot.acquireFence);
+        slot.state = SlotState::ACQUIRING;
+    }
+
+    bool TransferRing::Retire() {
+        auto& device = Device::Get();
+        for (auto& slot : slots) {
+            if (slot.state == SlotState::SUBMITTED && device.IsFenceSignaled(slot.fence)) {
+                device.Reset(slot.fence);
+                if (HasHandover()) {
+                    SubmitAcquire(slot);
+                } else {
+                    slot.state = SlotState::FREE;
+                }
+            }
+            if (slot.state == SlotState::ACQUIRING && device.IsFenceSignaled(slot.acquireFence)) {
+                device.Reset(slot.acquireFence);
+                slot.state = SlotState::FREE;
+            }
+        }
+        UpdateCompletedSubmission();
+        // Waits may have completed submissions in between, so compare against the last call
+        bool hasCompleted = completedSubmission != retiredSubmission;
+        retiredSubmission = completedSubmission;
+        return hasCompleted;
+    }
+
+    void TransferRing::WaitSlot(Slot& slot) {
+        auto& device = Device::Get();
+        if (slot.state == SlotState::SUBMITTED) {
+            device.WaitFence(slot.fence);
+            device.Reset(slot.fence);
+            if (HasHandover()) {
+                SubmitAcquire(slot);
+            } else {
+                slot.state = SlotState::FREE;
+            }
+        }
+        if (slot.state == SlotState::ACQUIRING) {
+            device.WaitFence(slot.acquireFence);
+            device.Reset(slot.acquireFence);
+            slot.state = SlotState::FREE;
+        }
+        UpdateCompletedSubmission();
+    }
+
+    void TransferRing::WaitIdle() {
+        Flush();
+        for (auto& slot : slots) {
+            WaitSlot(slot);
+        }
+    }
+
+    void TransferRing::UpdateCompletedSubmission() {
+        // Fences may be seen out of order, only submissions older than every running one count as completed.
+        // Acquired submissions are complete for all graphics work submitted after the acquire.
+        uint64_t completed = nextSubmission - 1;
+        for (const auto& slot : slots) {
+            if (slot.state == SlotState::SUBMITTED) {
+                completed = std::min(completed, slot.submission - 1);
+            }
+        }
+        completedSubmission = std::max(completedSubmission, completed);
+    }
+
+    size_t TransferRing::GetAllocatedSize() const {
+        size_t size = 0;
+        for (const auto& slot : slots) {
+            size += slot.stagingBuffer.GetSize();
+        }
+        return size;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <SGF.hpp>
+
+namespace SGF {
+    // Staging memory for uploads, split into slots that each have their own buffer, command buffer and fence.
+    // Uploads are sub-allocated linearly from the recording slot and recorded into its command buffer, Flush submits them together.
+    // A slot is reused once its fence signaled, recording only waits for the GPU when every slot is still in flight.
+    //
+    // When the ring submits to another queue than the graphics queue, uploaded resources are handed over after the copies finished:
+    // every slot has a second command buffer on the graphics queue that waits for the copies with a semaphore and acquires the
+    // resources. It is only submitted once the copies are done, so large uploads never make the graphics queue wait.
+    class TransferRing {
+    public:
+        static constexpr uint32_t SLOT_COUNT = 4;
+        struct Allocation {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            uint8_t* pData = nullptr;
+            size_t size = 0;
+            // Offsets are relative to the allocation, like StagingBuffer::CopyData
+            inline size_t CopyData(const void* data, size_t dataSize, size_t dataOffset = 0) {
+                assert(dataSize + dataOffset <= size);
+                memcpy(pData + dataOffset, data, dataSize);
+                return dataSize + dataOffset;
+            }
+            inline size_t CopyData(const void* data, const VkBufferCopy& copyRegion) { return CopyData(data, copyRegion.size, copyRegion.srcOffset); }
+        };
+
+        // Uploads for the graphics queue that are submitted to it directly
+        inline void Initialize(size_t slotSize, uint32_t queueFamilyIndex, VkQueue queue) { Initialize(slotSize, queueFamilyIndex, queue, queueFamilyIndex, queue); }
+        // Uploads submitted to transferQueue and used on graphicsQueue
+        void Initialize(size_t slotSize, uint32_t transferFamilyIndex, VkQueue transferQueue, uint32_t graphicsFamilyIndex, VkQueue graphicsQueue);
+        // Waits for all submitted slots
+        void Destroy();
+        inline ~TransferRing() { Destroy(); }
+
+        // Space for size bytes in the recording slot, moves on to a new slot if the current one is full.
+        // Commands using the allocation have to be recorded into GetCommandBuffer() before the next Allocate.
+        Allocation Allocate(size_t size, size_t alignment = 16);
+        // Command buffer of the slot of the last allocation
+        inline VkCommandBuffer GetCommandBuffer() const { assert(recordingSlot != UINT32_MAX); return slots[recordingSlot].commandBuffer; }
+        // Makes the copies to a buffer range of the recording slot available to the graphics queue at dstStage with dstAccess
+        void ReleaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+        // Same for an image written in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, it is used in newLayout afterwards
+        void ReleaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+        // Submits the recording slot, does nothing if nothing was recorded since the last flush
+        void Flush();
+        // Polls the fences without blocking and hands finished copies over to the graphics queue.
+        // Returns true if a submission completed since the last call, including ones a wait completed.
+        bool Retire();
+        void WaitIdle();
+
+        // Submission index the recording slot gets when it is flushed, indices increase by one per flush
+        inline uint64_t GetRecordingSubmission() const { return nextSubmission; }
+        // Every submission up to this index is usable by graphics work submitted from now on
+        inline uint64_t GetCompletedSubmission() const { return completedSubmission; }
+        inline bool IsRecording() const { return recordingSlot != UINT32_MAX; }
+        // True if the copies run on another queue than the graphics work
+        inline bool HasHandover() const { return transferQueue != graphicsQueue; }
+        size_t GetAllocatedSize() const;
+    private:
+        enum class SlotState {
+            FREE,
+            RECORDING,
+            // Copies are running
+            SUBMITTED,
+            // Copies are done, the graphics queue acquires the resources
+            ACQUIRING
+        };
+        struct Slot {
+            StagingBuffer stagingBuffer;
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            // Handover to the graphics queue:
+            VkCommandPool acquirePool = VK_NULL_HANDLE;
+            VkCommandBuffer acquireCommands = VK_NULL_HANDLE;
+            VkFence acquireFence = VK_NULL_HANDLE;
+            VkSemaphore semaphore = VK_NULL_HANDLE;
+            size_t usedSize = 0;
+            uint64_t submission = 0;
+            SlotState state = SlotState::FREE;
+        };
+        Slot slots[SLOT_COUNT];
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        VkQueue graphicsQueue = VK_NULL_HANDLE;
+        uint32_t transferFamily = UINT32_MAX;
+        uint32_t graphicsFamily = UINT32_MAX;
+        size_t slotSize = 0;
+        uint32_t recordingSlot = UINT32_MAX;
+        uint32_t nextSlot = 0;
+        uint64_t nextSubmission = 1;
+        uint64_t completedSubmission = 0;
+        // Completed submission at the last Retire
+        uint64_t retiredSubmission = 0;
+
+        void BeginSlot(size_t requiredSize);
+        void SubmitAcquire(Slot& slot);
+        // Blocks until the slot is free
+        void WaitSlot(Slot& slot);
+        void UpdateCompletedSubmission();
+    };
+}
@@ -4,6 +4,8 @@
 
 void SGF::PreInit() {
 	SGF::Device::RequireFeatures(DEVICE_FEATURE_GEOMETRY_SHADER | DEVICE_FEATURE_TESSELLATION_SHADER);
+	// Optional, static models fall back to direct draws without them
+	SGF::Device::RequestFeatures(DEVICE_FEATURE_MULTI_DRAW_INDIRECT | DEVICE_FEATURE_DRAW_INDIRECT_FIRST_INSTANCE);
 	SGF::Device::RequireGraphicsQueues(1);
 	SGF::Device::RequireTransferQueues(1);
 	SGF::Window::SetCreateFlags(WINDOW_FLAG_RESIZABLE | WINDOW_FLAG_NO_COLOR_CLEAR);
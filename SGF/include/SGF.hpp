@@ -9,3 +9,4 @@
 #include "SGF/Memory.hpp"
 #include "SGF/Profiling.hpp"
 #include "SGF/Render.hpp"
+#include "SGF/Threading.hpp"
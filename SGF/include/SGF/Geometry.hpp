@@ -2,5 +2,6 @@
 
 #include "SGF_Core.hpp"
 #include "Geometry/AABB.hpp"
+#include "Geometry/Frustum.hpp"
 #include "Geometry/Math.hpp"
 #include "Geometry/Ray.hpp"
\ No newline at end of file
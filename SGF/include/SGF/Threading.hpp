@@ -0,0 +1,5 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+
+#include "Threading/ThreadPool.hpp"
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+
+namespace SGF {
+    // View frustum as six world space planes (xyz: normal pointing inwards, w: distance), extracted from a
+    // view projection matrix with the Vulkan depth range [0, 1] (Gribb and Hartmann).
+    class Frustum {
+    public:
+        enum Plane {
+            PLANE_LEFT,
+            PLANE_RIGHT,
+            PLANE_BOTTOM,
+            PLANE_TOP,
+            PLANE_NEAR,
+            PLANE_FAR,
+            PLANE_COUNT
+        };
+        glm::vec4 planes[PLANE_COUNT];
+
+        inline Frustum() { for (auto& plane : planes) plane = glm::vec4(0.f); }
+        inline Frustum(const glm::mat4& viewProj) { SetViewProj(viewProj); }
+        inline void SetViewProj(const glm::mat4& viewProj) {
+            glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+            glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+            glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+            glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+            planes[PLANE_LEFT] = row3 + row0;
+            planes[PLANE_RIGHT] = row3 - row0;
+            planes[PLANE_BOTTOM] = row3 + row1;
+            planes[PLANE_TOP] = row3 - row1;
+            planes[PLANE_NEAR] = row2;
+            planes[PLANE_FAR] = row3 - row2;
+            for (auto& plane : planes) {
+                float length = glm::length(glm::vec3(plane));
+                if (length > 0.f) plane /= length;
+            }
+        }
+        inline float GetDistance(Plane plane, const glm::vec3& point) const {
+            return glm::dot(glm::vec3(planes[plane]), point) + planes[plane].w;
+        }
+        // Conservative, spheres close to the frustum corners may be reported as visible
+        inline bool IsSphereVisible(const glm::vec3& center, float radius) const {
+            for (uint32_t i = 0; i < PLANE_COUNT; ++i) {
+                if (GetDistance((Plane)i, center) < -radius) return false;
+            }
+            return true;
+        }
+        // Conservative like IsSphereVisible: tests the box corner furthest along every plane normal
+        inline bool IsBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+            for (const auto& plane : planes) {
+                glm::vec3 corner(plane.x >= 0.f ? boundsMax.x : boundsMin.x, plane.y >= 0.f ? boundsMax.y : boundsMin.y, plane.z >= 0.f ? boundsMax.z : boundsMin.z);
+                if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) return false;
+            }
+            return true;
+        }
+    };
+}
@@ -14,7 +14,8 @@ namespace SGF {
         if (!pixels) SGF::Log::Fatal("Failed to load texture!");
     }
     Texture::Texture(uint32_t width, uint32_t height, const uint8_t* data) : area{width, height} {
-        pixels = new uint8_t[width * height * 4];
+        pixels = (uint8_t*)malloc(width * height * 4);
+        if (!pixels) SGF::Log::Fatal("Failed to allocate memory!");
         memcpy(pixels, data, width * height * 4);
     }
     Texture::Texture(const Texture& other) {
@@ -0,0 +1,101 @@
+#include "Threading/ThreadPool.hpp"
+
+namespace SGF {
+    ThreadPool& ThreadPool::Get() {
+        static ThreadPool s_Instance(std::max(std::thread::hardware_concurrency(), 2U) - 1);
+        return s_Instance;
+    }
+
+    ThreadPool::ThreadPool(uint32_t threadCount) {
+        assert(threadCount != 0);
+        workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(queueMutex);
+            isStopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::Enqueue(std::function<void()>&& task) {
+        {
+            std::lock_guard lock(queueMutex);
+            tasks.push_back(std::move(task));
+        }
+        queueCondition.notify_one();
+    }
+
+    bool ThreadPool::RunPendingTask() {
+        std::function<void()> task;
+        {
+            std::lock_guard lock(queueMutex);
+            if (tasks.empty()) return false;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    void ThreadPool::WorkerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(queueMutex);
+                queueCondition.wait(lock, [this]() { return isStopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func, size_t batchSize) {
+        if (count == 0) return;
+        batchSize = std::max(batchSize, (size_t)1);
+        size_t batchCount = (count + batchSize - 1) / batchSize;
+        if (batchCount == 1) {
+            for (size_t i = 0; i < count; ++i) func(i);
+            return;
+        }
+        struct SharedState {
+            std::atomic<size_t> nextBatch = 0;
+            std::atomic<uint32_t> activeHelpers = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<SharedState>();
+        // Helpers only touch func while a batch is left, which can not happen after the caller returned
+        auto runBatches = [state, count, batchSize, batchCount, pFunc = &func]() {
+            size_t batch;
+            while ((batch = state->nextBatch.fetch_add(1)) < batchCount) {
+                size_t end = std::min(count, (batch + 1) * batchSize);
+                for (size_t i = batch * batchSize; i < end; ++i) {
+                    (*pFunc)(i);
+                }
+            }
+        };
+        size_t helperCount = std::min(batchCount - 1, workers.size());
+        for (size_t i = 0; i < helperCount; ++i) {
+            Enqueue([state, runBatches]() {
+                state->activeHelpers.fetch_add(1);
+                runBatches();
+                if (state->activeHelpers.fetch_sub(1) == 1) {
+                    std::lock_guard lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            });
+        }
+        runBatches();
+        std::unique_lock lock(state->mutex);
+        state->finished.wait(lock, [&state]() { return state->activeHelpers.load() == 0; });
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SGF_Core.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <atomic>
+
+namespace SGF {
+    class ThreadPool {
+    public:
+        // Shared pool with one worker per hardware thread except the calling one
+        static ThreadPool& Get();
+
+        ThreadPool(uint32_t threadCount);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        inline uint32_t GetThreadCount() const { return (uint32_t)workers.size(); }
+
+        void Enqueue(std::function<void()>&& task);
+        template<typename FUNC>
+        inline auto Submit(FUNC&& func) -> std::future<std::invoke_result_t<std::decay_t<FUNC>>> {
+            using RESULT = std::invoke_result_t<std::decay_t<FUNC>>;
+            auto task = std::make_shared<std::packaged_task<RESULT()>>(std::forward<FUNC>(func));
+            auto future = task->get_future();
+            Enqueue([task]() { (*task)(); });
+            return future;
+        }
+        // Runs one queued task on the calling thread, returns false if the queue was empty.
+        bool RunPendingTask();
+        // Waits for the future while working on queued tasks, so waiting on a worker thread can not deadlock the pool.
+        template<typename T>
+        inline void Wait(const std::future<T>& future) {
+            while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                if (!RunPendingTask()) {
+                    future.wait_for(std::chrono::milliseconds(1));
+                }
+            }
+        }
+        // Calls func(i) for every i in [0, count) and returns when all calls are finished.
+        // The calling thread takes part in the work, so nested calls from worker threads can not deadlock.
+        void ParallelFor(size_t count, const std::function<void(size_t)>& func, size_t batchSize = 1);
+    private:
+        void WorkerLoop();
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        bool isStopping = false;
+    };
+}
@@ -333,6 +333,45 @@ namespace SGF {
 
 		return filepath;
 	}
+	std::vector<std::string> WindowHandle::OpenMultipleFilesDialog(const FileFilter* pFilters, uint32_t filterCount) const {
+        assert(nativeHandle);
+		NFD_Init();
+
+		const nfdpathset_t* outPaths;
+		nfdopendialogu8args_t args = { 0 };
+
+		std::vector<std::string> filepaths;
+		if (!NFD_GetNativeWindowFromGLFWWindow((GLFWwindow*)nativeHandle, &args.parentWindow)) {
+			SGF::Log::Warn("Failed to get native window handle for file dialog parent! File dialog may not work correctly!");
+		}
+		args.filterList = (const nfdu8filteritem_t*)(pFilters);
+		args.filterCount = filterCount;
+		nfdresult_t result = NFD_OpenDialogMultipleU8_With(&outPaths, &args);
+
+		if (result == NFD_OKAY) {
+			nfdpathsetsize_t pathCount = 0;
+			NFD_PathSet_GetCount(outPaths, &pathCount);
+			filepaths.reserve(pathCount);
+			for (nfdpathsetsize_t i = 0; i < pathCount; ++i) {
+				nfdu8char_t* path;
+				if (NFD_PathSet_GetPathU8(outPaths, i, &path) == NFD_OKAY) {
+					filepaths.emplace_back(path);
+					NFD_PathSet_FreePathU8(path);
+				}
+			}
+			SGF::Log::Info("Picked {} files", filepaths.size());
+			NFD_PathSet_Free(outPaths);
+		}
+		else if (result == NFD_CANCEL) {
+			SGF::Log::Info("User pressed cancel.");
+		}
+		else {
+			SGF::Log::Error("File dialog error: {}", NFD_GetError());
+		}
+		NFD_Quit();
+
+		return filepaths;
+	}
 	std::string WindowHandle::SaveFileDialog(const FileFilter* pFilters, uint32_t filterCount) const
 	{
         assert(nativeHandle);
@@ -67,6 +67,10 @@ namespace SGF {
         template<uint32_t COUNT>
 		inline std::string OpenFileDialog(const FileFilter(&filters)[COUNT]) const { return OpenFileDialog(filters, COUNT); }
 
+		std::vector<std::string> OpenMultipleFilesDialog(const FileFilter* pFilters, uint32_t filterCount) const;
+		inline std::vector<std::string> OpenMultipleFilesDialog(const FileFilter& filter) const { return OpenMultipleFilesDialog(&filter, 1); }
+		inline std::vector<std::string> OpenMultipleFilesDialog(const char* filterDescription, const char* filter) const { return OpenMultipleFilesDialog(FileFilter(filterDescription, filter)); }
+
 		std::string SaveFileDialog(const FileFilter* pFilters, uint32_t filterCount) const;
 		inline std::string SaveFileDialog(const FileFilter& filter) const { return SaveFileDialog(&filter, 1); }
 		inline std::string SaveFileDialog(const char* filterDescription, const char* filter) const { return SaveFileDialog(FileFilter(filterDescription, filter)); }